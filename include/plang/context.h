@@ -76,6 +76,18 @@ p_goal_result p_context_call_once
 int p_context_is_debug(p_context *context);
 void p_context_set_debug(p_context *context, int debug);
 
+int p_context_is_occurs_check(p_context *context);
+void p_context_set_occurs_check(p_context *context, int occurs_check);
+
+int p_context_is_eager_compile(p_context *context);
+void p_context_set_eager_compile(p_context *context, int eager_compile);
+
+int p_context_is_consult_cache(p_context *context);
+void p_context_set_consult_cache(p_context *context, int consult_cache);
+
+int p_context_save_image(p_context *context, const char *filename);
+int p_context_load_image(p_context *context, const char *filename);
+
 void p_context_add_import_path(p_context *context, const char *path);
 void p_context_add_library_path(p_context *context, const char *path);
 
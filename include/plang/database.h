@@ -41,7 +41,10 @@ typedef enum {
     P_PREDICATE_NONE            = 0x00,
     P_PREDICATE_COMPILED        = 0x01,
     P_PREDICATE_DYNAMIC         = 0x02,
-    P_PREDICATE_BUILTIN         = 0x04
+    P_PREDICATE_BUILTIN         = 0x04,
+    P_PREDICATE_NO_OCCURS_CHECK = 0x08,
+    P_PREDICATE_TABLED          = 0x10,
+    P_PREDICATE_MEMO            = 0x20
 } p_predicate_flags;
 
 p_op_specifier p_db_operator_info(const p_term *name, int arity, int *priority);
@@ -112,9 +112,9 @@ p_term *p_term_lookup_predicate(p_context *context, p_term *name, int arity);
 typedef struct p_term_clause_iter p_term_clause_iter;
 struct p_term_clause_iter
 {
-    struct p_term_clause *next1;
-    struct p_term_clause *next2;
-    struct p_term_clause *next3;
+    struct p_term_clause *next;
+    struct p_term_clause **group;
+    unsigned int group_size;
 };
 /** @endcond */
 void p_term_clauses_begin(const p_term *predicate, const p_term *head, p_term_clause_iter *iter);
@@ -49,6 +49,8 @@ int main(int argc, char *argv[])
     int exitval;
     const char *filename;
     const char *main_pred = "main";
+    const char *image = 0;
+    const char *save_image = 0;
 
     /* Process leading options for the plang engine itself */
     context = p_context_create();
@@ -95,6 +97,36 @@ int main(int argc, char *argv[])
             main_pred = argv[1] + 2;
         } else if (!strncmp(argv[1], "--main=", 7)) {
             main_pred = argv[1] + 7;
+        } else if (!strcmp(argv[1], "-e") ||
+                   !strcmp(argv[1], "--eager-compile")) {
+            p_context_set_eager_compile(context, 1);
+        } else if (!strcmp(argv[1], "-c") ||
+                   !strcmp(argv[1], "--cache")) {
+            p_context_set_consult_cache(context, 1);
+        } else if (!strcmp(argv[1], "--image")) {
+            ++argv;
+            --argc;
+            if (argc <= 1) {
+                fprintf(stderr, "%s: missing image pathname\n",
+                        progname);
+                p_context_free(context);
+                return 1;
+            }
+            image = argv[1];
+        } else if (!strcmp(argv[1], "--save-image")) {
+            ++argv;
+            --argc;
+            if (argc <= 1) {
+                fprintf(stderr, "%s: missing image pathname\n",
+                        progname);
+                p_context_free(context);
+                return 1;
+            }
+            save_image = argv[1];
+        } else if (!strncmp(argv[1], "--image=", 8)) {
+            image = argv[1] + 8;
+        } else if (!strncmp(argv[1], "--save-image=", 13)) {
+            save_image = argv[1] + 13;
         } else if (!strcmp(argv[1], "--")) {
             ++argv;
             --argc;
@@ -111,7 +143,10 @@ int main(int argc, char *argv[])
 
     /* Load the contents of the input file.  If no file supplied,
      * then load up an interactive shell */
-    if (argc < 2) {
+    if (image) {
+        filename = image;
+        error = p_context_load_image(context, image);
+    } else if (argc < 2) {
         error = p_context_consult_string(context, shell_main);
         filename = "shell.lp";
         main_pred = "shell::frontend_main";
@@ -131,12 +166,26 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    /* Create the argument list to pass to main/1 */
+    /* Save the state of the program to an image if requested */
+    if (save_image) {
+        error = p_context_save_image(context, save_image);
+        if (error != 0)
+            fprintf(stderr, "%s: %s\n", save_image, strerror(error));
+        p_context_free(context);
+        return error != 0;
+    }
+
+    /* Create the argument list to pass to main/1.  When running
+     * from an image, the image takes the place of the input file */
     args = p_term_nil_atom(context);
     for (index = argc - 1; index >= 1; --index) {
         args = p_term_create_list
             (context, p_term_create_string(context, argv[index]), args);
     }
+    if (image) {
+        args = p_term_create_list
+            (context, p_term_create_string(context, image), args);
+    }
 
     /* Create and execute the main(Args) or main() goal */
     main_atom = p_term_create_atom(context, main_pred);
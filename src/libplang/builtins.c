@@ -51,6 +51,7 @@
  * \par Clause handling
  * \ref abolish_1 "abolish/1",
  * \ref abolish_2 "abolish/2",
+ * \ref abolish_all_tables_0 "abolish_all_tables/0",
  * \ref abolish_database_1 "abolish_database/1",
  * \ref asserta_1 "asserta/1",
  * \ref asserta_2 "asserta/2",
@@ -66,10 +67,16 @@
  * \ref directive_1 "(:-)/1",
  * \ref initialization_1 "(?-)/1",
  * \ref consult_1 "consult/1",
+ * \ref current_prolog_flag_2 "current_prolog_flag/2",
  * \ref dynamic_1 "dynamic/1",
  * \ref import_1 "import/1",
+ * \ref index_depth_2 "index_depth/2",
  * \ref initialization_1 "initialization/1",
- * \ref load_library_1 "load_library/1"
+ * \ref load_library_1 "load_library/1",
+ * \ref memo_nonterminal_1 "memo_nonterminal/1",
+ * \ref no_occurs_check_1 "no_occurs_check/1",
+ * \ref set_prolog_flag_2 "set_prolog_flag/2",
+ * \ref table_1 "table/1"
  *
  * \par Logic and control
  * \ref logical_and_2 "(&amp;&amp;)/2",
@@ -807,11 +814,6 @@ static p_goal_result p_builtin_call_member
     p_term *predicate;
     p_term *list;
     p_term_clause_iter clause_iter;
-    p_term *clause;
-    p_term *body;
-    p_exec_node *current;
-    p_exec_node *new_current;
-    p_exec_clause_node *next;
     int arity;
 
     /* Validate the parameters */
@@ -861,40 +863,10 @@ static p_goal_result p_builtin_call_member
     }
 
     /* Search for the first predicate clause that matches */
+    if (predicate->predicate.lazy_clauses)
+        _p_term_compile_clauses(context, predicate);
     p_term_clauses_begin(predicate, arg_head, &clause_iter);
-    while ((clause = p_term_clauses_next(&clause_iter)) != 0) {
-        body = p_term_unify_clause(context, arg_head, clause);
-        if (body) {
-            current = context->current_node;
-            if (p_term_clauses_has_more(&clause_iter)) {
-                next = GC_NEW(p_exec_clause_node);
-                new_current = GC_NEW(p_exec_node);
-                if (!next || !new_current)
-                    return P_RESULT_FAIL;
-                next->parent.parent.goal = arg_head;
-                next->parent.parent.success_node = current->success_node;
-                next->parent.parent.cut_node = context->fail_node;
-                _p_context_init_fail_node
-                    (context, &(next->parent), _p_context_clause_fail_func);
-                next->clause_iter = clause_iter;
-                new_current->goal = body;
-                new_current->success_node = current->success_node;
-                new_current->cut_node = context->fail_node;
-                context->current_node = new_current;
-                context->fail_node = &(next->parent);
-            } else {
-                new_current = GC_NEW(p_exec_node);
-                if (!new_current)
-                    return P_RESULT_FAIL;
-                new_current->goal = body;
-                new_current->success_node = current->success_node;
-                new_current->cut_node = context->fail_node;
-                context->current_node = new_current;
-            }
-            return P_RESULT_TREE_CHANGE;
-        }
-    }
-    return P_RESULT_FAIL;
+    return _p_context_call_clauses(context, arg_head, &clause_iter);
 }
 
 /*\@}*/
@@ -999,6 +971,7 @@ static p_goal_result p_builtin_call_member
  *
  * \ref abolish_1 "abolish/1",
  * \ref abolish_2 "abolish/2",
+ * \ref abolish_all_tables_0 "abolish_all_tables/0",
  * \ref abolish_database_1 "abolish_database/1",
  * \ref asserta_1 "asserta/1",
  * \ref asserta_2 "asserta/2",
@@ -1507,8 +1480,8 @@ static void _p_context_fetch_clause_fail_func
         body = p_term_unify_clause(context, current->head, clause);
         if (body && p_term_unify(context, current->body, body, P_BIND_DEFAULT)) {
             if (p_term_clauses_has_more(&clause_iter)) {
-                next = GC_NEW(p_exec_node);
-                retry = GC_NEW(p_exec_clause_fetch_node);
+                next = p_exec_new(context, p_exec_node);
+                retry = p_exec_new(context, p_exec_clause_fetch_node);
                 if (!next || !retry) {
                     current->parent.parent.goal = context->fail_atom;
                     return;
@@ -1531,7 +1504,7 @@ static void _p_context_fetch_clause_fail_func
                 context->current_node = next;
                 context->fail_node = &(retry->parent);
             } else {
-                next = GC_NEW(p_exec_node);
+                next = p_exec_new(context, p_exec_node);
                 if (next) {
                     next->goal = context->true_atom;
                     next->success_node = current->parent.parent.success_node;
@@ -1545,7 +1518,7 @@ static void _p_context_fetch_clause_fail_func
         }
         p_context_backtrack_trail(context, marker);
     }
-    next = GC_NEW(p_exec_node);
+    next = p_exec_new(context, p_exec_node);
     if (next) {
         next->goal = context->fail_atom;
         next->success_node = current->parent.parent.success_node;
@@ -1637,6 +1610,8 @@ static p_goal_result p_builtin_clause
     }
 
     /* Find the first clause that matches */
+    if (info->predicate->predicate.lazy_clauses)
+        _p_term_compile_clauses(context, info->predicate);
     p_term_clauses_begin(info->predicate, head, &clause_iter);
     while ((clause = p_term_clauses_next(&clause_iter)) != 0) {
         marker = p_context_mark_trail(context);
@@ -1644,8 +1619,8 @@ static p_goal_result p_builtin_clause
         if (body && p_term_unify(context, args[1], body, P_BIND_DEFAULT)) {
             if (p_term_clauses_has_more(&clause_iter)) {
                 current = context->current_node;
-                next = GC_NEW(p_exec_node);
-                retry = GC_NEW(p_exec_clause_fetch_node);
+                next = p_exec_new(context, p_exec_node);
+                retry = p_exec_new(context, p_exec_clause_fetch_node);
                 if (!next || !retry)
                     return P_RESULT_FAIL;
                 next->goal = context->true_atom;
@@ -1745,6 +1720,8 @@ static p_goal_result p_builtin_clause_3
         return P_RESULT_FAIL;
 
     /* Find the first clause that matches */
+    if (predicate->predicate.lazy_clauses)
+        _p_term_compile_clauses(context, predicate);
     p_term_clauses_begin(predicate, head, &clause_iter);
     while ((clause = p_term_clauses_next(&clause_iter)) != 0) {
         marker = p_context_mark_trail(context);
@@ -1752,8 +1729,8 @@ static p_goal_result p_builtin_clause_3
         if (body && p_term_unify(context, args[1], body, P_BIND_DEFAULT)) {
             if (p_term_clauses_has_more(&clause_iter)) {
                 current = context->current_node;
-                next = GC_NEW(p_exec_node);
-                retry = GC_NEW(p_exec_clause_fetch_node);
+                next = p_exec_new(context, p_exec_node);
+                retry = p_exec_new(context, p_exec_clause_fetch_node);
                 if (!next || !retry)
                     return P_RESULT_FAIL;
                 next->goal = context->true_atom;
@@ -2068,10 +2045,16 @@ static p_goal_result p_builtin_retract_2
  * \ref directive_1 "(:-)/1",
  * \ref initialization_1 "(?-)/1",
  * \ref consult_1 "consult/1",
+ * \ref current_prolog_flag_2 "current_prolog_flag/2",
  * \ref dynamic_1 "dynamic/1",
  * \ref import_1 "import/1",
+ * \ref index_depth_2 "index_depth/2",
  * \ref initialization_1 "initialization/1",
- * \ref load_library_1 "load_library/1"
+ * \ref load_library_1 "load_library/1",
+ * \ref memo_nonterminal_1 "memo_nonterminal/1",
+ * \ref no_occurs_check_1 "no_occurs_check/1",
+ * \ref set_prolog_flag_2 "set_prolog_flag/2",
+ * \ref table_1 "table/1"
  */
 /*\@{*/
 
@@ -2187,6 +2170,77 @@ static p_goal_result p_builtin_consult
     }
 }
 
+/* Look up the Plang-level name for a Standard Prolog flag value */
+static p_term *p_builtin_flag_value(p_context *context, int value)
+{
+    if (value)
+        return context->true_atom;
+    else
+        return p_term_create_atom(context, "false");
+}
+
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor current_prolog_flag_2
+ * <b>current_prolog_flag/2</b> - gets the value of a system flag.
+ *
+ * \par Usage
+ * \b current_prolog_flag(\em Flag, \em Value)
+ *
+ * \par Description
+ * Unifies \em Value with the current value of \em Flag.
+ * If \em Flag is a variable, then it is unified with the
+ * name of a supported flag.  The following flags are supported:
+ *
+ * \li <tt>occurs_check</tt> - \c true if \ref unify_2 "(=)/2"
+ *     and clause head unification perform an occurs check,
+ *     or \c false if they do not.  The default is \c true.
+ *
+ * \par Errors
+ *
+ * \li <tt>type_error(atom, \em Flag)</tt> - \em Flag is not
+ *     a variable or an atom.
+ * \li <tt>domain_error(prolog_flag, \em Flag)</tt> - \em Flag
+ *     is not a supported flag name.
+ *
+ * \par Examples
+ * \code
+ * current_prolog_flag(occurs_check, X)     succeeds with X = true
+ * current_prolog_flag(1.5, X)              type_error(atom, 1.5)
+ * current_prolog_flag(foo, X)              domain_error(prolog_flag, foo)
+ * \endcode
+ *
+ * \par Compatibility
+ * \ref standard "Standard Prolog"
+ *
+ * \par See Also
+ * \ref set_prolog_flag_2 "set_prolog_flag/2"
+ */
+static p_goal_result p_builtin_current_prolog_flag
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *flag = p_term_deref_member(context, args[0]);
+    p_term *occurs_check = p_term_create_atom(context, "occurs_check");
+    if (flag && (flag->header.type & P_TERM_VARIABLE) != 0) {
+        if (!p_term_unify(context, flag, occurs_check, P_BIND_DEFAULT))
+            return P_RESULT_FAIL;
+    } else if (!flag || flag->header.type != P_TERM_ATOM) {
+        *error = p_create_type_error(context, "atom", flag);
+        return P_RESULT_ERROR;
+    } else if (flag != occurs_check) {
+        *error = p_create_domain_error(context, "prolog_flag", flag);
+        return P_RESULT_ERROR;
+    }
+    if (p_term_unify(context, args[1],
+                     p_builtin_flag_value
+                        (context, p_context_is_occurs_check(context)),
+                     P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
 /**
  * \addtogroup directives
  * <hr>
@@ -2456,6 +2510,416 @@ static p_goal_result p_builtin_load_library
     return _p_context_load_library(context, name, error);
 }
 
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor index_depth_2
+ * <b>index_depth/2</b> - sets how deeply the arguments of a
+ * user-defined predicate are examined for clause indexing.
+ *
+ * \par Usage
+ * <b>:-</b> \b index_depth(\em Pred, \em Depth).
+ *
+ * \par Description
+ * Clauses are normally indexed on the functor name and arity of
+ * compound arguments.  When most of the clauses of the predicate
+ * associated with the predicate indicator \em Pred have compound
+ * terms with the same functor in an argument, such as
+ * <tt>node(1)</tt>, <tt>node(2)</tt>, and so on, the index instead
+ * looks into the first argument of the compound term.  This
+ * directive sets the maximum number of levels, \em Depth, that the
+ * index will descend.  The default depth is 2.  A \em Depth of 0
+ * disables indexing on sub-terms.  Values of \em Depth larger
+ * than 8 are treated as 8.
+ * \par
+ * The indicator should have the form \em Name / \em Arity.
+ *
+ * \par Errors
+ *
+ * \li <tt>instantiation_error</tt> - one of \em Pred, \em Name,
+ *     \em Arity, or \em Depth is a variable.
+ * \li <tt>type_error(predicate_indicator, \em Pred)</tt> - \em Pred
+ *     does not have the form \em Name / \em Arity.
+ * \li <tt>type_error(integer, \em Arity)</tt> - \em Arity is not
+ *     an integer.
+ * \li <tt>type_error(integer, \em Depth)</tt> - \em Depth is not
+ *     an integer.
+ * \li <tt>type_error(atom, \em Name)</tt> - \em Name is not an atom.
+ * \li <tt>domain_error(not_less_than_zero, \em Arity)</tt> - \em Arity
+ *     is less than zero.
+ * \li <tt>domain_error(not_less_than_zero, \em Depth)</tt> - \em Depth
+ *     is less than zero.
+ * \li <tt>permission_error(modify, static_procedure, \em Pred)</tt> -
+ *     \em Pred is a builtin predicate.
+ *
+ * \par Examples
+ * \code
+ * :- index_depth(edge/2, 3).
+ * \endcode
+ *
+ * \par See Also
+ * \ref dynamic_1 "dynamic/1"
+ */
+static p_goal_result p_builtin_index_depth
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *name;
+    p_term *depth;
+    int arity;
+    name = p_builtin_parse_indicator(context, args[0], &arity, error);
+    if (!name)
+        return P_RESULT_ERROR;
+    depth = p_term_deref_member(context, args[1]);
+    if (!depth || (depth->header.type & P_TERM_VARIABLE) != 0) {
+        *error = p_create_instantiation_error(context);
+        return P_RESULT_ERROR;
+    }
+    if (depth->header.type != P_TERM_INTEGER) {
+        *error = p_create_type_error(context, "integer", depth);
+        return P_RESULT_ERROR;
+    }
+    if (p_term_integer_value(depth) < 0) {
+        *error = p_create_domain_error
+            (context, "not_less_than_zero", depth);
+        return P_RESULT_ERROR;
+    }
+    if (p_db_predicate_flags(context, name, arity) & P_PREDICATE_BUILTIN) {
+        *error = p_create_permission_error
+            (context, "modify", "static_procedure", args[0]);
+        return P_RESULT_ERROR;
+    }
+    if (p_term_integer_value(depth) > P_TERM_INDEX_SUBTERM_MAX) {
+        _p_db_set_index_depth
+            (context, name, arity, P_TERM_INDEX_SUBTERM_MAX);
+    } else {
+        _p_db_set_index_depth
+            (context, name, arity,
+             (unsigned int)p_term_integer_value(depth));
+    }
+    return P_RESULT_TRUE;
+}
+
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor no_occurs_check_1
+ * <b>no_occurs_check/1</b> - disables the occurs check when
+ * unifying the clause heads of a user-defined predicate.
+ *
+ * \par Usage
+ * <b>:-</b> \b no_occurs_check(\em Pred).
+ *
+ * \par Description
+ * Marks the predicate associated with the predicate indicator
+ * \em Pred so that unification of its clause heads against the
+ * incoming arguments will not perform an occurs check.
+ * The indicator should have the form \em Name / \em Arity.
+ * \par
+ * Binding a variable to a long list with the occurs check enabled
+ * requires a full traversal of the list.  This directive can be
+ * used to avoid that cost for predicates that are known to never
+ * create circular terms.  The directive only affects clauses
+ * that are added to the predicate after the directive is executed.
+ * \par
+ * Bindings to new terms that are constructed by a clause head
+ * never require an occurs check and so the check is omitted
+ * for them regardless of this directive.
+ *
+ * \par Errors
+ *
+ * \li <tt>instantiation_error</tt> - one of \em Pred, \em Name,
+ *     or \em Arity, is a variable.
+ * \li <tt>type_error(predicate_indicator, \em Pred)</tt> - \em Pred
+ *     does not have the form \em Name / \em Arity.
+ * \li <tt>type_error(integer, \em Arity)</tt> - \em Arity is not
+ *     an integer.
+ * \li <tt>type_error(atom, \em Name)</tt> - \em Name is not an atom.
+ * \li <tt>domain_error(not_less_than_zero, \em Arity)</tt> - \em Arity
+ *     is less than zero.
+ * \li <tt>permission_error(modify, static_procedure, \em Pred)</tt> -
+ *     \em Pred is a builtin predicate.
+ *
+ * \par Examples
+ * \code
+ * :- no_occurs_check(append/3).
+ * \endcode
+ *
+ * \par See Also
+ * \ref set_prolog_flag_2 "set_prolog_flag/2",
+ * \ref unify_2 "unify_with_occurs_check/2"
+ */
+static p_goal_result p_builtin_no_occurs_check
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *name;
+    int arity;
+    name = p_builtin_parse_indicator(context, args[0], &arity, error);
+    if (!name)
+        return P_RESULT_ERROR;
+    if (p_db_predicate_flags(context, name, arity) & P_PREDICATE_BUILTIN) {
+        *error = p_create_permission_error
+            (context, "modify", "static_procedure", args[0]);
+        return P_RESULT_ERROR;
+    }
+    p_db_set_predicate_flag
+        (context, name, arity, P_PREDICATE_NO_OCCURS_CHECK, 1);
+    return P_RESULT_TRUE;
+}
+
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor set_prolog_flag_2
+ * <b>set_prolog_flag/2</b> - sets the value of a system flag.
+ *
+ * \par Usage
+ * <b>:-</b> \b set_prolog_flag(\em Flag, \em Value).
+ *
+ * \par Description
+ * Sets the system flag \em Flag to \em Value.  See
+ * \ref current_prolog_flag_2 "current_prolog_flag/2" for
+ * the list of supported flags.
+ * \par
+ * Setting <tt>occurs_check</tt> to \c false causes
+ * \ref unify_2 "(=)/2" and clause head unification to bind
+ * variables without first checking if the variable occurs
+ * in the value.  This is faster when binding variables to
+ * large terms, but it is possible to create circular terms.
+ * \ref unify_2 "unify_with_occurs_check/2" can be used to
+ * explicitly request an occurs check when the flag is \c false.
+ *
+ * \par Errors
+ *
+ * \li <tt>instantiation_error</tt> - \em Flag or \em Value
+ *     is a variable.
+ * \li <tt>type_error(atom, \em Flag)</tt> - \em Flag is not an atom.
+ * \li <tt>domain_error(prolog_flag, \em Flag)</tt> - \em Flag
+ *     is not a supported flag name.
+ * \li <tt>domain_error(flag_value, \em Flag + \em Value)</tt> -
+ *     \em Value is not a legal value for \em Flag.
+ *
+ * \par Examples
+ * \code
+ * :- set_prolog_flag(occurs_check, false).
+ * set_prolog_flag(X, false)            instantiation_error
+ * set_prolog_flag(foo, true)           domain_error(prolog_flag, foo)
+ * set_prolog_flag(occurs_check, 1)     domain_error(flag_value, occurs_check + 1)
+ * \endcode
+ *
+ * \par Compatibility
+ * \ref standard "Standard Prolog".  The <tt>error</tt> value
+ * for <tt>occurs_check</tt> is not supported.
+ *
+ * \par See Also
+ * \ref current_prolog_flag_2 "current_prolog_flag/2",
+ * \ref no_occurs_check_1 "no_occurs_check/1"
+ */
+static p_goal_result p_builtin_set_prolog_flag
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *flag = p_term_deref_member(context, args[0]);
+    p_term *value = p_term_deref_member(context, args[1]);
+    if (!flag || (flag->header.type & P_TERM_VARIABLE) != 0 ||
+            !value || (value->header.type & P_TERM_VARIABLE) != 0) {
+        *error = p_create_instantiation_error(context);
+        return P_RESULT_ERROR;
+    }
+    if (flag->header.type != P_TERM_ATOM) {
+        *error = p_create_type_error(context, "atom", flag);
+        return P_RESULT_ERROR;
+    }
+    if (flag != p_term_create_atom(context, "occurs_check")) {
+        *error = p_create_domain_error(context, "prolog_flag", flag);
+        return P_RESULT_ERROR;
+    }
+    if (value == p_builtin_flag_value(context, 1)) {
+        p_context_set_occurs_check(context, 1);
+    } else if (value == p_builtin_flag_value(context, 0)) {
+        p_context_set_occurs_check(context, 0);
+    } else {
+        *error = p_create_domain_error
+            (context, "flag_value",
+             p_term_create_functor_with_args
+                (context, p_term_create_atom(context, "+"),
+                 args, 2));
+        return P_RESULT_ERROR;
+    }
+    return P_RESULT_TRUE;
+}
+
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor table_1
+ * <b>table/1</b> - evaluates a user-defined predicate with tabling.
+ *
+ * \par Usage
+ * <b>:-</b> \b table(\em Pred).
+ *
+ * \par Description
+ * Marks the predicate associated with the predicate indicator
+ * \em Pred so that its answers are remembered in a table for each
+ * variant of a call.  The indicator should have the form
+ * \em Name / \em Arity.
+ * \par
+ * The first call with a particular pattern of arguments evaluates
+ * the clauses of the predicate until no more answers can be found,
+ * and then returns the answers from the table.  Later calls with
+ * the same pattern, up to renaming of variables, return the answers
+ * from the table without executing the clauses again.  Recursive
+ * calls to a table that is still being evaluated return the answers
+ * found so far, which allows left-recursive definitions such as
+ * transitive closure over a graph with cycles to terminate.
+ * \par
+ * Answers are returned in the order in which they were found,
+ * and answers that are variants of earlier answers are discarded.
+ * Tabled predicates should not rely upon side effects or
+ * \ref commit_0 "commit/0" across calls to tabled predicates,
+ * as the clauses may be executed several times while computing
+ * the answers.
+ * \par
+ * Asserting or retracting a clause of a predicate that was called
+ * while a table was being evaluated, directly or via other predicates
+ * and tables, marks the table as out of date.  The table is evaluated
+ * again the next time that it is called.  Tables that did not call
+ * the modified predicate keep their answers.  Callers that are part
+ * way through the answers of a table when it is modified continue
+ * to see the old answers.
+ *
+ * \par Errors
+ *
+ * \li <tt>instantiation_error</tt> - one of \em Pred, \em Name,
+ *     or \em Arity, is a variable.
+ * \li <tt>type_error(predicate_indicator, \em Pred)</tt> - \em Pred
+ *     does not have the form \em Name / \em Arity.
+ * \li <tt>type_error(integer, \em Arity)</tt> - \em Arity is not
+ *     an integer.
+ * \li <tt>type_error(atom, \em Name)</tt> - \em Name is not an atom.
+ * \li <tt>domain_error(not_less_than_zero, \em Arity)</tt> - \em Arity
+ *     is less than zero.
+ * \li <tt>permission_error(modify, static_procedure, \em Pred)</tt> -
+ *     \em Pred is a builtin predicate.
+ *
+ * \par Examples
+ * \code
+ * :- table(path/2).
+ *
+ * path(X, Y) { path(X, Z); edge(Z, Y); }
+ * path(X, Y) { edge(X, Y); }
+ * \endcode
+ *
+ * \par Compatibility
+ * \ref swi_prolog "SWI-Prolog", for the single predicate
+ * indicator form.
+ *
+ * \par See Also
+ * \ref abolish_all_tables_0 "abolish_all_tables/0",
+ * \ref memo_nonterminal_1 "memo_nonterminal/1"
+ */
+static p_goal_result p_builtin_table
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *name;
+    int arity;
+    name = p_builtin_parse_indicator(context, args[0], &arity, error);
+    if (!name)
+        return P_RESULT_ERROR;
+    if (p_db_predicate_flags(context, name, arity) & P_PREDICATE_BUILTIN) {
+        *error = p_create_permission_error
+            (context, "modify", "static_procedure", args[0]);
+        return P_RESULT_ERROR;
+    }
+    p_db_set_predicate_flag(context, name, arity, P_PREDICATE_TABLED, 1);
+    return P_RESULT_TRUE;
+}
+
+/**
+ * \addtogroup directives
+ * <hr>
+ * \anchor memo_nonterminal_1
+ * <b>memo_nonterminal/1</b> - memoises the results of a
+ * grammar rule nonterminal.
+ *
+ * \par Usage
+ * <b>:-</b> \b memo_nonterminal(\em Name / \em Arity).
+ *
+ * \par Description
+ * Marks the predicate that implements the nonterminal \em Name
+ * with \em Arity arguments so that the results of parsing the
+ * nonterminal at each position in the input are remembered.
+ * The \em Arity does not include the two extra arguments that
+ * are added by grammar rules, which hold the input and the
+ * remainder of the input.
+ * \par
+ * The nonterminal is evaluated with \ref table_1 "table/1",
+ * so the first call at a position finds all of the ways to parse
+ * the nonterminal there, and backtracking into the same position
+ * later returns the results without parsing the input again.
+ * This turns grammars that backtrack heavily into "packrat"
+ * parsers, and allows left-recursive rules.
+ * \par
+ * If the input is a ground list, then the results are keyed on the
+ * identity of the list cell at the current position rather than on
+ * its contents, and the remainder of the input in each result is
+ * shared with the input.  This makes the cost of looking up the
+ * results independent of the length of the input.  A ground list
+ * that was built by binding variables is copied once when the
+ * nonterminal is first called on it, and the nested calls then use
+ * the copy.  Inputs that are not ground are compared up to variable
+ * renaming.
+ * \par
+ * The results are kept until \ref abolish_all_tables_0
+ * "abolish_all_tables/0" is called, and so will keep the inputs
+ * that were parsed alive until then.
+ *
+ * \par Errors
+ *
+ * \li <tt>instantiation_error</tt> - one of \em Pred, \em Name,
+ *     or \em Arity, is a variable.
+ * \li <tt>type_error(predicate_indicator, \em Pred)</tt> - \em Pred
+ *     does not have the form \em Name / \em Arity.
+ * \li <tt>type_error(integer, \em Arity)</tt> - \em Arity is not
+ *     an integer.
+ * \li <tt>type_error(atom, \em Name)</tt> - \em Name is not an atom.
+ * \li <tt>domain_error(not_less_than_zero, \em Arity)</tt> - \em Arity
+ *     is less than zero.
+ * \li <tt>permission_error(modify, static_procedure, \em Pred)</tt> -
+ *     the predicate for the nonterminal is a builtin predicate.
+ *
+ * \par Examples
+ * \code
+ * :- memo_nonterminal(noun_phrase/0).
+ *
+ * noun_phrase --> noun_phrase, pp.
+ * noun_phrase --> det, noun.
+ * \endcode
+ *
+ * \par Compatibility
+ * SWI-Prolog writes nonterminal indicators as \em Name // \em Arity,
+ * but <tt>//</tt> starts a comment in Plang.
+ *
+ * \par See Also
+ * \ref table_1 "table/1"
+ */
+static p_goal_result p_builtin_memo_nonterminal
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *name;
+    int arity;
+    name = p_builtin_parse_indicator(context, args[0], &arity, error);
+    if (!name)
+        return P_RESULT_ERROR;
+    arity += 2;
+    if (p_db_predicate_flags(context, name, arity) & P_PREDICATE_BUILTIN) {
+        *error = p_create_permission_error
+            (context, "modify", "static_procedure", args[0]);
+        return P_RESULT_ERROR;
+    }
+    p_db_set_predicate_flag
+        (context, name, arity, P_PREDICATE_TABLED | P_PREDICATE_MEMO, 1);
+    return P_RESULT_TRUE;
+}
+
 /*\@}*/
 
 /**
@@ -2542,8 +3006,8 @@ static p_goal_result p_builtin_logical_and
     (p_context *context, p_term **args, p_term **error)
 {
     p_exec_node *current = context->current_node;
-    p_exec_node *next = GC_NEW(p_exec_node);
-    p_exec_node *new_current = GC_NEW(p_exec_node);
+    p_exec_node *next = p_exec_new(context, p_exec_node);
+    p_exec_node *new_current = p_exec_new(context, p_exec_node);
     if (!next || !new_current)
         return P_RESULT_FAIL;
     new_current->goal = args[0];
@@ -2611,10 +3075,10 @@ static p_goal_result p_builtin_logical_or
             term->functor.functor_name == context->if_atom) {
         /* The term has the form (A -> B || C) */
         current = context->current_node;
-        if_node = GC_NEW(p_exec_node);
-        retry = GC_NEW(p_exec_fail_node);
-        commit = GC_NEW(p_exec_node);
-        then = GC_NEW(p_exec_node);
+        then = p_exec_new(context, p_exec_node);
+        commit = p_exec_new(context, p_exec_node);
+        retry = p_exec_new(context, p_exec_fail_node);
+        if_node = p_exec_new(context, p_exec_node);
         if (!if_node || !retry || !commit || !then)
             return P_RESULT_FAIL;
         retry->parent.goal = args[1];
@@ -2637,8 +3101,8 @@ static p_goal_result p_builtin_logical_or
     } else {
         /* Regular disjunction */
         current = context->current_node;
-        if_node = GC_NEW(p_exec_node);
-        retry = GC_NEW(p_exec_fail_node);
+        retry = p_exec_new(context, p_exec_fail_node);
+        if_node = p_exec_new(context, p_exec_node);
         if (!if_node || !retry)
             return P_RESULT_FAIL;
         retry->parent.goal = args[1];
@@ -2794,7 +3258,7 @@ static p_goal_result p_builtin_call
     (p_context *context, p_term **args, p_term **error)
 {
     p_exec_node *current = context->current_node;
-    p_exec_node *new_current = GC_NEW(p_exec_node);
+    p_exec_node *new_current = p_exec_new(context, p_exec_node);
     if (!new_current)
         return P_RESULT_FAIL;
     new_current->goal = args[0];
@@ -2861,8 +3325,8 @@ static p_goal_result p_builtin_call_2
     p_term *database = p_builtin_verify_database(context, args[1], error);
     if (!database)
         return P_RESULT_ERROR;
-    new_current = GC_NEW(p_exec_node);
-    pop_database = GC_NEW(p_exec_pop_database_node);
+    pop_database = p_exec_new(context, p_exec_pop_database_node);
+    new_current = p_exec_new(context, p_exec_node);
     if (!new_current || !pop_database)
         return P_RESULT_FAIL;
     new_current->goal = args[0];
@@ -2888,6 +3352,15 @@ static p_goal_result p_builtin_pop_database
     return P_RESULT_TRUE;
 }
 
+/* $$resume predicate - resumes execution of a compiled clause
+ * body when the previous goal in the body succeeds */
+static p_goal_result p_builtin_resume
+    (p_context *context, p_term **args, p_term **error)
+{
+    return _p_context_resume_clause
+        (context, (p_exec_code_node *)(context->current_node), error);
+}
+
 /**
  * \addtogroup logic_and_control
  * <hr>
@@ -2932,6 +3405,13 @@ int p_builtin_handle_catch(p_context *context, p_term *error)
     p_term *catch_atom = p_term_create_atom(context, "catch");
     p_term *catch_clause_atom = p_term_create_atom(context, "$$catch");
     p_term *goal;
+    p_term *ball;
+
+    /* The error term outlives the nodes that are unwound below,
+     * so copy it in the form that always trails its variables */
+    ball = _p_term_clone_persistent(context, error);
+    if (ball)
+        error = ball;
     while (catcher != 0) {
         _p_context_basic_fail_func(context, &(catcher->parent));
         goal = p_term_deref_member(context, catcher->parent.parent.goal);
@@ -2939,6 +3419,8 @@ int p_builtin_handle_catch(p_context *context, p_term *error)
             /* "catch" block */
             if (p_term_unify(context, error,
                              goal->functor.arg[1], P_BIND_DEFAULT)) {
+                _p_context_pop_nodes
+                    (context, catcher->parent.node_marker);
                 catcher->parent.parent.goal = goal->functor.arg[2];
                 context->current_node = &(catcher->parent.parent);
                 context->fail_node = catcher->parent.parent.cut_node;
@@ -2957,6 +3439,8 @@ int p_builtin_handle_catch(p_context *context, p_term *error)
                                 == catch_clause_atom) {
                     if (p_term_unify(context, p_term_arg(head, 0),
                                      error, P_BIND_DEFAULT)) {
+                        _p_context_pop_nodes
+                            (context, catcher->parent.node_marker);
                         catcher->parent.parent.goal = p_term_arg(head, 1);
                         context->current_node = &(catcher->parent.parent);
                         context->fail_node = catcher->parent.parent.cut_node;
@@ -2977,9 +3461,9 @@ static p_goal_result p_builtin_catch
     (p_context *context, p_term **args, p_term **error)
 {
     p_exec_node *current = context->current_node;
-    p_exec_catch_node *catcher = GC_NEW(p_exec_catch_node);
-    p_exec_node *new_current = GC_NEW(p_exec_node);
-    p_exec_pop_catch_node *pop_catch = GC_NEW(p_exec_pop_catch_node);
+    p_exec_pop_catch_node *pop_catch = p_exec_new(context, p_exec_pop_catch_node);
+    p_exec_catch_node *catcher = p_exec_new(context, p_exec_catch_node);
+    p_exec_node *new_current = p_exec_new(context, p_exec_node);
     if (!catcher || !new_current || !pop_catch)
         return P_RESULT_FAIL;
     catcher->parent.parent.goal = current->goal;
@@ -3432,9 +3916,9 @@ static p_goal_result p_builtin_if
     (p_context *context, p_term **args, p_term **error)
 {
     p_exec_node *current = context->current_node;
-    p_exec_node *commit = GC_NEW(p_exec_node);
-    p_exec_node *then = GC_NEW(p_exec_node);
-    p_exec_node *if_node = GC_NEW(p_exec_node);
+    p_exec_node *then = p_exec_new(context, p_exec_node);
+    p_exec_node *commit = p_exec_new(context, p_exec_node);
+    p_exec_node *if_node = p_exec_new(context, p_exec_node);
     if (!commit || !then || !if_node)
         return P_RESULT_FAIL;
     commit->goal = context->commit_atom;
@@ -4685,10 +5169,13 @@ static p_goal_result p_builtin_functor
  * If \em Term1 and \em Term2 can be unified, then perform
  * variable substitutions to unify them and succeed.  Fails otherwise.
  * \par
- * An occurs check is performed to ensure that circular terms will
- * not be created by the unification.  Therefore, in this
- * implementation the \ref standard "Standard Prolog" predicate
- * <b>unify_with_occurs_check/2</b> is identical to <b>(=)/2</b>.
+ * By default, an occurs check is performed to ensure that circular
+ * terms will not be created by the unification.  If the
+ * <tt>occurs_check</tt> flag has been set to \c false with
+ * \ref set_prolog_flag_2 "set_prolog_flag/2", then <b>(=)/2</b>
+ * will omit the check.  The \ref standard "Standard Prolog"
+ * predicate <b>unify_with_occurs_check/2</b> always performs
+ * the check, regardless of the flag.
  *
  * \par Examples
  * \code
@@ -4704,10 +5191,23 @@ static p_goal_result p_builtin_functor
  * \ref not_unifiable_2 "(!=)/2",
  * \ref unifiable_2 "unifiable/2",
  * \ref unify_one_way_2 "unify_one_way/2",
- * \ref assign_2 "(:=)/2"
+ * \ref assign_2 "(:=)/2",
+ * \ref set_prolog_flag_2 "set_prolog_flag/2"
  */
 static p_goal_result p_builtin_unify
     (p_context *context, p_term **args, p_term **error)
+{
+    int flags = P_BIND_DEFAULT;
+    if (context->no_occurs_check)
+        flags |= P_BIND_NO_OCCURS_CHECK;
+    if (p_term_unify(context, args[0], args[1], flags))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+static p_goal_result p_builtin_unify_with_occurs_check
+    (p_context *context, p_term **args, p_term **error)
 {
     if (p_term_unify(context, args[0], args[1], P_BIND_DEFAULT))
         return P_RESULT_TRUE;
@@ -4750,7 +5250,10 @@ static p_goal_result p_builtin_not_unifiable
     (p_context *context, p_term **args, p_term **error)
 {
     void *marker = p_context_mark_trail(context);
-    if (p_term_unify(context, args[0], args[1], P_BIND_DEFAULT)) {
+    int flags = P_BIND_DEFAULT;
+    if (context->no_occurs_check)
+        flags |= P_BIND_NO_OCCURS_CHECK;
+    if (p_term_unify(context, args[0], args[1], flags)) {
         p_context_backtrack_trail(context, marker);
         return P_RESULT_FAIL;
     } else {
@@ -5669,7 +6172,6 @@ static p_goal_result p_builtin_var
  */
 /*\@{*/
 
-int p_term_occurs_in(const p_term *var, const p_term *value);
 p_goal_result p_arith_eval
     (p_context *context, p_arith_value *result,
      p_term *expr, p_term **error);
@@ -5740,7 +6242,7 @@ static p_goal_result p_builtin_assign
         *error = p_create_type_error(context, "variable", args[0]);
         return P_RESULT_ERROR;
     }
-    var->var.value = p_term_clone(context, args[1]);
+    var->var.value = _p_term_clone_persistent(context, args[1]);
     return P_RESULT_TRUE;
 }
 
@@ -5870,7 +6372,7 @@ static p_goal_result p_builtin_bt_assign
     }
     prev = var->var.value;
     var->var.value = 0;
-    if (!p_term_occurs_in(var, args[1])) {
+    if (!p_term_occurs_in(context, var, args[1])) {
         _p_context_record_contents_in_trail
             (context, (void **)&(var->var.value), prev);
         var->var.value = args[1];
@@ -6039,6 +6541,7 @@ void _p_db_init_builtins(p_context *context)
         {"compound", 1, p_builtin_compound},
         {"consult", 1, p_builtin_consult},
         {"copy_term", 2, p_builtin_copy_term},
+        {"current_prolog_flag", 2, p_builtin_current_prolog_flag},
         {"database", 1, p_builtin_database},
         {"dynamic", 1, p_builtin_dynamic},
         {"fail", 0, p_builtin_fail},
@@ -6048,26 +6551,32 @@ void _p_db_init_builtins(p_context *context)
         {"halt", 0, p_builtin_halt_0},
         {"halt", 1, p_builtin_halt_1},
         {"import", 1, p_builtin_import},
+        {"index_depth", 2, p_builtin_index_depth},
         {"initialization", 1, p_builtin_call},
         {"integer", 1, p_builtin_integer},
         {"$$line", 3, p_builtin_line},
         {"load_library", 1, p_builtin_load_library},
+        {"memo_nonterminal", 1, p_builtin_memo_nonterminal},
         {"$$new", 2, p_builtin_new},
         {"new_class", 4, p_builtin_new_class},
         {"new_database", 1, p_builtin_new_database},
         {"new_object", 3, p_builtin_new_object},
+        {"no_occurs_check", 1, p_builtin_no_occurs_check},
         {"nonvar", 1, p_builtin_nonvar},
         {"number", 1, p_builtin_number},
         {"object", 1, p_builtin_object_1},
         {"object", 2, p_builtin_object_2},
         {"$$pop_catch", 0, p_builtin_pop_catch},
         {"$$pop_database", 0, p_builtin_pop_database},
+        {"$$resume", 0, p_builtin_resume},
         {"predicate", 1, p_builtin_predicate_1},
         {"predicate", 2, p_builtin_predicate_2},
         {"retract", 1, p_builtin_retract_1},
         {"retract", 2, p_builtin_retract_2},
         {"$$set_loop_var", 2, p_builtin_set_loop_var},
+        {"set_prolog_flag", 2, p_builtin_set_prolog_flag},
         {"string", 1, p_builtin_string},
+        {"table", 1, p_builtin_table},
         {"throw", 1, p_builtin_throw},
         {"true", 0, p_builtin_true},
         {"$$try", 2, p_builtin_catch},
@@ -6075,7 +6584,7 @@ void _p_db_init_builtins(p_context *context)
         {"unifiable", 2, p_builtin_unifiable},
         {"unifiable_one_way", 2, p_builtin_unifiable_one_way},
         {"unify_one_way", 2, p_builtin_unify_one_way},
-        {"unify_with_occurs_check", 2, p_builtin_unify},
+        {"unify_with_occurs_check", 2, p_builtin_unify_with_occurs_check},
         {"$$unique", 1, p_builtin_unique},
         {"var", 1, p_builtin_var},
         {"$$witness", 3, p_builtin_witness},
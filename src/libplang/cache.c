@@ -0,0 +1,1334 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+#include <plang/context.h>
+#include "context-priv.h"
+#include "term-priv.h"
+#include "parser-priv.h"
+#include "database-priv.h"
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+/** @cond */
+
+/*
+ * A consult cache file "foo.lpc" holds the declarations that were
+ * parsed from "foo.lp", so that the next consult of the source file
+ * can skip the lexer and parser.  The layout is:
+ *
+ *      magic           "PLC" followed by the format version
+ *      byte order      0x01020304 in host byte order
+ *      source size     size of the source file in bytes
+ *      source hash     64-bit FNV-1a hash of the source contents
+ *      atoms           number of atoms, then length and name of each
+ *      declarations    the declaration list as a single term
+ *
+ * Sizes, counts and indexes are stored as variable-length unsigned
+ * integers.  Cache files are specific to the host that wrote them.
+ */
+#define P_CACHE_MAGIC           "PLC\001"
+#define P_CACHE_MAGIC_SIZE      4
+#define P_CACHE_BYTE_ORDER      0x01020304UL
+
+enum {
+    P_CACHE_ATOM            = 1,
+    P_CACHE_STRING          = 2,
+    P_CACHE_INTEGER         = 3,
+    P_CACHE_REAL            = 4,
+    P_CACHE_VARIABLE        = 5,
+    P_CACHE_MEMBER_VARIABLE = 6,
+    P_CACHE_FUNCTOR         = 7,
+    P_CACHE_LIST            = 8,
+    P_CACHE_PREDICATE       = 9
+};
+
+/*
+ * A saved image "foo.pli" holds the predicates, classes, and other
+ * state of a context so that it can be restored without consulting
+ * the original source files again.  After the magic number, byte
+ * order, and atoms, the image is a sequence of records that is
+ * terminated by P_IMAGE_END:
+ *
+ *      P_IMAGE_FILE        name of a file that has been consulted
+ *      P_IMAGE_LIBRARY     name of a native library to be reloaded
+ *      P_IMAGE_BUILTIN     name and arity of a builtin, followed by
+ *                          another name for the same builtin function
+ *      P_IMAGE_PREDICATE   name, arity, flags, index depth, clause
+ *                          count, and clauses in (:-)/2 form
+ *      P_IMAGE_CLASS       name, parent, member variables, and
+ *                          the member properties of a class
+ *
+ * Images are decoded into new terms when they are loaded rather than
+ * being mapped into memory directly, because the garbage-collected
+ * heap cannot be placed at a fixed address.
+ */
+#define P_IMAGE_MAGIC           "PLI\001"
+
+enum {
+    P_IMAGE_END             = 0,
+    P_IMAGE_FILE            = 1,
+    P_IMAGE_LIBRARY         = 2,
+    P_IMAGE_PREDICATE       = 3,
+    P_IMAGE_CLASS           = 4,
+    P_IMAGE_BUILTIN         = 5
+};
+
+typedef struct p_cache_buffer p_cache_buffer;
+struct p_cache_buffer
+{
+    unsigned char *data;
+    size_t len;
+    size_t max;
+    int error;
+};
+
+/* Maps atoms and variables to their index in the cache file */
+typedef struct p_cache_map_entry p_cache_map_entry;
+struct p_cache_map_entry
+{
+    const p_term *term;
+    size_t index;
+};
+typedef struct p_cache_map p_cache_map;
+struct p_cache_map
+{
+    p_cache_map_entry *entries;
+    size_t size;
+    size_t count;
+};
+
+typedef struct p_cache_writer p_cache_writer;
+struct p_cache_writer
+{
+    p_cache_buffer atoms;
+    p_cache_buffer terms;
+    p_cache_map atom_map;
+    p_cache_map var_map;
+};
+
+typedef struct p_image_builtin p_image_builtin;
+struct p_image_builtin
+{
+    p_term *name;
+    p_database_info *info;
+};
+
+/* The atom and variable arrays are allocated with the garbage
+ * collector, as they may hold the only references to new terms */
+typedef struct p_cache_reader p_cache_reader;
+struct p_cache_reader
+{
+    const unsigned char *posn;
+    const unsigned char *end;
+    p_term **atoms;
+    size_t num_atoms;
+    p_term **vars;
+    size_t num_vars;
+    size_t max_vars;
+};
+
+/** @endcond */
+
+/* Hashes the contents of a source file */
+static unsigned long long p_cache_hash(const char *data, size_t len)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    while (len > 0) {
+        hash = (hash ^ (unsigned char)(*data++)) * 1099511628211ULL;
+        --len;
+    }
+    return hash;
+}
+
+/* Reads the whole of "file" into memory, returning null on error */
+static char *p_cache_read_file(FILE *file, size_t *len)
+{
+    char *data = 0;
+    size_t size = 0;
+    size_t max = 0;
+    size_t n;
+    for (;;) {
+        if (size >= max) {
+            char *new_data;
+            max = max ? max * 2 : 16384;
+            new_data = (char *)realloc(data, max);
+            if (!new_data) {
+                free(data);
+                return 0;
+            }
+            data = new_data;
+        }
+        n = fread(data + size, 1, max - size, file);
+        if (!n)
+            break;
+        size += n;
+    }
+    if (ferror(file)) {
+        free(data);
+        return 0;
+    }
+    *len = size;
+    return data;
+}
+
+/* Returns the name of the cache file for "filename" */
+static char *p_cache_filename(const char *filename)
+{
+    size_t len = strlen(filename);
+    char *name = (char *)malloc(len + 5);
+    if (!name)
+        return 0;
+    strcpy(name, filename);
+    if (len > 3 && !strcmp(filename + len - 3, ".lp"))
+        strcpy(name + len, "c");
+    else
+        strcpy(name + len, ".lpc");
+    return name;
+}
+
+static void p_cache_put_bytes
+    (p_cache_buffer *buf, const void *data, size_t len)
+{
+    if ((buf->len + len) > buf->max) {
+        size_t new_max = buf->max ? buf->max * 2 : 4096;
+        unsigned char *new_data;
+        while (new_max < (buf->len + len))
+            new_max *= 2;
+        new_data = (unsigned char *)realloc(buf->data, new_max);
+        if (!new_data) {
+            buf->error = 1;
+            return;
+        }
+        buf->data = new_data;
+        buf->max = new_max;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void p_cache_put_byte(p_cache_buffer *buf, int value)
+{
+    unsigned char byte = (unsigned char)value;
+    p_cache_put_bytes(buf, &byte, 1);
+}
+
+static void p_cache_put_uint(p_cache_buffer *buf, unsigned long long value)
+{
+    while (value >= 0x80) {
+        p_cache_put_byte(buf, (int)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    p_cache_put_byte(buf, (int)value);
+}
+
+/* Looks up "term" in "map", adding it with the next index if
+ * it is not present.  Returns non-zero if the term is new */
+static int p_cache_map_lookup
+    (p_cache_map *map, const p_term *term, size_t *index)
+{
+    size_t hash, posn;
+    if ((map->count * 2) >= map->size) {
+        p_cache_map_entry *old_entries = map->entries;
+        size_t old_size = map->size;
+        map->size = old_size ? old_size * 2 : 256;
+        map->entries = (p_cache_map_entry *)calloc
+            (map->size, sizeof(p_cache_map_entry));
+        if (!map->entries) {
+            map->entries = old_entries;
+            map->size = old_size;
+            return -1;
+        }
+        for (posn = 0; posn < old_size; ++posn) {
+            if (!old_entries[posn].term)
+                continue;
+            hash = (((size_t)(old_entries[posn].term)) >> 3) &
+                   (map->size - 1);
+            while (map->entries[hash].term)
+                hash = (hash + 1) & (map->size - 1);
+            map->entries[hash] = old_entries[posn];
+        }
+        free(old_entries);
+    }
+    hash = (((size_t)term) >> 3) & (map->size - 1);
+    while (map->entries[hash].term) {
+        if (map->entries[hash].term == term) {
+            *index = map->entries[hash].index;
+            return 0;
+        }
+        hash = (hash + 1) & (map->size - 1);
+    }
+    map->entries[hash].term = term;
+    map->entries[hash].index = map->count;
+    *index = (map->count)++;
+    return 1;
+}
+
+static void p_cache_write_atom(p_cache_writer *writer, const p_term *atom)
+{
+    size_t index, len;
+    int result = p_cache_map_lookup(&(writer->atom_map), atom, &index);
+    if (result < 0) {
+        writer->terms.error = 1;
+        return;
+    }
+    if (result > 0) {
+        len = p_term_name_length(atom);
+        p_cache_put_uint(&(writer->atoms), len);
+        p_cache_put_bytes(&(writer->atoms), p_term_name(atom), len);
+    }
+    p_cache_put_uint(&(writer->terms), index);
+}
+
+/* Writes "term" to the cache.  Returns zero if the term
+ * contains something that cannot be written to a cache file */
+static int p_cache_write_term(p_cache_writer *writer, p_term *term)
+{
+    p_cache_buffer *buf = &(writer->terms);
+    size_t index, count;
+    int value, result;
+    p_term *list;
+    term = p_term_deref(term);
+    if (!term)
+        return 0;
+    switch (term->header.type) {
+    case P_TERM_ATOM:
+        p_cache_put_byte(buf, P_CACHE_ATOM);
+        p_cache_write_atom(writer, term);
+        break;
+    case P_TERM_STRING:
+        p_cache_put_byte(buf, P_CACHE_STRING);
+        p_cache_put_uint(buf, p_term_name_length(term));
+        p_cache_put_bytes
+            (buf, p_term_name(term), p_term_name_length(term));
+        break;
+    case P_TERM_INTEGER:
+        /* Zig-zag encoding keeps small negative numbers short */
+        value = p_term_integer_value(term);
+        p_cache_put_byte(buf, P_CACHE_INTEGER);
+        p_cache_put_uint
+            (buf, (((unsigned int)value) << 1) ^ (unsigned int)(value >> 31));
+        break;
+    case P_TERM_REAL:
+        p_cache_put_byte(buf, P_CACHE_REAL);
+        p_cache_put_bytes
+            (buf, &(term->real.value), sizeof(term->real.value));
+        break;
+    case P_TERM_VARIABLE:
+        /* Parsed declarations never have named variables */
+        if (term->header.size & P_TERM_VAR_NAMED)
+            return 0;
+        result = p_cache_map_lookup(&(writer->var_map), term, &index);
+        if (result < 0)
+            return 0;
+        p_cache_put_byte(buf, P_CACHE_VARIABLE);
+        p_cache_put_uint(buf, index);
+        break;
+    case P_TERM_MEMBER_VARIABLE:
+        p_cache_put_byte(buf, P_CACHE_MEMBER_VARIABLE);
+        p_cache_put_byte(buf, term->header.size ? 1 : 0);
+        p_cache_write_atom(writer, term->member_var.name);
+        return p_cache_write_term(writer, term->member_var.object);
+    case P_TERM_FUNCTOR:
+        p_cache_put_byte(buf, P_CACHE_FUNCTOR);
+        p_cache_write_atom(writer, term->functor.functor_name);
+        p_cache_put_uint(buf, term->header.size);
+        for (index = 0; index < term->header.size; ++index) {
+            if (!p_cache_write_term(writer, term->functor.arg[index]))
+                return 0;
+        }
+        break;
+    case P_TERM_LIST:
+        /* Write the members of the list without recursion,
+         * as the declaration list of a file may be very long */
+        count = 0;
+        list = term;
+        do {
+            ++count;
+            list = p_term_deref(list->list.tail);
+        } while (list && list->header.type == P_TERM_LIST);
+        p_cache_put_byte(buf, P_CACHE_LIST);
+        p_cache_put_uint(buf, count);
+        list = term;
+        do {
+            if (!p_cache_write_term(writer, list->list.head))
+                return 0;
+            list = p_term_deref(list->list.tail);
+        } while (list && list->header.type == P_TERM_LIST);
+        return p_cache_write_term(writer, list);
+    case P_TERM_PREDICATE:
+        /* Predicates are written by name, to be looked up again
+         * in the database when the term is read back in */
+        p_cache_put_byte(buf, P_CACHE_PREDICATE);
+        p_cache_write_atom(writer, term->predicate.name);
+        p_cache_put_uint(buf, term->header.size);
+        break;
+    default:
+        /* Objects, databases, etc cannot appear in the cache */
+        return 0;
+    }
+    return !buf->error;
+}
+
+/* Starts a new variable numbering scope in "writer" */
+static void p_cache_reset_vars(p_cache_writer *writer)
+{
+    if (writer->var_map.count) {
+        memset(writer->var_map.entries, 0,
+               writer->var_map.size * sizeof(p_cache_map_entry));
+        writer->var_map.count = 0;
+    }
+}
+
+static void p_cache_free_writer(p_cache_writer *writer)
+{
+    free(writer->atoms.data);
+    free(writer->terms.data);
+    free(writer->atom_map.entries);
+    free(writer->var_map.entries);
+}
+
+/* Writes a complete cache file to "filename", consisting of "header",
+ * the atom table, and the terms.  The file is written under a
+ * temporary name and then renamed into place so that concurrent
+ * processes never see a partial file.  Returns an errno code */
+static int p_cache_write_file
+    (const char *filename, p_cache_buffer *header, p_cache_writer *writer)
+{
+    size_t len = strlen(filename);
+    char *temp_name;
+    FILE *file;
+    int error;
+
+    p_cache_put_uint(header, writer->atom_map.count);
+    if (header->error || writer->atoms.error || writer->terms.error)
+        return ENOMEM;
+
+    temp_name = (char *)malloc(len + 32);
+    if (!temp_name)
+        return ENOMEM;
+#if defined(HAVE_UNISTD_H)
+    sprintf(temp_name, "%s.%ld", filename, (long)getpid());
+#else
+    sprintf(temp_name, "%s.tmp", filename);
+#endif
+    file = fopen(temp_name, "wb");
+    if (!file) {
+        error = errno;
+        free(temp_name);
+        return error;
+    }
+    error = 0;
+    if (fwrite(header->data, 1, header->len, file) != header->len)
+        error = errno;
+    if (!error && writer->atoms.len &&
+            fwrite(writer->atoms.data, 1, writer->atoms.len, file)
+                    != writer->atoms.len)
+        error = errno;
+    if (!error &&
+            fwrite(writer->terms.data, 1, writer->terms.len, file)
+                    != writer->terms.len)
+        error = errno;
+    if (fclose(file) != 0 && !error)
+        error = errno;
+#if defined(P_WIN32)
+    if (!error)
+        remove(filename);
+#endif
+    if (!error && rename(temp_name, filename) != 0)
+        error = errno;
+    if (error)
+        remove(temp_name);
+    free(temp_name);
+    return error;
+}
+
+/* Saves the declarations that were parsed from "source" to the
+ * cache file for "stream".  Failure to write the cache is ignored,
+ * as the source file will simply be parsed again next time */
+void _p_context_save_cache
+    (p_context *context, p_input_stream *stream,
+     const char *source, size_t source_len)
+{
+    p_cache_writer writer;
+    p_cache_buffer header;
+    unsigned long byte_order = P_CACHE_BYTE_ORDER;
+    unsigned long long source_hash;
+    char *cache_name;
+    if (!stream->declarations || !stream->filename)
+        return;
+    memset(&writer, 0, sizeof(writer));
+    memset(&header, 0, sizeof(header));
+    if (p_cache_write_term(&writer, stream->declarations)) {
+        source_hash = p_cache_hash(source, source_len);
+        p_cache_put_bytes(&header, P_CACHE_MAGIC, P_CACHE_MAGIC_SIZE);
+        p_cache_put_bytes(&header, &byte_order, sizeof(byte_order));
+        p_cache_put_uint(&header, source_len);
+        p_cache_put_bytes(&header, &source_hash, sizeof(source_hash));
+        cache_name = p_cache_filename(stream->filename);
+        if (cache_name) {
+            p_cache_write_file(cache_name, &header, &writer);
+            free(cache_name);
+        }
+    }
+    free(header.data);
+    p_cache_free_writer(&writer);
+}
+
+static int p_cache_get_uint(p_cache_reader *reader, size_t *value)
+{
+    size_t result = 0;
+    int shift = 0;
+    int byte;
+    do {
+        if (reader->posn >= reader->end || shift >= (int)(sizeof(size_t) * 8))
+            return 0;
+        byte = *(reader->posn)++;
+        result |= ((size_t)(byte & 0x7F)) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value = result;
+    return 1;
+}
+
+static int p_cache_get_bytes
+    (p_cache_reader *reader, void *data, size_t len)
+{
+    if ((size_t)(reader->end - reader->posn) < len)
+        return 0;
+    memcpy(data, reader->posn, len);
+    reader->posn += len;
+    return 1;
+}
+
+static p_term *p_cache_get_atom(p_cache_reader *reader)
+{
+    size_t index;
+    if (!p_cache_get_uint(reader, &index) || index >= reader->num_atoms)
+        return 0;
+    return reader->atoms[index];
+}
+
+/* Reads a term from the cache, returning null if the cache is bad */
+static p_term *p_cache_read_term(p_context *context, p_cache_reader *reader)
+{
+    size_t index, count, len;
+    p_term *term;
+    p_term *name;
+    p_term *arg;
+    p_term *tail;
+    p_term *new_tail;
+    p_database_info *info;
+    int type;
+    double real;
+    if (reader->posn >= reader->end)
+        return 0;
+    type = *(reader->posn)++;
+    switch (type) {
+    case P_CACHE_ATOM:
+        return p_cache_get_atom(reader);
+    case P_CACHE_STRING:
+        if (!p_cache_get_uint(reader, &len) ||
+                (size_t)(reader->end - reader->posn) < len)
+            return 0;
+        term = p_term_create_string_n
+            (context, (const char *)(reader->posn), len);
+        reader->posn += len;
+        return term;
+    case P_CACHE_INTEGER:
+        if (!p_cache_get_uint(reader, &index))
+            return 0;
+        return p_term_create_integer
+            (context, (int)((unsigned int)(index >> 1) ^
+                            (0U - (unsigned int)(index & 1))));
+    case P_CACHE_REAL:
+        if (!p_cache_get_bytes(reader, &real, sizeof(real)))
+            return 0;
+        return p_term_create_real(context, real);
+    case P_CACHE_VARIABLE:
+        if (!p_cache_get_uint(reader, &index) || index > reader->num_vars)
+            return 0;
+        if (index < reader->num_vars)
+            return reader->vars[index];
+        if (reader->num_vars >= reader->max_vars) {
+            p_term **new_vars;
+            size_t new_max = reader->max_vars ? reader->max_vars * 2 : 64;
+            new_vars = (p_term **)GC_REALLOC
+                (reader->vars, new_max * sizeof(p_term *));
+            if (!new_vars)
+                return 0;
+            reader->vars = new_vars;
+            reader->max_vars = new_max;
+        }
+        term = p_term_create_variable(context);
+        reader->vars[(reader->num_vars)++] = term;
+        return term;
+    case P_CACHE_MEMBER_VARIABLE:
+        if (reader->posn >= reader->end)
+            return 0;
+        type = *(reader->posn)++;
+        name = p_cache_get_atom(reader);
+        if (!name)
+            return 0;
+        arg = p_cache_read_term(context, reader);
+        if (!arg)
+            return 0;
+        return p_term_create_member_variable(context, arg, name, type);
+    case P_CACHE_FUNCTOR:
+        name = p_cache_get_atom(reader);
+        if (!name || !p_cache_get_uint(reader, &count) || !count ||
+                count > (size_t)(reader->end - reader->posn))
+            return 0;
+        term = p_term_create_functor(context, name, (int)count);
+        for (index = 0; index < count; ++index) {
+            arg = p_cache_read_term(context, reader);
+            if (!arg)
+                return 0;
+            p_term_bind_functor_arg(term, (int)index, arg);
+        }
+        return term;
+    case P_CACHE_LIST:
+        if (!p_cache_get_uint(reader, &count) || !count ||
+                count > (size_t)(reader->end - reader->posn))
+            return 0;
+        term = 0;
+        tail = 0;
+        for (index = 0; index < count; ++index) {
+            arg = p_cache_read_term(context, reader);
+            if (!arg)
+                return 0;
+            new_tail = p_term_create_list(context, arg, 0);
+            if (tail)
+                p_term_set_tail(tail, new_tail);
+            else
+                term = new_tail;
+            tail = new_tail;
+        }
+        arg = p_cache_read_term(context, reader);
+        if (!arg)
+            return 0;
+        p_term_set_tail(tail, arg);
+        return term;
+    case P_CACHE_PREDICATE:
+        name = p_cache_get_atom(reader);
+        if (!name || !p_cache_get_uint(reader, &count))
+            return 0;
+        info = _p_db_create_arity(name, (unsigned int)count);
+        if (!info)
+            return 0;
+        if (!info->predicate) {
+            info->predicate = p_term_create_predicate
+                (context, name, (int)count);
+        }
+        return info->predicate;
+    default: break;
+    }
+    return 0;
+}
+
+/* Reads the atom table into "reader".  Returns zero on error */
+static int p_cache_read_atoms(p_context *context, p_cache_reader *reader)
+{
+    size_t index, len;
+    if (!p_cache_get_uint(reader, &(reader->num_atoms)) ||
+            reader->num_atoms > (size_t)(reader->end - reader->posn))
+        return 0;
+    reader->atoms = (p_term **)GC_MALLOC
+        ((reader->num_atoms + 1) * sizeof(p_term *));
+    if (!reader->atoms)
+        return 0;
+    for (index = 0; index < reader->num_atoms; ++index) {
+        if (!p_cache_get_uint(reader, &len) ||
+                (size_t)(reader->end - reader->posn) < len)
+            return 0;
+        reader->atoms[index] = p_term_create_atom_n
+            (context, (const char *)(reader->posn), len);
+        reader->posn += len;
+    }
+    return 1;
+}
+
+/* Reads the declarations from "data" if it is a valid cache for
+ * a source file with the given length and hash */
+static p_term *p_cache_read_declarations
+    (p_context *context, const unsigned char *data, size_t len,
+     size_t source_len, unsigned long long source_hash)
+{
+    p_cache_reader reader;
+    unsigned long byte_order;
+    unsigned long long hash;
+    size_t value;
+    p_term *decls = 0;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.posn = data;
+    reader.end = data + len;
+    if (len < P_CACHE_MAGIC_SIZE ||
+            memcmp(data, P_CACHE_MAGIC, P_CACHE_MAGIC_SIZE) != 0)
+        return 0;
+    reader.posn += P_CACHE_MAGIC_SIZE;
+    if (!p_cache_get_bytes(&reader, &byte_order, sizeof(byte_order)) ||
+            byte_order != P_CACHE_BYTE_ORDER)
+        return 0;
+    if (!p_cache_get_uint(&reader, &value) || value != source_len)
+        return 0;
+    if (!p_cache_get_bytes(&reader, &hash, sizeof(hash)) ||
+            hash != source_hash)
+        return 0;
+
+    /* Load the atoms that are used by the declarations */
+    if (p_cache_read_atoms(context, &reader)) {
+        decls = p_cache_read_term(context, &reader);
+        if (reader.posn != reader.end)
+            decls = 0;
+    }
+    GC_FREE(reader.atoms);
+    GC_FREE(reader.vars);
+    return decls;
+}
+
+/* Re-runs the directives from cached declarations in the same order
+ * that the parser originally ran them, including imports */
+static void p_cache_run_directives
+    (p_context *context, p_input_stream *stream)
+{
+    p_term *list = stream->declarations;
+    p_term *directive_atom = p_term_create_atom(context, ":-");
+    p_term *import_atom = p_term_create_atom(context, "import");
+    p_term *decl;
+    p_term *name;
+    while (list->header.type == P_TERM_LIST) {
+        decl = p_term_deref(list->list.head);
+        list = list->list.tail;
+        if (!decl || decl->header.type != P_TERM_FUNCTOR ||
+                decl->header.size != 1 ||
+                decl->functor.functor_name != directive_atom)
+            continue;
+        decl = p_term_deref(decl->functor.arg[0]);
+        if (decl && decl->header.type == P_TERM_FUNCTOR &&
+                decl->header.size == 1 &&
+                decl->functor.functor_name == import_atom) {
+            name = p_term_deref(decl->functor.arg[0]);
+            if (_p_context_import_file
+                    (context, stream, p_term_name(name)) < 0) {
+                fprintf(stderr, "%s: cannot locate import `%s'\n",
+                        stream->filename, p_term_name(name));
+                ++(stream->error_count);
+            }
+        } else if (p_goal_call_from_parser(context, decl)
+                        != P_RESULT_TRUE) {
+            ++(stream->error_count);
+        }
+    }
+}
+
+/* Consults "stream" from its cache file if the cache is up to date.
+ * Returns -1 if the source file must be parsed instead, or the
+ * result of consulting the declarations from the cache otherwise.
+ * The source text is returned in "source" for writing a new cache */
+int _p_context_load_cache
+    (p_context *context, p_input_stream *stream,
+     char **source, size_t *source_len)
+{
+    char *cache_name;
+    FILE *file;
+    char *data;
+    size_t len;
+    unsigned long long hash;
+    p_term *decls;
+
+    /* Hash the contents of the source file */
+    *source = p_cache_read_file(stream->stream, source_len);
+    if (!*source)
+        return -1;
+    hash = p_cache_hash(*source, *source_len);
+
+    /* Load the cache file if it matches the source */
+    cache_name = p_cache_filename(stream->filename);
+    if (!cache_name)
+        return -1;
+    file = fopen(cache_name, "rb");
+    free(cache_name);
+    if (!file)
+        return -1;
+    data = p_cache_read_file(file, &len);
+    fclose(file);
+    if (!data)
+        return -1;
+    decls = p_cache_read_declarations
+        (context, (const unsigned char *)data, len, *source_len, hash);
+    free(data);
+    if (!decls)
+        return -1;
+
+    /* Run the directives and then process the declarations
+     * as though they had just been parsed from the source */
+    stream->declarations = decls;
+    p_cache_run_directives(context, stream);
+    return _p_context_consult_declarations
+        (context, stream, stream->error_count == 0);
+}
+
+/* Writes "clause" of "predicate" to an image in (:-)/2 form */
+static int p_image_write_clause
+    (p_context *context, p_cache_writer *writer,
+     p_term *predicate, struct p_term_clause *clause)
+{
+    unsigned int arity = predicate->header.size;
+    unsigned int index;
+    p_term *head;
+    p_term *body;
+    p_term *source;
+    void *marker;
+    int ok;
+
+    /* Each clause has its own set of variables */
+    p_cache_reset_vars(writer);
+
+    /* Clauses that have not been compiled yet still have their source */
+    if (p_term_clause_is_lazy(clause))
+        return p_cache_write_term(writer, clause->source);
+
+    /* Recover the clause by unifying it against a fresh head */
+    if (arity > 0) {
+        head = p_term_create_functor
+            (context, predicate->predicate.name, (int)arity);
+        for (index = 0; index < arity; ++index) {
+            p_term_bind_functor_arg
+                (head, (int)index, p_term_create_variable(context));
+        }
+    } else {
+        head = predicate->predicate.name;
+    }
+    marker = p_context_mark_trail(context);
+    body = p_term_unify_clause(context, head, (p_term *)clause);
+    if (body) {
+        source = p_term_create_functor(context, context->clause_atom, 2);
+        p_term_bind_functor_arg(source, 0, head);
+        p_term_bind_functor_arg(source, 1, body);
+        ok = p_cache_write_term(writer, source);
+    } else {
+        ok = 0;
+    }
+    p_context_backtrack_trail(context, marker);
+    return ok;
+}
+
+static int p_image_write_predicate
+    (p_context *context, p_cache_writer *writer,
+     p_term *name, p_database_info *info)
+{
+    p_cache_buffer *buf = &(writer->terms);
+    p_term *predicate = info->predicate;
+    struct p_term_clause *clause;
+    size_t count = 0;
+    if (predicate) {
+        for (clause = predicate->predicate.clauses.head; clause;
+                clause = clause->next_clause)
+            ++count;
+    }
+    p_cache_put_byte(buf, P_IMAGE_PREDICATE);
+    p_cache_write_atom(writer, name);
+    p_cache_put_uint(buf, info->arity);
+    p_cache_put_uint(buf, info->flags);
+    p_cache_put_uint(buf, info->index_depth);
+    p_cache_put_uint(buf, count);
+    if (predicate) {
+        for (clause = predicate->predicate.clauses.head; clause;
+                clause = clause->next_clause) {
+            if (!p_image_write_clause(context, writer, predicate, clause))
+                return 0;
+        }
+    }
+    return !buf->error;
+}
+
+/* Writes "class_info" to an image, after its parent classes.
+ * The "classes" map records the classes that have been written */
+static int p_image_write_class
+    (p_context *context, p_cache_writer *writer,
+     p_class_info *class_info, p_cache_map *classes)
+{
+    p_cache_buffer *buf = &(writer->terms);
+    p_term *object = class_info->class_object;
+    p_term *block;
+    p_term *name;
+    size_t index, count;
+    int result;
+
+    result = p_cache_map_lookup
+        (classes, (const p_term *)class_info, &index);
+    if (result <= 0)
+        return result == 0;
+    if (class_info->parent && !p_image_write_class
+            (context, writer, class_info->parent, classes))
+        return 0;
+
+    /* Write the name, parent, and member variables */
+    p_cache_put_byte(buf, P_IMAGE_CLASS);
+    p_cache_write_atom
+        (writer, p_term_own_property
+            (context, object, context->class_name_atom));
+    if (class_info->parent) {
+        name = p_term_own_property
+            (context, class_info->parent->class_object,
+             context->class_name_atom);
+    } else {
+        name = context->nil_atom;
+    }
+    if (!p_cache_write_term(writer, name) ||
+            !p_cache_write_term(writer, class_info->var_list))
+        return 0;
+
+    /* Write the member properties of the class object, which
+     * are usually predicates or lists of predicates */
+    count = 0;
+    for (block = object; block; block = block->object.next) {
+        for (index = 0; index < block->header.size; ++index) {
+            name = block->object.properties[index].name;
+            if (name != context->class_name_atom &&
+                    name != context->prototype_atom)
+                ++count;
+        }
+    }
+    p_cache_put_uint(buf, count);
+    for (block = object; block; block = block->object.next) {
+        for (index = 0; index < block->header.size; ++index) {
+            name = block->object.properties[index].name;
+            if (name == context->class_name_atom ||
+                    name == context->prototype_atom)
+                continue;
+            p_cache_write_atom(writer, name);
+            if (!p_cache_write_term
+                    (writer, block->object.properties[index].value))
+                return 0;
+        }
+    }
+    return !buf->error;
+}
+
+/* Writes the libraries in the order in which they were loaded */
+static void p_image_write_libraries
+    (p_cache_writer *writer, p_library *library)
+{
+    if (!library)
+        return;
+    p_image_write_libraries(writer, library->next);
+    p_cache_put_byte(&(writer->terms), P_IMAGE_LIBRARY);
+    p_cache_write_atom(writer, library->name);
+}
+
+static int p_image_builtin_compare(const void *e1, const void *e2)
+{
+    p_db_builtin func1 = ((const p_image_builtin *)e1)->info->builtin_func;
+    p_db_builtin func2 = ((const p_image_builtin *)e2)->info->builtin_func;
+    return memcmp(&func1, &func2, sizeof(p_db_builtin));
+}
+
+/* Builtins can be registered under extra names after the context
+ * is created, such as fuzzy/1 by import(fuzzy).  Every builtin
+ * that shares its function with another is written along with
+ * the other name, so that the extra names can be restored */
+static int p_image_write_builtins(p_context *context, p_cache_writer *writer)
+{
+    p_cache_buffer *buf = &(writer->terms);
+    p_image_builtin *builtins;
+    struct p_term_atom_link *link;
+    p_database_info *info;
+    p_term *atom;
+    size_t count, index, posn, end, alias;
+
+    /* Only pinned atoms can have database information */
+    count = 0;
+    for (index = 0; index < context->atom_hash_size; ++index) {
+        for (link = context->atom_hash[index]; link; link = link->next) {
+            atom = link->pinned;
+            if (!atom)
+                continue;
+            for (info = atom->atom.db_info; info; info = info->next) {
+                if (info->builtin_func)
+                    ++count;
+            }
+        }
+    }
+    if (!count)
+        return 1;
+    builtins = (p_image_builtin *)malloc(count * sizeof(p_image_builtin));
+    if (!builtins)
+        return 0;
+    count = 0;
+    for (index = 0; index < context->atom_hash_size; ++index) {
+        for (link = context->atom_hash[index]; link; link = link->next) {
+            atom = link->pinned;
+            if (!atom)
+                continue;
+            for (info = atom->atom.db_info; info; info = info->next) {
+                if (info->builtin_func) {
+                    builtins[count].name = atom;
+                    builtins[count].info = info;
+                    ++count;
+                }
+            }
+        }
+    }
+    qsort(builtins, count, sizeof(p_image_builtin), p_image_builtin_compare);
+    for (posn = 0; posn < count; posn = end) {
+        end = posn + 1;
+        while (end < count && builtins[end].info->builtin_func ==
+                                builtins[posn].info->builtin_func)
+            ++end;
+        if ((end - posn) < 2)
+            continue;
+        for (index = posn; index < end; ++index) {
+            alias = (index + 1) < end ? index + 1 : posn;
+            p_cache_put_byte(buf, P_IMAGE_BUILTIN);
+            p_cache_write_atom(writer, builtins[index].name);
+            p_cache_put_uint(buf, builtins[index].info->arity);
+            p_cache_write_atom(writer, builtins[alias].name);
+            p_cache_put_uint(buf, builtins[alias].info->arity);
+        }
+    }
+    free(builtins);
+    return !buf->error;
+}
+
+static int p_image_write_context(p_context *context, p_cache_writer *writer)
+{
+    p_cache_buffer *buf = &(writer->terms);
+    p_cache_map classes;
+    struct p_term_atom_link *link;
+    p_database_info *info;
+    p_term *atom;
+    size_t index, len;
+    int ok;
+
+    /* Files that have been consulted, so that imports of the
+     * same files after the image is loaded will be skipped */
+    for (index = 0; index < context->loaded_files.num_paths; ++index) {
+        len = strlen(context->loaded_files.paths[index]);
+        p_cache_put_byte(buf, P_IMAGE_FILE);
+        p_cache_put_uint(buf, len);
+        p_cache_put_bytes(buf, context->loaded_files.paths[index], len);
+    }
+
+    /* Libraries must be reloaded before the predicates so that
+     * their builtins take precedence over database clauses */
+    p_image_write_libraries(writer, context->libraries);
+    ok = p_image_write_builtins(context, writer);
+
+    /* Database predicates, including dynamic predicates and index
+     * declarations that do not have any clauses yet */
+    for (index = 0; ok && index < context->atom_hash_size; ++index) {
+        for (link = context->atom_hash[index]; ok && link;
+                link = link->next) {
+            atom = link->pinned;
+            if (!atom)
+                continue;
+            for (info = atom->atom.db_info; ok && info; info = info->next) {
+                if ((info->flags & P_PREDICATE_BUILTIN) ||
+                        info->source_builtin)
+                    continue;
+                if (info->predicate || info->flags || info->index_depth) {
+                    ok = p_image_write_predicate
+                        (context, writer, atom, info);
+                }
+            }
+        }
+    }
+
+    /* Classes are written after the predicates for their members */
+    memset(&classes, 0, sizeof(classes));
+    for (index = 0; ok && index < context->atom_hash_size; ++index) {
+        for (link = context->atom_hash[index]; ok && link;
+                link = link->next) {
+            atom = link->pinned;
+            if (!atom)
+                continue;
+            info = _p_db_find_arity(atom, 0);
+            if (info && info->class_info) {
+                ok = p_image_write_class
+                    (context, writer, info->class_info, &classes);
+            }
+        }
+    }
+    free(classes.entries);
+
+    p_cache_put_byte(buf, P_IMAGE_END);
+    return ok && !buf->error;
+}
+
+/**
+ * \brief Saves the state of \a context to the image \a filename.
+ *
+ * The image holds the clauses of the predicate database, the
+ * predicate flags, the classes, the names of the files that have
+ * been consulted, and the names of the native libraries that have
+ * been loaded.  It can be restored into a new context with
+ * p_context_load_image(), which is a lot quicker than consulting
+ * the original source files for large programs.
+ *
+ * Returns zero if the image was saved, or an errno code otherwise.
+ * EINVAL indicates that the database contains terms that cannot be
+ * saved, such as objects that were asserted into dynamic clauses.
+ *
+ * Images are specific to the host that saved them and should
+ * be regenerated whenever Plang is upgraded.
+ *
+ * \ingroup context
+ * \sa p_context_load_image()
+ */
+int p_context_save_image(p_context *context, const char *filename)
+{
+    p_cache_writer writer;
+    p_cache_buffer header;
+    unsigned long byte_order = P_CACHE_BYTE_ORDER;
+    int error;
+    memset(&writer, 0, sizeof(writer));
+    memset(&header, 0, sizeof(header));
+    if (p_image_write_context(context, &writer)) {
+        p_cache_put_bytes(&header, P_IMAGE_MAGIC, P_CACHE_MAGIC_SIZE);
+        p_cache_put_bytes(&header, &byte_order, sizeof(byte_order));
+        error = p_cache_write_file(filename, &header, &writer);
+    } else {
+        error = writer.terms.error ? ENOMEM : EINVAL;
+    }
+    free(header.data);
+    p_cache_free_writer(&writer);
+    return error;
+}
+
+static int p_image_read_predicate(p_context *context, p_cache_reader *reader)
+{
+    p_term *name = p_cache_get_atom(reader);
+    p_database_info *info;
+    p_term *clause;
+    size_t arity, flags, depth, count;
+    if (!name || !p_cache_get_uint(reader, &arity) ||
+            !p_cache_get_uint(reader, &flags) ||
+            !p_cache_get_uint(reader, &depth) ||
+            !p_cache_get_uint(reader, &count))
+        return 0;
+    info = _p_db_create_arity(name, (unsigned int)arity);
+    if (!info || (info->flags & P_PREDICATE_BUILTIN) != 0)
+        return 0;
+
+    /* The index depth and occurs check flag must be set before
+     * the clauses are added, as they affect clause compilation */
+    info->flags = (unsigned int)
+        (flags & ~(P_PREDICATE_BUILTIN | P_PREDICATE_COMPILED));
+    info->index_depth = (unsigned int)depth;
+    if (info->predicate && depth)
+        info->predicate->predicate.index_depth = (unsigned int)(depth - 1);
+    while (count > 0) {
+        reader->num_vars = 0;
+        clause = p_cache_read_term(context, reader);
+        if (!clause || clause->header.type != P_TERM_FUNCTOR ||
+                clause->header.size != 2 ||
+                clause->functor.functor_name != context->clause_atom)
+            return 0;
+        if (!_p_db_clause_consult(context, clause))
+            return 0;
+        --count;
+    }
+    info->flags = (unsigned int)(flags & ~P_PREDICATE_BUILTIN);
+    return 1;
+}
+
+static int p_image_read_class(p_context *context, p_cache_reader *reader)
+{
+    p_term *name = p_cache_get_atom(reader);
+    p_term *parent;
+    p_term *vars;
+    p_term *class_object;
+    p_term *prototype;
+    p_term *value;
+    p_database_info *info;
+    p_database_info *parent_db_info;
+    p_class_info *class_info;
+    p_class_info *parent_info;
+    size_t count;
+
+    if (!name)
+        return 0;
+    parent = p_cache_read_term(context, reader);
+    vars = p_cache_read_term(context, reader);
+    if (!parent || !vars || !p_cache_get_uint(reader, &count))
+        return 0;
+    info = _p_db_create_arity(name, 0);
+    if (!info || info->class_info)
+        return 0;
+    if (parent != context->nil_atom) {
+        parent_db_info = _p_db_find_arity(parent, 0);
+        if (!parent_db_info || !parent_db_info->class_info)
+            return 0;
+        parent_info = parent_db_info->class_info;
+        prototype = parent_info->class_object;
+    } else {
+        parent_info = 0;
+        prototype = 0;
+    }
+
+    class_info = GC_NEW(p_class_info);
+    if (!class_info)
+        return 0;
+    class_object = p_term_create_class_object(context, name, prototype);
+    if (!class_object)
+        return 0;
+    class_info->class_object = class_object;
+    class_info->parent = parent_info;
+    class_info->var_list = vars;
+    while (count > 0) {
+        name = p_cache_get_atom(reader);
+        if (!name)
+            return 0;
+        value = p_cache_read_term(context, reader);
+        if (!value ||
+                !p_term_add_property(context, class_object, name, value))
+            return 0;
+        --count;
+    }
+    info->class_info = class_info;
+    return 1;
+}
+
+static int p_image_read_builtin(p_cache_reader *reader)
+{
+    p_term *name = p_cache_get_atom(reader);
+    p_term *alias;
+    p_database_info *info;
+    size_t arity, alias_arity;
+    if (!name || !p_cache_get_uint(reader, &arity))
+        return 0;
+    alias = p_cache_get_atom(reader);
+    if (!alias || !p_cache_get_uint(reader, &alias_arity))
+        return 0;
+    info = _p_db_find_arity(name, (unsigned int)arity);
+    if (info && (info->flags & P_PREDICATE_BUILTIN) != 0)
+        return 1;
+    info = _p_db_find_arity(alias, (unsigned int)alias_arity);
+    if (info && (info->flags & P_PREDICATE_BUILTIN) != 0)
+        p_db_set_builtin_predicate(name, (int)arity, info->builtin_func);
+    return 1;
+}
+
+static int p_image_read_context(p_context *context, p_cache_reader *reader)
+{
+    p_term *error;
+    p_term *name;
+    char *filename;
+    size_t len;
+    while (reader->posn < reader->end) {
+        switch (*(reader->posn)++) {
+        case P_IMAGE_END:
+            return reader->posn == reader->end;
+        case P_IMAGE_FILE:
+            if (!p_cache_get_uint(reader, &len) ||
+                    (size_t)(reader->end - reader->posn) < len)
+                return 0;
+            filename = (char *)malloc(len + 1);
+            if (!filename)
+                return 0;
+            memcpy(filename, reader->posn, len);
+            filename[len] = '\0';
+            reader->posn += len;
+            p_context_add_path(context->loaded_files, filename);
+            free(filename);
+            break;
+        case P_IMAGE_LIBRARY:
+            name = p_cache_get_atom(reader);
+            error = 0;
+            if (!name || _p_context_load_library(context, name, &error)
+                            != P_RESULT_TRUE)
+                return 0;
+            break;
+        case P_IMAGE_BUILTIN:
+            if (!p_image_read_builtin(reader))
+                return 0;
+            break;
+        case P_IMAGE_PREDICATE:
+            if (!p_image_read_predicate(context, reader))
+                return 0;
+            break;
+        case P_IMAGE_CLASS:
+            if (!p_image_read_class(context, reader))
+                return 0;
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Loads the image \a filename into \a context.
+ *
+ * The image must have been saved by p_context_save_image() on
+ * the same host.  The \a context should be newly created, with
+ * nothing consulted into it yet.  Library paths must be set on
+ * \a context before the image is loaded if the image refers to
+ * native libraries that are not in the system library directories.
+ *
+ * Returns zero if the image was loaded, or an errno code otherwise.
+ * EINVAL indicates that \a filename is not a valid image, or that it
+ * could not be loaded because of conflicts with the existing state
+ * of \a context.  Other errno codes indicate errors in opening or
+ * reading from \a filename.
+ *
+ * \ingroup context
+ * \sa p_context_save_image()
+ */
+int p_context_load_image(p_context *context, const char *filename)
+{
+    p_cache_reader reader;
+    unsigned long byte_order;
+    FILE *file;
+    char *data;
+    size_t len;
+    int ok;
+
+    file = fopen(filename, "rb");
+    if (!file)
+        return errno;
+    data = p_cache_read_file(file, &len);
+    fclose(file);
+    if (!data)
+        return ENOMEM;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.posn = (const unsigned char *)data;
+    reader.end = reader.posn + len;
+    ok = len >= P_CACHE_MAGIC_SIZE &&
+         !memcmp(data, P_IMAGE_MAGIC, P_CACHE_MAGIC_SIZE);
+    if (ok) {
+        reader.posn += P_CACHE_MAGIC_SIZE;
+        ok = p_cache_get_bytes(&reader, &byte_order, sizeof(byte_order)) &&
+             byte_order == P_CACHE_BYTE_ORDER &&
+             p_cache_read_atoms(context, &reader) &&
+             p_image_read_context(context, &reader);
+    }
+    GC_FREE(reader.atoms);
+    GC_FREE(reader.vars);
+    free(data);
+    return ok ? 0 : EINVAL;
+}
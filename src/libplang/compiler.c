@@ -19,6 +19,7 @@
 
 #include "inst-priv.h"
 #include "context-priv.h"
+#include <string.h>
 
 /** @cond */
 
@@ -941,22 +942,13 @@ void _p_code_generate_matcher
     p_context_backtrack_trail(context, marker);
 }
 
-/* Generate code for a dynamic clause that matches the "head"
- * and then builds and returns the "body" */
-void _p_code_generate_dynamic_clause
-    (p_context *context, p_term *head, p_term *body, p_code *code)
+/* Generate code to match the arguments of a clause head against
+ * the incoming argument registers */
+static void p_code_generate_head
+    (p_context *context, p_term *head, p_code *code)
 {
-    void *marker = p_context_mark_trail(context);
-    int arity, index, reg;
+    int arity, index;
     p_term *arg;
-
-    /* Assign registers to the variables in the terms.  For dynamic
-     * clauses, the body is built straight after matching the head
-     * so it is still technically within the head goal's scope */
-    p_code_analyze_variables(context, head, 0);
-    p_code_analyze_variables(context, body, 0);
-
-    /* Allocate and match the arguments */
     arity = p_term_arg_count(head);
     _p_code_allocate_args(code, arity);
     for (index = 0; index < arity; ++index) {
@@ -972,6 +964,24 @@ void _p_code_generate_dynamic_clause
             p_code_generate_matcher_inner(context, arg, code, index, 0);
         }
     }
+}
+
+/* Generate code for a dynamic clause that matches the "head"
+ * and then builds and returns the "body" */
+void _p_code_generate_dynamic_clause
+    (p_context *context, p_term *head, p_term *body, p_code *code)
+{
+    void *marker = p_context_mark_trail(context);
+    int reg;
+
+    /* Assign registers to the variables in the terms.  For dynamic
+     * clauses, the body is built straight after matching the head
+     * so it is still technically within the head goal's scope */
+    p_code_analyze_variables(context, head, 0);
+    p_code_analyze_variables(context, body, 0);
+
+    /* Allocate and match the arguments */
+    p_code_generate_head(context, head, code);
 
     /* Build the clause body and return it.  If there is no body
      * then succeed without constructing a body term */
@@ -986,6 +996,138 @@ void _p_code_generate_dynamic_clause
     p_context_backtrack_trail(context, marker);
 }
 
+/* Analyze the variables in the goals of a clause body.  The first
+ * goal shares "goal_number" with the head and each subsequent goal
+ * gets the next number.  Returns the number of the last goal */
+static unsigned int p_code_analyze_body
+    (p_context *context, p_term *body, unsigned int goal_number)
+{
+    body = p_term_deref(body);
+    if (body && body->header.type == P_TERM_FUNCTOR &&
+            body->header.size == 2 &&
+            body->functor.functor_name == context->comma_atom) {
+        goal_number = p_code_analyze_body
+            (context, body->functor.arg[0], goal_number);
+        return p_code_analyze_body
+            (context, body->functor.arg[1], goal_number + 1);
+    }
+    p_code_analyze_variables(context, body, goal_number);
+    return goal_number;
+}
+
+/* Determine if "var" is the first occurrence of a variable
+ * and that it does not occur within "value" */
+static int p_code_is_fresh_variable
+    (p_context *context, p_term *var, p_term *value)
+{
+    var = p_term_deref(var);
+    value = p_term_deref(value);
+    if (!var || !value)
+        return 0;
+    if (var->header.type != P_TERM_X_REGISTER &&
+            var->header.type != P_TERM_Y_REGISTER)
+        return 0;
+    if (var->reg.allocated)
+        return 0;
+    if (value->header.type == P_TERM_MEMBER_VARIABLE)
+        return 0;   /* Unification must resolve the member */
+    return !p_term_occurs_in(context, var, value);
+}
+
+/* Generate code for a "X = Term" goal where X is the first
+ * occurrence of a variable that does not occur in Term.
+ * The unification cannot fail and does not need an occurs
+ * check, so we build Term straight into the variable's register
+ * instead of calling (=)/2.  Returns zero if not applicable */
+static int p_code_generate_fresh_unify
+    (p_context *context, p_term *goal, p_code *code)
+{
+    p_term *var;
+    p_term *value;
+    int reg;
+    if (goal->header.type != P_TERM_FUNCTOR ||
+            goal->header.size != 2 ||
+            goal->functor.functor_name != context->unify_atom)
+        return 0;
+    if (p_code_is_fresh_variable
+            (context, goal->functor.arg[0], goal->functor.arg[1])) {
+        var = p_term_deref(goal->functor.arg[0]);
+        value = goal->functor.arg[1];
+    } else if (p_code_is_fresh_variable
+                    (context, goal->functor.arg[1], goal->functor.arg[0])) {
+        var = p_term_deref(goal->functor.arg[1]);
+        value = goal->functor.arg[0];
+    } else {
+        return 0;
+    }
+    reg = p_code_generate_builder_inner(context, value, code, -1);
+    if (var->header.type == P_TERM_Y_REGISTER) {
+        var->header.size = (unsigned int)((code->num_yregs)++);
+        var->reg.allocated = 1;
+        p_inst_new_two_reg(code, P_OP_GET_Y_VARIABLE,
+                           reg, (int)(var->header.size));
+    }
+    /* An X register variable that does not occur in the value
+     * has no other references, so the value can be discarded */
+    p_inst_reg_used(code, reg);
+    return 1;
+}
+
+/* Generate "call" instructions for the goals in a clause body.
+ * The final goal is invoked with "execute" if "last" is non-zero */
+static void p_code_generate_body
+    (p_context *context, p_term *body, p_code *code, int last)
+{
+    p_inst *inst;
+    int reg;
+    body = p_term_deref(body);
+    if (body && body->header.type == P_TERM_FUNCTOR &&
+            body->header.size == 2 &&
+            body->functor.functor_name == context->comma_atom) {
+        p_code_generate_body(context, body->functor.arg[0], code, 0);
+        p_code_generate_body(context, body->functor.arg[1], code, last);
+        return;
+    }
+    if (body && p_code_generate_fresh_unify(context, body, code)) {
+        if (last)
+            p_inst_new(code, P_OP_PROCEED, struct p_inst_header);
+        return;
+    }
+    reg = p_code_generate_builder_inner(context, body, code, -1);
+    inst = p_inst_new(code, last ? P_OP_EXECUTE : P_OP_CALL,
+                      struct p_inst_call);
+    inst->call.reg1 = reg;
+    p_inst_reg_used(code, reg);
+}
+
+/* Generate code for a clause that matches the "head" and then
+ * calls each of the goals in "body" in turn.  Variables that
+ * live across calls are placed into the Y registers of the
+ * clause's environment.  Only the goal that is about to be
+ * called is built on the heap, not the whole body */
+void _p_code_generate_clause
+    (p_context *context, p_term *head, p_term *body, p_code *code)
+{
+    void *marker = p_context_mark_trail(context);
+
+    /* Assign registers to the variables in the head and body */
+    p_code_analyze_variables(context, head, 0);
+    if (body != context->true_atom)
+        p_code_analyze_body(context, body, 0);
+
+    /* Allocate and match the arguments */
+    p_code_generate_head(context, head, code);
+
+    /* Call the body goals, or proceed if there is no body */
+    if (body != context->true_atom)
+        p_code_generate_body(context, body, code, 1);
+    else
+        p_inst_new(code, P_OP_PROCEED, struct p_inst_header);
+
+    /* Backtrack out the register assignments */
+    p_context_backtrack_trail(context, marker);
+}
+
 p_code *_p_code_new(void)
 {
     p_code *code = GC_NEW(p_code);
@@ -993,6 +1135,44 @@ p_code *_p_code_new(void)
     return code;
 }
 
+/* Copies the code for "clause" out of the fixed-size blocks that
+ * it was generated into and into a single allocation of the exact
+ * size.  The jumps between blocks are removed along the way, and the
+ * blocks are freed.  Most clauses are facts or short rules that only
+ * use a fraction of the first block */
+static void p_code_compact(p_code_clause *clause)
+{
+    p_code_block *block = clause->code;
+    const p_inst *inst = (p_inst *)(block->inst);
+    size_t size = _p_code_clause_size(clause);
+    size_t inst_size;
+    p_opcode opcode;
+    char *code;
+    char *posn;
+    code = (char *)GC_MALLOC(size);
+    if (!code)
+        return;
+    posn = code;
+    for (;;) {
+        opcode = p_inst_opcode(inst);
+        if (opcode == P_OP_JUMP) {
+            /* The label points to the start of the next block */
+            inst = inst->label.label;
+            GC_FREE(block);
+            block = (p_code_block *)inst;
+            continue;
+        }
+        inst_size = _p_code_inst_size(inst);
+        memcpy(posn, inst, inst_size);
+        posn += inst_size;
+        if (opcode == P_OP_END)
+            break;
+        inst = (p_inst *)(((const char *)inst) + inst_size);
+    }
+    GC_FREE(block);
+    clause->code = (p_code_block *)code;
+}
+
 void _p_code_finish(p_code *code, p_code_clause *clause)
 {
     p_code_block *block;
@@ -1010,7 +1190,12 @@ void _p_code_finish(p_code *code, p_code_clause *clause)
     /* Detach the code and create a clause block for it */
     clause->num_xregs = code->num_regs;
     clause->num_yregs = code->num_yregs;
+    clause->bind_flags = P_BIND_DEFAULT;
     clause->code = code->first_block;
+    p_code_compact(clause);
+#if defined(P_INST_THREADED)
+    _p_code_thread(clause);
+#endif
 
     /* Clean up and exit */
     if (code->used_regs)
@@ -1020,4 +1205,302 @@ void _p_code_finish(p_code *code, p_code_clause *clause)
     GC_FREE(code);
 }
 
+/* Information about a group of clauses that have the same key
+ * in the argument that is used for clause selection */
+typedef struct p_switch_group p_switch_group;
+struct p_switch_group
+{
+    p_rbkey key;
+    unsigned int hash;
+    unsigned int count;
+    struct p_term_clause **clauses;
+};
+
+#define P_SWITCH_VAR_CLAUSE     ((unsigned int)(-1))
+
+/* Creates a "try_clauses" instruction for a null-terminated list
+ * of "count" clauses.  Returns null if there are no clauses or
+ * the instruction could not be allocated */
+static p_inst *p_switch_new_try
+    (struct p_term_clause **clauses, unsigned int count)
+{
+    struct p_inst_try_clauses *inst;
+    if (!count)
+        return 0;
+    inst = GC_NEW(struct p_inst_try_clauses);
+    if (!inst)
+        return 0;
+    inst->opcode = P_OP_TRY_CLAUSES;
+    inst->count = count;
+    inst->clauses = clauses;
+    return (p_inst *)inst;
+}
+
+/* Creates a "switch_on_constant" or "switch_on_structure"
+ * instruction for the groups listed in "order".  Small tables
+ * are searched linearly and larger tables are hashed.  Returns
+ * null if the instruction could not be allocated */
+static p_inst *p_switch_new_table
+    (p_opcode opcode, unsigned int arg, const p_switch_group *groups,
+     const unsigned int *order, p_inst **labels, unsigned int count,
+     p_inst *default_label)
+{
+    struct p_inst_switch_table *inst;
+    p_switch_entry *entries;
+    unsigned int size, index, posn;
+    if (count <= P_SWITCH_LINEAR_MAX) {
+        size = count;
+    } else {
+        size = 16;
+        while (size < count * 2)
+            size *= 2;
+    }
+    inst = GC_NEW(struct p_inst_switch_table);
+    entries = (p_switch_entry *)GC_MALLOC(sizeof(p_switch_entry) * size);
+    if (!inst || !entries)
+        return 0;
+    inst->opcode = opcode;
+    inst->reg1 = arg;
+    inst->num_entries = count;
+    inst->mask = (count <= P_SWITCH_LINEAR_MAX) ? 0 : size - 1;
+    inst->default_label = default_label;
+    inst->entries = entries;
+    for (index = 0; index < count; ++index) {
+        const p_switch_group *group = &(groups[order[index]]);
+        if (inst->mask) {
+            posn = group->hash & inst->mask;
+            while (entries[posn].label)
+                posn = (posn + 1) & inst->mask;
+        } else {
+            posn = index;
+        }
+        entries[posn].key = group->key;
+        entries[posn].hash = group->hash;
+        entries[posn].label = labels[order[index]];
+    }
+    return (p_inst *)inst;
+}
+
+/* Chooses the argument to switch on for the "count" clauses in
+ * "clauses".  The argument whose key changes the most often from
+ * one clause to the next is likely to be the most selective */
+static unsigned int p_switch_choose_arg
+    (struct p_term_clause **clauses, unsigned int count,
+     unsigned int arity)
+{
+    unsigned int arg, index, changes;
+    unsigned int best_arg = 0;
+    unsigned int best_changes = 0;
+    p_rbkey prev, key;
+    for (arg = 0; arg < arity; ++arg) {
+        changes = 0;
+        for (index = 0; index < count; ++index) {
+            if (!_p_term_clause_key(&key, clauses[index], arg, 0)) {
+                key.type = P_TERM_VARIABLE;
+                key.size = 0;
+                key.name = 0;
+            }
+            if (index > 0 && !_p_rbkey_equal_keys(&prev, &key))
+                ++changes;
+            prev = key;
+        }
+        if (changes > best_changes) {
+            best_changes = changes;
+            best_arg = arg;
+        }
+    }
+    return best_arg;
+}
+
+/* Generates the clause selection code for "predicate".  The
+ * clauses are grouped on the key of the predicate's index argument,
+ * and the code dispatches on the type of the argument and then on
+ * the key.  Clauses that have a variable in the index argument are
+ * merged into every group in clause order.  Returns null if there
+ * is not enough memory, in which case the clauses are scanned in
+ * order instead */
+p_inst *_p_code_generate_switch(p_term *predicate)
+{
+    unsigned int num_clauses = predicate->predicate.clause_count;
+    unsigned int arg;
+    struct p_term_clause **all;
+    struct p_term_clause **vars;
+    struct p_term_clause *clause;
+    p_switch_group *groups;
+    unsigned int *group_of;
+    unsigned int *buckets;
+    unsigned int *constants;
+    unsigned int *structures;
+    p_inst **labels;
+    p_inst *all_label;
+    p_inst *var_label;
+    p_inst *list_label;
+    struct p_inst_switch_on_term *inst;
+    unsigned int num_groups = 0;
+    unsigned int num_vars = 0;
+    unsigned int num_constants = 0;
+    unsigned int num_structures = 0;
+    unsigned int index, group, size, posn, hash;
+    p_rbkey key;
+
+    /* Collect up all of the clauses in order */
+    all = (struct p_term_clause **)GC_MALLOC
+        (sizeof(struct p_term_clause *) * (num_clauses + 1));
+    if (!all)
+        return 0;
+    index = 0;
+    clause = predicate->predicate.clauses.head;
+    while (clause && index < num_clauses) {
+        all[index++] = clause;
+        clause = clause->next_clause;
+    }
+    num_clauses = index;
+    all_label = p_switch_new_try(all, num_clauses);
+    if (num_clauses <= 1 || predicate->header.size == 0)
+        return all_label;
+    arg = p_switch_choose_arg(all, num_clauses, predicate->header.size);
+    predicate->predicate.index_arg = arg;
+
+    /* Sort the clauses into groups according to their keys */
+    size = 16;
+    while (size < num_clauses * 2)
+        size *= 2;
+    groups = (p_switch_group *)GC_MALLOC
+        (sizeof(p_switch_group) * num_clauses);
+    group_of = (unsigned int *)GC_MALLOC_ATOMIC
+        (sizeof(unsigned int) * num_clauses);
+    buckets = (unsigned int *)GC_MALLOC_ATOMIC
+        (sizeof(unsigned int) * size);
+    if (!groups || !group_of || !buckets)
+        return 0;
+    memset(buckets, 0, sizeof(unsigned int) * size);
+    for (index = 0; index < num_clauses; ++index) {
+        if (!_p_term_clause_key(&key, all[index], arg, 0)) {
+            group_of[index] = P_SWITCH_VAR_CLAUSE;
+            ++num_vars;
+            continue;
+        }
+        hash = _p_rbkey_hash(&key);
+        posn = hash & (size - 1);
+        while ((group = buckets[posn]) != 0) {
+            if (groups[group - 1].hash == hash &&
+                    _p_rbkey_equal_keys(&(groups[group - 1].key), &key))
+                break;
+            posn = (posn + 1) & (size - 1);
+        }
+        if (!group) {
+            group = ++num_groups;
+            buckets[posn] = group;
+            groups[group - 1].key = key;
+            groups[group - 1].hash = hash;
+        }
+        group_of[index] = group - 1;
+        ++(groups[group - 1].count);
+    }
+    GC_FREE(buckets);
+
+    /* If every clause has a variable argument, then try them all */
+    if (!num_groups) {
+        GC_FREE(groups);
+        GC_FREE(group_of);
+        return all_label;
+    }
+
+    /* Build the clause lists for the groups, with the variable
+     * clauses merged into each group in their original order */
+    vars = (struct p_term_clause **)GC_MALLOC
+        (sizeof(struct p_term_clause *) * (num_vars + 1));
+    if (!vars)
+        return 0;
+    for (group = 0; group < num_groups; ++group) {
+        groups[group].clauses = (struct p_term_clause **)GC_MALLOC
+            (sizeof(struct p_term_clause *) *
+                (groups[group].count + num_vars + 1));
+        if (!(groups[group].clauses))
+            return 0;
+        groups[group].count = 0;
+    }
+    num_vars = 0;
+    for (index = 0; index < num_clauses; ++index) {
+        group = group_of[index];
+        if (group == P_SWITCH_VAR_CLAUSE) {
+            vars[num_vars++] = all[index];
+            for (group = 0; group < num_groups; ++group) {
+                groups[group].clauses[(groups[group].count)++] =
+                    all[index];
+            }
+        } else {
+            groups[group].clauses[(groups[group].count)++] = all[index];
+        }
+    }
+    var_label = p_switch_new_try(vars, num_vars);
+    if (num_vars && !var_label)
+        return 0;
+
+    /* Create the "try_clauses" instructions for the groups and
+     * divide them up into constants, lists, and structures */
+    labels = (p_inst **)GC_MALLOC(sizeof(p_inst *) * num_groups);
+    constants = (unsigned int *)GC_MALLOC_ATOMIC
+        (sizeof(unsigned int) * num_groups);
+    structures = (unsigned int *)GC_MALLOC_ATOMIC
+        (sizeof(unsigned int) * num_groups);
+    if (!labels || !constants || !structures)
+        return 0;
+    list_label = var_label;
+    for (group = 0; group < num_groups; ++group) {
+        if (groups[group].count == num_clauses) {
+            labels[group] = all_label;
+        } else {
+            labels[group] = p_switch_new_try
+                (groups[group].clauses, groups[group].count);
+            if (!labels[group])
+                return 0;
+        }
+        switch (groups[group].key.type) {
+        case P_TERM_LIST:
+            list_label = labels[group];
+            break;
+        case P_TERM_FUNCTOR:
+            structures[num_structures++] = group;
+            break;
+        default:
+            constants[num_constants++] = group;
+            break;
+        }
+    }
+
+    /* Create the top-level "switch_on_term" instruction */
+    inst = GC_NEW(struct p_inst_switch_on_term);
+    if (!inst)
+        return 0;
+    inst->opcode = P_OP_SWITCH_ON_TERM;
+    inst->reg1 = arg;
+    inst->var_label = all_label;
+    inst->list_label = list_label;
+    inst->constant_label = var_label;
+    inst->structure_label = var_label;
+    if (num_constants > 0) {
+        inst->constant_label = p_switch_new_table
+            (P_OP_SWITCH_ON_CONSTANT, arg, groups, constants,
+             labels, num_constants, var_label);
+        if (!(inst->constant_label))
+            return 0;
+    }
+    if (num_structures > 0) {
+        inst->structure_label = p_switch_new_table
+            (P_OP_SWITCH_ON_STRUCTURE, arg, groups, structures,
+             labels, num_structures, var_label);
+        if (!(inst->structure_label))
+            return 0;
+    }
+
+    /* Clean up and exit */
+    GC_FREE(structures);
+    GC_FREE(constants);
+    GC_FREE(labels);
+    GC_FREE(group_of);
+    GC_FREE(groups);
+    return (p_inst *)inst;
+}
+
 /** @endcond */
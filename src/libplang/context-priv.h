@@ -30,7 +30,11 @@ extern "C" {
 
 /** @cond */
 
-#define P_CONTEXT_HASH_SIZE     511
+/* Initial number of buckets in the atom table, which must be a power
+ * of two.  The table doubles in size whenever the number of atoms
+ * exceeds the number of buckets.  Atoms that have been reclaimed by
+ * the garbage collector are removed from the count as they are found */
+#define P_CONTEXT_HASH_SIZE     512
 
 /* Internal result code that indicates that a builtin predicate
  * has modified the search tree */
@@ -39,7 +43,11 @@ extern "C" {
 /* Internal result code for dynamic clause body returns */
 #define P_RESULT_RETURN_BODY    ((p_goal_result)(P_RESULT_HALT + 6))
 
-typedef struct p_trail p_trail;
+/* Internal result code for compiled clause bodies that call a
+ * subgoal and then continue with the rest of the clause */
+#define P_RESULT_CALL_BODY      ((p_goal_result)(P_RESULT_HALT + 7))
+
+typedef struct p_exec_stack p_exec_stack;
 
 struct p_path_list
 {
@@ -54,6 +62,7 @@ typedef struct p_exec_clause_node p_exec_clause_node;
 typedef struct p_exec_catch_node p_exec_catch_node;
 typedef struct p_exec_pop_catch_node p_exec_pop_catch_node;
 typedef struct p_exec_pop_database_node p_exec_pop_database_node;
+typedef struct p_exec_code_node p_exec_code_node;
 typedef void (*p_exec_fail_func)
     (p_context *context, p_exec_fail_node *node);
 
@@ -68,6 +77,9 @@ struct p_exec_fail_node
 {
     p_exec_node parent;
     void *fail_marker;
+    void *node_marker;
+    unsigned int var_age;
+    unsigned int trail_age;
     double confidence;
     p_exec_catch_node *catch_node;
     p_term *database;
@@ -92,11 +104,31 @@ struct p_exec_pop_database_node
     p_exec_node parent;
     p_term *database;
 };
+struct p_exec_code_node
+{
+    p_exec_node parent;
+    const struct p_code_clause *clause;
+    const union p_inst *pc;
+    p_term **yregs;
+};
+
+/* Entry on the explicit work stack for iterative term traversals */
+typedef struct p_term_work p_term_work;
+struct p_term_work
+{
+    p_term *term1;
+    p_term *term2;
+    unsigned int index;
+};
+
+struct p_call_cache;
+struct p_term_atom_link;
 
 typedef void (*p_library_entry_func)(p_context *context);
 typedef struct p_library p_library;
 struct p_library
 {
+    p_term *name;
     void *handle;
     p_library_entry_func shutdown_func;
     p_library *next;
@@ -123,13 +155,27 @@ struct p_context
     p_term *unify_atom;
     p_term *pop_catch_atom;
     p_term *pop_database_atom;
-    p_term *atom_hash[P_CONTEXT_HASH_SIZE];
-
-    p_trail *trail;
-    int trail_top;
+    p_term *resume_atom;
+    p_term *tabled_call_atom;
+    struct p_term_atom_link **atom_hash;
+    size_t atom_hash_size;
+    size_t atom_count;
+
+    void ***trail;
+    size_t trail_top;
+    size_t trail_max;
+    unsigned int var_age;
+    unsigned int trail_age;
+
+    p_exec_stack *exec_stack;
+    p_exec_stack *exec_spare;
+    size_t exec_top;
 
     int fail_on_unknown : 1;
     int debug : 1;
+    int no_occurs_check : 1;
+    int eager_compile : 1;
+    int consult_cache : 1;
 
     int goal_active;
     void *goal_marker;
@@ -139,6 +185,7 @@ struct p_context
     void *fail_marker;
     double confidence;
     p_term *database;
+    struct p_call_cache *call_cache;
 
     int allow_test_goals;
     p_term *test_goal;
@@ -157,18 +204,58 @@ struct p_context
 
     p_term **xregs;
     int num_xregs;
+
+    p_term_work *term_work;
+    size_t term_work_top;
+    size_t term_work_max;
+
+    p_term **findall_terms;
+    size_t findall_top;
+    size_t findall_max;
+
+    struct p_table **tables;
+    size_t num_tables;
+    size_t max_tables;
+    struct p_table **table_stack;
+    size_t table_top;
+    size_t table_max;
+    struct p_table **table_incomplete;
+    size_t num_incomplete;
+    size_t max_incomplete;
+    unsigned int table_iteration;
+    int table_changed;
+    struct p_rbtree *table_fixed;
+    struct p_rbtree *table_copies;
 };
 
-#define P_TRACE_SIZE 1020
+#define P_EXEC_STACK_SIZE   (64 * 1024)
+#define P_EXEC_STACK_WORDS  (P_EXEC_STACK_SIZE / sizeof(double))
 
-struct p_trail
+struct p_exec_stack
 {
-    void **bindings[P_TRACE_SIZE];
-    p_trail *next;
+    p_exec_stack *prev;
+    size_t used;
+    double data[P_EXEC_STACK_WORDS];
 };
 
+void *_p_context_alloc_node(p_context *context, size_t size);
+void *_p_context_mark_nodes(p_context *context);
+void _p_context_pop_nodes(p_context *context, void *marker);
+
+#define p_exec_new(context,type)    \
+    ((type *)_p_context_alloc_node((context), sizeof(type)))
+
 int _p_context_record_in_trail(p_context *context, p_term *var);
 int _p_context_record_contents_in_trail(p_context *context, void **location, void *prev_value);
+void _p_context_new_var_age(p_context *context);
+void _p_context_prune_trail(p_context *context, void *marker);
+
+/* Marks the current position in the trail without starting a new
+ * variable age.  This can only be used when a choice point will be
+ * created before any bindings are made, or when the caller will
+ * backtrack on failure anyway */
+#define _p_context_trail_marker(context)    \
+    ((void *)((context)->trail_top))
 
 void _p_context_basic_fail_func
     (p_context *context, p_exec_fail_node *node);
@@ -177,6 +264,10 @@ void _p_context_clause_fail_func
 void _p_context_init_fail_node
     (p_context *context, p_exec_fail_node *node,
      p_exec_fail_func fail_func);
+p_goal_result _p_context_call_clauses
+    (p_context *context, p_term *goal, p_term_clause_iter *clause_iter);
+p_goal_result _p_context_resume_clause
+    (p_context *context, p_exec_code_node *node, p_term **error);
 
 p_goal_result p_goal_call_from_parser(p_context *context, p_term *goal);
 
@@ -23,6 +23,7 @@
 #include "term-priv.h"
 #include "database-priv.h"
 #include "parser-priv.h"
+#include "inst-priv.h"
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
@@ -71,14 +72,17 @@ p_context *p_context_create(void)
     context->unify_atom = p_term_create_atom(context, "=");
     context->pop_catch_atom = p_term_create_atom(context, "$$pop_catch");
     context->pop_database_atom = p_term_create_atom(context, "$$pop_database");
-    context->trail_top = P_TRACE_SIZE;
+    context->resume_atom = p_term_create_atom(context, "$$resume");
+    context->tabled_call_atom = p_term_create_atom(context, "$$tabled_call");
     context->confidence = 1.0;
     _p_db_init(context);
     _p_db_init_builtins(context);
     _p_db_init_arith(context);
     _p_db_init_io(context);
+    _p_db_init_findall(context);
     _p_db_init_fuzzy(context);
     _p_db_init_sort(context);
+    _p_db_init_table(context);
     p_context_find_system_imports(context);
     return context;
 }
@@ -99,63 +103,108 @@ void p_context_free(p_context *context)
     GC_FREE(context);
 }
 
+/* Grow the trail to make room for more words.  The trail is a
+ * single array that is reallocated as necessary.  It is never
+ * shrunk, so that a program that repeatedly creates and discards
+ * bindings does not thrash the allocator */
+static int p_context_grow_trail(p_context *context)
+{
+    size_t max = context->trail_max * 2;
+    void ***trail;
+    if (max < 1024)
+        max = 1024;
+    trail = (void ***)GC_REALLOC(context->trail, max * sizeof(void **));
+    if (!trail)
+        return 0;
+    context->trail = trail;
+    context->trail_max = max;
+    return 1;
+}
+
 /* Push a word onto the trail */
 P_INLINE int p_context_push_trail(p_context *context, void **word)
 {
-    if (context->trail_top >= P_TRACE_SIZE) {
-        struct p_trail *trail = GC_NEW(struct p_trail);
-        if (!trail)
+    if (context->trail_top >= context->trail_max) {
+        if (!p_context_grow_trail(context))
             return 0;
-        trail->next = context->trail;
-        context->trail = trail;
-        context->trail_top = 0;
     }
-    context->trail->bindings[(context->trail_top)++] = word;
+    context->trail[(context->trail_top)++] = word;
     return 1;
 }
 
-/* Pop a word from the trail */
+/* Pop a word from the trail.  Markers are trail positions */
 P_INLINE void **p_context_pop_trail(p_context *context, void *marker)
 {
     void **word;
-    void ***wordp;
 
     /* Have we reached the marker? */
-    if (!context->trail)
-        return 0;
-    wordp = &(context->trail->bindings[context->trail_top]);
-    if (wordp == (void ***)marker)
+    if (context->trail_top <= (size_t)marker)
         return 0;
 
     /* Pop the word and zero it out so that the garbage collector
      * will forget the reference to the popped word */
-    --(context->trail_top);
-    word = *(--wordp);
-    *wordp = 0;
-
-    /* Free the trail block if it is now empty */
-    if (context->trail_top <= 0) {
-        struct p_trail *trail = context->trail;
-        context->trail = trail->next;
-        context->trail_top = P_TRACE_SIZE;
-        GC_FREE(trail);
-    }
+    word = context->trail[--(context->trail_top)];
+    context->trail[context->trail_top] = 0;
     return word;
 }
 
+/* Starts a new variable age for a choice point.  Bindings of
+ * variables that were created before this point will be recorded
+ * in the trail, but those created afterwards will not.  If the
+ * ages run out, then every binding is recorded from then on */
+void _p_context_new_var_age(p_context *context)
+{
+    if (context->var_age < P_TERM_VAR_MAX_AGE)
+        context->trail_age = ++(context->var_age);
+    else
+        context->trail_age = P_TERM_VAR_MAX_AGE + 1;
+}
+
+/* Removes the bindings above "marker" from the trail that belong
+ * to variables which are younger than the most recent choice point.
+ * This is used after a unification that recorded every binding in
+ * case it had to be backed out, but which then succeeded */
+void _p_context_prune_trail(p_context *context, void *marker)
+{
+    size_t from = (size_t)marker;
+    size_t to = from;
+    size_t top = context->trail_top;
+    void **word;
+    p_term *var;
+    while (from < top) {
+        word = context->trail[from];
+        if ((from + 1) < top && (((long)(context->trail[from + 1])) & 1L)) {
+            /* Previous value and location for an assignment */
+            context->trail[to++] = word;
+            context->trail[to++] = context->trail[from + 1];
+            from += 2;
+            continue;
+        }
+        var = (p_term *)(((char *)word) - offsetof(struct p_term_var, value));
+        if (var->header.type != P_TERM_VARIABLE ||
+                p_term_var_age(var) < context->trail_age)
+            context->trail[to++] = word;
+        ++from;
+    }
+    while (top > to)
+        context->trail[--top] = 0;
+    context->trail_top = to;
+}
+
 /**
  * \brief Marks the current position in the backtrack trail
  * in \a context and returns a marker pointer.
  *
+ * All variables that exist when the marker is created will have
+ * their bindings recorded until \a context backtracks past it.
+ *
  * \ingroup context
  * \sa p_context_backtrack_trail()
  */
 void *p_context_mark_trail(p_context *context)
 {
-    if (context->trail)
-        return (void *)&(context->trail->bindings[context->trail_top]);
-    else
-        return 0;
+    _p_context_new_var_age(context);
+    return _p_context_trail_marker(context);
 }
 
 /**
@@ -198,6 +247,141 @@ int _p_context_record_contents_in_trail(p_context *context, void **location, voi
 }
 
 /* Imports from the flex-generated lexer and bison-generated parser */
+/* The execution nodes that make up the search tree are allocated
+ * from a control stack of fixed-size segments rather than from the
+ * garbage-collected heap.  Nodes that were allocated after a choice
+ * point are popped when the choice point is retried, and nodes that
+ * were allocated for a deterministic sub-goal are popped when the
+ * sub-goal succeeds.  Popped regions are zeroed so that the garbage
+ * collector does not see stale references in the unused part of
+ * the stack.  Only the most recent empty segment is kept for re-use */
+
+/* Allocates a new execution node on the control stack */
+void *_p_context_alloc_node(p_context *context, size_t size)
+{
+    p_exec_stack *stack = context->exec_stack;
+    size_t words = (size + sizeof(double) - 1) / sizeof(double);
+    void *node;
+    if (!stack || (context->exec_top + words) > P_EXEC_STACK_WORDS) {
+        p_exec_stack *next = context->exec_spare;
+        if (next) {
+            context->exec_spare = 0;
+        } else {
+            next = GC_NEW(p_exec_stack);
+            if (!next)
+                return 0;
+        }
+        if (stack)
+            stack->used = context->exec_top;
+        next->prev = stack;
+        context->exec_stack = next;
+        context->exec_top = 0;
+        stack = next;
+    }
+    node = (void *)(stack->data + context->exec_top);
+    context->exec_top += words;
+    return node;
+}
+
+/* Marks the current top of the control stack */
+void *_p_context_mark_nodes(p_context *context)
+{
+    if (context->exec_stack)
+        return (void *)(context->exec_stack->data + context->exec_top);
+    else
+        return 0;
+}
+
+/* Pops all execution nodes that were allocated after "marker" */
+void _p_context_pop_nodes(p_context *context, void *marker)
+{
+    p_exec_stack *stack = context->exec_stack;
+    double *mark = (double *)marker;
+    size_t top;
+    while (stack && (mark < stack->data ||
+                     mark > (stack->data + P_EXEC_STACK_WORDS))) {
+        p_exec_stack *prev = stack->prev;
+        memset(stack->data, 0, context->exec_top * sizeof(double));
+        if (context->exec_spare) {
+            GC_FREE(stack);
+        } else {
+            stack->prev = 0;
+            context->exec_spare = stack;
+        }
+        stack = prev;
+        context->exec_stack = stack;
+        context->exec_top = stack ? stack->used : 0;
+    }
+    if (!stack)
+        return;
+    top = (size_t)(mark - stack->data);
+    if (top < context->exec_top) {
+        memset(mark, 0, (context->exec_top - top) * sizeof(double));
+        context->exec_top = top;
+    }
+}
+
+/* Size of the largest execution node, rounded up to the stack's
+ * allocation granularity.  This is used to find a safe point to
+ * trim the stack back to when the size of a node is not known */
+#define P_EXEC_NODE_MAX \
+    (((sizeof(p_exec_clause_node) > sizeof(p_exec_catch_node) ? \
+       sizeof(p_exec_clause_node) : sizeof(p_exec_catch_node)) + \
+      sizeof(double) - 1) / sizeof(double))
+
+/* Determine if "node" is more recent on the control stack than
+ * the current fail point and catch point, which means that "node"
+ * and everything above it can be discarded once the search tree
+ * no longer refers to them.  Returns the stack segment containing
+ * "node", or null if the nodes cannot be discarded */
+static p_exec_stack *p_context_is_newest(p_context *context, p_exec_node *node)
+{
+    p_exec_stack *stack = context->exec_stack;
+    double *mark = (double *)node;
+    double *fail = (double *)(context->fail_node);
+    double *catcher = (double *)(context->catch_node);
+    double *end;
+    while (stack) {
+        end = stack->data + P_EXEC_STACK_WORDS;
+        if (mark >= stack->data && mark < end) {
+            if ((fail >= mark && fail < end) ||
+                    (catcher >= mark && catcher < end))
+                return 0;
+            return stack;
+        }
+        if ((fail >= stack->data && fail < end) ||
+                (catcher >= stack->data && catcher < end))
+            return 0;
+        stack = stack->prev;
+    }
+    return 0;
+}
+
+/* Pops the nodes above "node" after a deterministic success.
+ * Nothing is popped if there is a choice point or catch block
+ * that is newer than "node" as such nodes may still be needed */
+static void p_context_trim_nodes(p_context *context, p_exec_node *node)
+{
+    p_exec_stack *stack = p_context_is_newest(context, node);
+    double *mark;
+    if (stack) {
+        mark = ((double *)node) + P_EXEC_NODE_MAX;
+        if (mark > (stack->data + P_EXEC_STACK_WORDS))
+            mark = stack->data + P_EXEC_STACK_WORDS;
+        _p_context_pop_nodes(context, mark);
+    }
+}
+
+/* Pops "node" itself and everything above it once the caller has
+ * finished reading the contents of "node".  This implements last
+ * call optimization: the nodes for the next goal reuse the space
+ * of the goal or continuation that is being replaced */
+static void p_context_pop_current(p_context *context, p_exec_node *node)
+{
+    if (p_context_is_newest(context, node))
+        _p_context_pop_nodes(context, node);
+}
+
 int p_term_lex_init_extra(p_input_stream *extra, yyscan_t *scanner);
 int p_term_lex_destroy(yyscan_t scanner);
 int p_term_parse(p_context *context, yyscan_t scanner);
@@ -252,7 +436,15 @@ int p_context_consult(p_context *context, p_input_stream *stream)
         fclose(stream->stream);
     p_term_lex_destroy(scanner);
 
-    /* Process the declarations from the file */
+    return _p_context_consult_declarations(context, stream, ok);
+}
+
+/* Processes the declarations that were parsed from "stream" by
+ * asserting clauses and running goals.  If "ok" is zero, then
+ * there were errors and the declarations are ignored */
+int _p_context_consult_declarations
+    (p_context *context, p_input_stream *stream, int ok)
+{
     if (ok && stream->declarations) {
         p_term *list = stream->declarations;
         p_term *clause_atom = context->clause_atom;
@@ -269,7 +461,7 @@ int p_context_consult(p_context *context, p_input_stream *stream)
             if (decl && decl->header.type == P_TERM_FUNCTOR) {
                 if (decl->functor.functor_name == clause_atom) {
                     /* TODO: error reporting */
-                    p_db_clause_assert_last(context, decl);
+                    _p_db_clause_consult(context, decl);
                 } else if (decl->functor.functor_name == goal_atom) {
                     /* Execute the initialization goal */
                     if (p_goal_call_from_parser
@@ -305,6 +497,43 @@ static int p_stdio_read_func
     return (int)result;
 }
 
+int p_string_read_func(p_input_stream *stream, char *buf, size_t max_size);
+
+/* Consults a source file using its cache file if it is up to date,
+ * or parses the source and writes a new cache file otherwise */
+static int p_context_consult_cached
+    (p_context *context, p_input_stream *stream)
+{
+    char *source = 0;
+    size_t source_len = 0;
+    int error = _p_context_load_cache
+        (context, stream, &source, &source_len);
+    if (error >= 0) {
+        fclose(stream->stream);
+        free(source);
+        return error;
+    }
+    if (!source) {
+        /* Could not read the source into memory, so parse it
+         * directly from the file without writing a cache */
+        rewind(stream->stream);
+        return p_context_consult(context, stream);
+    }
+
+    /* Parse the source text that was already read to check the cache */
+    fclose(stream->stream);
+    stream->stream = 0;
+    stream->close_stream = 0;
+    stream->buffer = source;
+    stream->buffer_len = source_len;
+    stream->read_func = p_string_read_func;
+    error = p_context_consult(context, stream);
+    if (!error)
+        _p_context_save_cache(context, stream, source, source_len);
+    free(source);
+    return error;
+}
+
 /**
  * \enum p_consult_option
  * \ingroup context
@@ -343,8 +572,13 @@ static int p_stdio_read_func
  * loaded into \a context previously, then this function does
  * nothing and returns zero.
  *
+ * If the consult cache has been enabled with
+ * p_context_set_consult_cache(), then the declarations in
+ * \a filename are loaded from its cache file if it is up to date.
+ *
  * \ingroup context
  * \sa p_context_consult_string(), p_context_add_import_path()
+ * \sa p_context_set_consult_cache()
  */
 int p_context_consult_file
     (p_context *context, const char *filename, p_consult_option option)
@@ -371,6 +605,8 @@ int p_context_consult_file
         stream.filename = filename;
         stream.close_stream = 1;
         p_context_add_path(context->loaded_files, filename);
+        if (context->consult_cache && !context->debug)
+            return p_context_consult_cached(context, &stream);
     }
     return p_context_consult(context, &stream);
 }
@@ -459,71 +695,229 @@ void _p_context_basic_fail_func
 {
     p_context_backtrack_trail(context, node->fail_marker);
     context->confidence = node->confidence;
+
+    /* Variables that were created after the choice point are
+     * now unreachable, so their ages can be handed out again.
+     * Terms that outlive back-tracking, such as the solutions
+     * collected by findall/3, use the oldest age instead */
+    context->var_age = node->var_age;
+    context->trail_age = node->trail_age;
     context->catch_node = node->catch_node;
     context->database = node->database;
 }
 
+/* Schedules the goal returned from a compiled clause for execution.
+ * If the clause will continue after the goal succeeds, then "cont"
+ * is linked in as the success continuation of the goal */
+static int p_context_schedule_body
+    (p_context *context, p_goal_result result, p_term *body,
+     p_exec_code_node *cont, p_exec_node *success_node,
+     p_exec_fail_node *cut_node)
+{
+    p_exec_node *new_current;
+    if (result == P_RESULT_CALL_BODY) {
+        cont->parent.success_node = success_node;
+        cont->parent.cut_node = cut_node;
+        success_node = &(cont->parent);
+    } else if (result != P_RESULT_RETURN_BODY) {
+        body = context->true_atom;
+    }
+    new_current = p_exec_new(context, p_exec_node);
+    if (!new_current)
+        return 0;
+    new_current->goal = body;
+    new_current->success_node = success_node;
+    new_current->cut_node = cut_node;
+    context->current_node = new_current;
+    return 1;
+}
+
+/* Runs the compiled code for "clause" against the arguments of
+ * "goal".  If the head matches, then the first goal of the body
+ * is scheduled with "success_node" and "cut_node" as its
+ * continuation.  Returns zero if the head does not match */
+static int p_context_enter_clause
+    (p_context *context, p_term *goal, p_term *clause,
+     p_exec_node *success_node, p_exec_fail_node *cut_node)
+{
+    void *marker = _p_context_trail_marker(context);
+    p_exec_code_node *cont = 0;
+    p_term *body = 0;
+    p_goal_result result;
+    unsigned int index;
+
+    /* Ground facts are matched directly against the goal */
+    if (p_term_clause_is_fact(&(clause->clause))) {
+        if (!_p_term_unify_fact(context, goal, &(clause->clause))) {
+            p_context_backtrack_trail(context, marker);
+            return 0;
+        }
+        return p_context_schedule_body
+            (context, P_RESULT_TRUE, 0, 0, success_node, cut_node);
+    }
+
+    /* The clause may have been consulted into the predicate after
+     * the call started, in which case it won't be compiled yet */
+    if (p_term_clause_is_lazy(&(clause->clause)))
+        _p_term_compile_lazy_clause(context, &(clause->clause));
+
+    /* Copy the arguments of the goal into X registers */
+    if (goal->header.type == P_TERM_FUNCTOR) {
+        for (index = 0; index < goal->header.size; ++index) {
+            _p_code_set_xreg
+                (context, (int)index, goal->functor.arg[index]);
+        }
+    }
+
+    /* Match the head and run the body up until the first call.
+     * If the head does not match, then back out any bindings
+     * that were made before the mismatch was detected */
+    result = _p_code_resume
+        (context, &(clause->clause.exec_code), 0, 0, &body, &cont);
+    if (result == P_RESULT_FAIL || result == P_RESULT_ERROR) {
+        p_context_backtrack_trail(context, marker);
+        return 0;
+    }
+    return p_context_schedule_body
+        (context, result, body, cont, success_node, cut_node);
+}
+
 /* Fail handling function for going to the next clause of a
  * dynamic predicate */
 void _p_context_clause_fail_func
     (p_context *context, p_exec_fail_node *node)
 {
     p_exec_clause_node *current = (p_exec_clause_node *)node;
+    p_exec_node *success_node = current->parent.parent.success_node;
+    p_exec_fail_node *cut_node = current->parent.parent.cut_node;
+    p_term *goal = current->parent.parent.goal;
     p_term_clause_iter clause_iter;
     p_term *clause;
-    p_term *body;
     p_exec_node *new_current;
 
-    /* Perform the basic backtracking logic */
+    /* Perform the basic backtracking logic, and then start a
+     * new variable age for the choice point as it is re-used */
     _p_context_basic_fail_func(context, node);
+    _p_context_new_var_age(context);
 
     /* We have backtracked into a new clause of a predicate.
      * See if the clause, or one of the following clauses
-     * matches the current goal.  If no match, then fail */
+     * matches the current goal.  If no match, then fail.
+     * The choice point node is re-used for the remaining
+     * clauses, or discarded when the last clause is reached */
     clause_iter = current->clause_iter;
-    body = 0;
     while ((clause = p_term_clauses_next(&clause_iter)) != 0) {
-        body = p_term_unify_clause
-            (context, current->parent.parent.goal, clause);
-        if (body)
-            break;
-    }
-    if (body) {
+        if (!p_term_clauses_has_more(&clause_iter)) {
+            context->var_age = current->parent.var_age;
+            context->trail_age = current->parent.trail_age;
+            p_context_pop_current(context, &(current->parent.parent));
+        }
+        if (!p_context_enter_clause
+                (context, goal, clause, success_node, cut_node))
+            continue;
         if (p_term_clauses_has_more(&clause_iter)) {
-            p_exec_clause_node *next = GC_NEW(p_exec_clause_node);
-            if (next) {
-                next->parent.parent.goal = current->parent.parent.goal;
-                next->parent.parent.success_node = current->parent.parent.success_node;
-                next->parent.parent.cut_node = current->parent.parent.cut_node;
-                _p_context_init_fail_node
-                    (context, &(next->parent), _p_context_clause_fail_func);
-                next->parent.fail_marker = current->parent.fail_marker;
-                next->clause_iter = clause_iter;
-                context->fail_node = &(next->parent);
-            } else {
-                body = context->fail_atom;
-            }
+            current->clause_iter = clause_iter;
+            context->fail_node = &(current->parent);
         }
-    } else {
-        body = context->fail_atom;
+        return;
     }
-    new_current = GC_NEW(p_exec_node);
+    new_current = p_exec_new(context, p_exec_node);
     if (new_current) {
-        new_current->goal = body;
-        new_current->success_node = current->parent.parent.success_node;
-        new_current->cut_node = current->parent.parent.cut_node;
+        new_current->goal = context->fail_atom;
+        new_current->success_node = success_node;
+        new_current->cut_node = cut_node;
         context->current_node = new_current;
     } else {
         current->parent.parent.goal = context->fail_atom;
     }
 }
 
+/* Calls "goal" by searching "clause_iter" for the first clause
+ * whose head matches.  A choice point is pushed to try the
+ * remaining clauses on backtracking.  The choice point is
+ * allocated before the clause is entered so that it sits
+ * below the nodes for the clause body on the control stack.
+ * The node for the goal itself is discarded first if nothing
+ * else refers to it, so that tail calls run in constant space */
+p_goal_result _p_context_call_clauses
+    (p_context *context, p_term *goal, p_term_clause_iter *clause_iter)
+{
+    p_exec_node *success_node = context->current_node->success_node;
+    p_exec_fail_node *cut_node = context->fail_node;
+    p_exec_clause_node *next = 0;
+    p_term *clause;
+    p_context_pop_current(context, context->current_node);
+    while ((clause = p_term_clauses_next(clause_iter)) != 0) {
+        if (p_term_clauses_has_more(clause_iter)) {
+            if (!next) {
+                next = p_exec_new(context, p_exec_clause_node);
+                if (!next)
+                    return P_RESULT_FAIL;
+                next->parent.parent.goal = goal;
+                next->parent.parent.success_node = success_node;
+                next->parent.parent.cut_node = cut_node;
+                _p_context_init_fail_node
+                    (context, &(next->parent),
+                     _p_context_clause_fail_func);
+            }
+        } else if (next) {
+            /* Last clause, so the choice point is not needed.
+             * Bindings no longer need to be trailed for it either,
+             * and the variables created since it are unreachable */
+            context->var_age = next->parent.var_age;
+            context->trail_age = next->parent.trail_age;
+            _p_context_pop_nodes(context, next);
+            next = 0;
+        }
+        if (!p_context_enter_clause
+                (context, goal, clause, success_node, cut_node))
+            continue;
+        if (next) {
+            next->clause_iter = *clause_iter;
+            context->fail_node = &(next->parent);
+        }
+        return P_RESULT_TREE_CHANGE;
+    }
+    return P_RESULT_FAIL;
+}
+
+/* Resumes execution of a compiled clause body after one of
+ * its goals has succeeded */
+p_goal_result _p_context_resume_clause
+    (p_context *context, p_exec_code_node *node, p_term **error)
+{
+    const p_code_clause *clause = node->clause;
+    const p_inst *pc = node->pc;
+    p_term **yregs = node->yregs;
+    p_exec_node *success_node = node->parent.success_node;
+    p_exec_fail_node *cut_node = node->parent.cut_node;
+    p_exec_code_node *cont = 0;
+    p_term *body = 0;
+    p_goal_result result;
+    p_context_pop_current(context, &(node->parent));
+    result = _p_code_resume
+        (context, clause, pc, yregs, &body, &cont);
+    if (result == P_RESULT_CALL_BODY || result == P_RESULT_RETURN_BODY) {
+        if (!p_context_schedule_body
+                (context, result, body, cont, success_node, cut_node))
+            return P_RESULT_FAIL;
+        return P_RESULT_TREE_CHANGE;
+    } else if (result == P_RESULT_ERROR) {
+        *error = body;
+    }
+    return result;
+}
+
 void _p_context_init_fail_node
     (p_context *context, p_exec_fail_node *node,
      p_exec_fail_func fail_func)
 {
     node->parent.fail_func = fail_func;
     node->fail_marker = context->fail_marker;
+    node->var_age = context->var_age;
+    node->trail_age = context->trail_age;
+    _p_context_new_var_age(context);
+    node->node_marker = _p_context_mark_nodes(context);
     node->confidence = context->confidence;
     node->catch_node = context->catch_node;
     node->database = context->database;
@@ -542,6 +936,12 @@ static p_goal_result p_goal_execute_inner(p_context *context, p_term *goal, p_te
     p_exec_node *next;
     p_exec_node *new_current;
     p_term *predicate;
+    p_call_cache *cache;
+
+    /* Fetch the call site cache for this goal, if any.  The cache
+     * is only valid for the goal immediately following the call */
+    cache = context->call_cache;
+    context->call_cache = 0;
 
     /* Bail out if the goal is a variable.  It is assumed that
      * the goal has already been dereferenced by the caller */
@@ -561,8 +961,8 @@ static p_goal_result p_goal_execute_inner(p_context *context, p_term *goal, p_te
              * right-recursive.  Create two new nodes for the
              * left and right parts of the comma term */
             current = context->current_node;
-            next = GC_NEW(p_exec_node);
-            new_current = GC_NEW(p_exec_node);
+            next = p_exec_new(context, p_exec_node);
+            new_current = p_exec_new(context, p_exec_node);
             if (!next || !new_current)
                 return P_RESULT_FAIL;
             new_current->goal = goal->functor.arg[0];
@@ -582,10 +982,41 @@ static p_goal_result p_goal_execute_inner(p_context *context, p_term *goal, p_te
         return P_RESULT_ERROR;
     }
 
+    /* Resolve the name and arity using the call site cache if it
+     * is still valid, or by searching the databases otherwise */
+    if (cache && cache->name == name && cache->arity == arity &&
+            cache->database == context->database &&
+            cache->generation == _p_db_generation) {
+        info = cache->info;
+        predicate = cache->local_predicate;
+    } else {
+        info = name->atom.db_info;
+        while (info && info->arity != arity)
+            info = info->next;
+        predicate = 0;
+        if (context->database && (!info || !info->builtin_func)) {
+            predicate = p_term_database_lookup_predicate
+                (context->database, name, arity);
+        }
+        if (cache) {
+            cache->name = name;
+            cache->arity = arity;
+            cache->generation = _p_db_generation;
+            cache->info = info;
+            cache->database = context->database;
+            cache->local_predicate = predicate;
+        }
+    }
+
+    /* Calls to tabled predicates are evaluated via their tables */
+    if (info && (info->flags & P_PREDICATE_TABLED) != 0 && !predicate) {
+        pred = p_term_create_functor(context, context->tabled_call_atom, 1);
+        p_term_bind_functor_arg(pred, 0, goal);
+        context->current_node->goal = pred;
+        return P_RESULT_TREE_CHANGE;
+    }
+
     /* Find a builtin to handle the functor */
-    info = name->atom.db_info;
-    while (info && info->arity != arity)
-        info = info->next;
     if (info && (builtin = info->builtin_func) != 0) {
         if (arity != 0)
             return (*builtin)(context, goal->functor.arg, error);
@@ -594,54 +1025,21 @@ static p_goal_result p_goal_execute_inner(p_context *context, p_term *goal, p_te
     }
 
     /* Look for a user-defined predicate in the local or global db */
-    predicate = info ? info->predicate : 0;
-    if (context->database) {
-        p_term *pred = p_term_database_lookup_predicate
-            (context->database, name, arity);
-        if (pred)
-            predicate = pred;
+    if (!predicate && info) {
+        predicate = info->predicate;
+
+        /* Tables that are being evaluated depend upon the predicate */
+        if (context->table_top > 0)
+            _p_table_record_read(context, info);
     }
 
     /* Use a user-defined predicate to handle the functor */
     if (predicate) {
         p_term_clause_iter clause_iter;
+        if (predicate->predicate.lazy_clauses)
+            _p_term_compile_clauses(context, predicate);
         p_term_clauses_begin(predicate, goal, &clause_iter);
-        p_term *clause;
-        p_term *body;
-        while ((clause = p_term_clauses_next(&clause_iter)) != 0) {
-            /* Find the first clause whose head unifies with the goal */
-            body = p_term_unify_clause(context, goal, clause);
-            if (body) {
-                current = context->current_node;
-                if (p_term_clauses_has_more(&clause_iter)) {
-                    p_exec_clause_node *next = GC_NEW(p_exec_clause_node);
-                    new_current = GC_NEW(p_exec_node);
-                    if (!next || !new_current)
-                        return P_RESULT_FAIL;
-                    next->parent.parent.goal = current->goal;
-                    next->parent.parent.success_node = current->success_node;
-                    next->parent.parent.cut_node = context->fail_node;
-                    _p_context_init_fail_node
-                        (context, &(next->parent), _p_context_clause_fail_func);
-                    next->clause_iter = clause_iter;
-                    new_current->goal = body;
-                    new_current->success_node = current->success_node;
-                    new_current->cut_node = context->fail_node;
-                    context->current_node = new_current;
-                    context->fail_node = &(next->parent);
-                } else {
-                    new_current = GC_NEW(p_exec_node);
-                    if (!new_current)
-                        return P_RESULT_FAIL;
-                    new_current->goal = body;
-                    new_current->success_node = current->success_node;
-                    new_current->cut_node = context->fail_node;
-                    context->current_node = new_current;
-                }
-                return P_RESULT_TREE_CHANGE;
-            }
-        }
-        return P_RESULT_FAIL;
+        return _p_context_call_clauses(context, goal, &clause_iter);
     }
 
     /* The predicate does not exist - throw an error or fail */
@@ -715,7 +1113,7 @@ static p_goal_result p_goal_execute(p_context *context, p_term **error)
 
         /* Determine what needs to be done next for this goal */
         *error = 0;
-        context->fail_marker = p_context_mark_trail(context);
+        context->fail_marker = _p_context_trail_marker(context);
         result = p_goal_execute_inner(context, goal, error);
         if (result == P_RESULT_TRUE) {
             /* Success of deterministic leaf goal */
@@ -734,6 +1132,7 @@ static p_goal_result p_goal_execute(p_context *context, p_term **error)
                     context->fail_node = 0;
                 break;
             }
+            p_context_trim_nodes(context, context->current_node);
         } else if (result == P_RESULT_FAIL) {
             /* Failure of deterministic leaf goal */
 #ifdef P_GOAL_DEBUG
@@ -743,6 +1142,9 @@ static p_goal_result p_goal_execute(p_context *context, p_term **error)
             if (!(context->current_node))
                 break;      /* Final top-level goal failure */
             context->fail_node = context->current_node->cut_node;
+            _p_context_pop_nodes
+                (context, ((p_exec_fail_node *)(context->current_node))
+                                ->node_marker);
             (*(context->current_node->fail_func))
                 (context, (p_exec_fail_node *)(context->current_node));
         } else if (result == P_RESULT_ERROR) {
@@ -804,7 +1206,7 @@ p_goal_result p_context_execute_goal
     p_term_print(context, goal, p_term_stdio_print_func, stdout);
     putc('\n', stdout);
 #endif
-    context->current_node = GC_NEW(p_exec_node);
+    context->current_node = p_exec_new(context, p_exec_node);
     if (!context->current_node)
         return P_RESULT_FAIL;
     context->current_node->goal = goal;
@@ -821,6 +1223,7 @@ p_goal_result p_context_execute_goal
         context->current_node = 0;
         context->fail_node = 0;
         context->confidence = 0.0;
+        _p_context_pop_nodes(context, 0);
     }
     return result;
 }
@@ -851,6 +1254,9 @@ p_goal_result p_context_reexecute_goal(p_context *context, p_term **error)
     p_goal_result result;
     if (!context->current_node)
         return P_RESULT_FAIL;
+    _p_context_pop_nodes
+        (context, ((p_exec_fail_node *)(context->current_node))
+                        ->node_marker);
     (*(context->current_node->fail_func))
         (context, (p_exec_fail_node *)(context->current_node));
     result = p_goal_execute(context, &error_term);
@@ -861,6 +1267,7 @@ p_goal_result p_context_reexecute_goal(p_context *context, p_term **error)
         context->fail_node = 0;
         context->confidence = 0.0;
         context->database = 0;
+        _p_context_pop_nodes(context, 0);
     }
     return result;
 }
@@ -886,6 +1293,7 @@ void p_context_abandon_goal(p_context *context)
         context->catch_node = 0;
         context->confidence = 1.0;
         context->database = 0;
+        _p_context_pop_nodes(context, 0);
     }
 }
 
@@ -1093,7 +1501,8 @@ p_goal_result p_context_call_once
     p_exec_catch_node *catch_node = context->catch_node;
     double confidence = context->confidence;
     p_term *database = context->database;
-    p_exec_node *goal_node = GC_NEW(p_exec_node);
+    void *node_marker = _p_context_mark_nodes(context);
+    p_exec_node *goal_node = p_exec_new(context, p_exec_node);
     p_term *error_node = 0;
     if (goal_node) {
         goal_node->goal = goal;
@@ -1113,6 +1522,7 @@ p_goal_result p_context_call_once
         context->catch_node = catch_node;
         context->confidence = confidence;
         context->database = database;
+        _p_context_pop_nodes(context, node_marker);
     } else {
         result = P_RESULT_FAIL;
     }
@@ -1133,7 +1543,8 @@ p_goal_result p_goal_call_from_parser(p_context *context, p_term *goal)
     p_exec_catch_node *catch_node = context->catch_node;
     double confidence = context->confidence;
     p_term *database = context->database;
-    p_exec_node *goal_node = GC_NEW(p_exec_node);
+    void *node_marker = _p_context_mark_nodes(context);
+    p_exec_node *goal_node = p_exec_new(context, p_exec_node);
     if (goal_node) {
         goal_node->goal = goal;
         context->current_node = goal_node;
@@ -1147,6 +1558,7 @@ p_goal_result p_goal_call_from_parser(p_context *context, p_term *goal)
         context->catch_node = catch_node;
         context->confidence = confidence;
         context->database = database;
+        _p_context_pop_nodes(context, node_marker);
     } else {
         result = P_RESULT_FAIL;
     }
@@ -1215,6 +1627,110 @@ void p_context_set_debug(p_context *context, int debug)
     context->debug = debug;
 }
 
+/**
+ * \brief Returns non-zero if unification in \a context performs
+ * an occurs check, or zero if it does not.
+ *
+ * \ingroup context
+ * \sa p_context_set_occurs_check()
+ */
+int p_context_is_occurs_check(p_context *context)
+{
+    return context->no_occurs_check ? 0 : 1;
+}
+
+/**
+ * \brief Sets the \a occurs_check state for \a context.
+ *
+ * The occurs check is enabled by default.  When it is disabled,
+ * \ref unify_2 "(=)/2" and clause head unification will bind
+ * variables without checking if the variable occurs within the
+ * value, which may create circular terms.  The explicit
+ * \ref unify_2 "unify_with_occurs_check/2" predicate always
+ * performs the check.
+ *
+ * \ingroup context
+ * \sa p_context_is_occurs_check()
+ */
+void p_context_set_occurs_check(p_context *context, int occurs_check)
+{
+    context->no_occurs_check = !occurs_check;
+}
+
+/**
+ * \brief Returns non-zero if clauses that are consulted into
+ * \a context are compiled straight away, or zero if compilation
+ * is deferred until their predicates are first called.
+ *
+ * \ingroup context
+ * \sa p_context_set_eager_compile()
+ */
+int p_context_is_eager_compile(p_context *context)
+{
+    return context->eager_compile ? 1 : 0;
+}
+
+/**
+ * \brief Sets the \a eager_compile state for \a context.
+ *
+ * By default, the clauses in source files are not compiled until
+ * their predicate is called for the first time, so that programs
+ * with large knowledge bases start quickly and do not pay for
+ * compiling the predicates that they never use.  When eager
+ * compilation is enabled, every clause is compiled as it is
+ * consulted, which avoids the compilation delay on the first call.
+ * This is useful for servers that need consistent response times.
+ *
+ * Clauses that are added with \ref assertz_1 "assertz/1" and
+ * friends are always compiled straight away.
+ *
+ * \ingroup context
+ * \sa p_context_is_eager_compile(), p_context_consult_file()
+ */
+void p_context_set_eager_compile(p_context *context, int eager_compile)
+{
+    context->eager_compile = eager_compile ? 1 : 0;
+}
+
+/**
+ * \brief Returns non-zero if source files that are consulted into
+ * \a context are loaded from cache files when possible.
+ *
+ * \ingroup context
+ * \sa p_context_set_consult_cache()
+ */
+int p_context_is_consult_cache(p_context *context)
+{
+    return context->consult_cache ? 1 : 0;
+}
+
+/**
+ * \brief Sets the \a consult_cache state for \a context.
+ *
+ * When the consult cache is enabled, p_context_consult_file()
+ * saves the declarations that it parses from \c foo.lp into the
+ * cache file \c foo.lpc in the same directory.  The next time that
+ * \c foo.lp is consulted, the declarations are loaded from
+ * \c foo.lpc instead of lexing and parsing the source again.
+ * This includes files that are loaded by \ref import_1 "import/1".
+ *
+ * A cache file is only used if the size and hash of the source
+ * file match those recorded in the cache file.  Otherwise the source
+ * is parsed and the cache file is rewritten.  If the cache file
+ * cannot be written, then the source is parsed every time.
+ *
+ * The cache is not used when debugging is enabled with
+ * p_context_set_debug(), as the debug line number information
+ * is not saved in cache files.
+ *
+ * \ingroup context
+ * \sa p_context_is_consult_cache(), p_context_consult_file()
+ */
+void p_context_set_consult_cache(p_context *context, int consult_cache)
+{
+    context->consult_cache = consult_cache ? 1 : 0;
+}
+
 /**
  * \brief Adds \a path to \a context as a directory to search for
  * source files imported by \ref import_1 "import/1".
@@ -1331,6 +1847,7 @@ p_goal_result _p_context_load_library(p_context *context, p_term *name, p_term *
 
     /* Create a library information block for the context */
     library = GC_NEW(p_library);
+    library->name = name;
     library->handle = handle;
     library->shutdown_func = shutdown_func;
     library->next = context->libraries;
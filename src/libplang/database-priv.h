@@ -38,6 +38,12 @@ struct p_class_info
     p_term *var_list;
 };
 
+/* Answer tables for the calls to a tabled predicate */
+typedef struct p_table_trie p_table_trie;
+
+/* List of the tables that depend upon a predicate or another table */
+typedef struct p_table_dep p_table_dep;
+
 /* Information that is attached to an atom to provide information
  * about the operators and predicates with that name */
 struct p_database_info
@@ -46,11 +52,15 @@ struct p_database_info
     unsigned int arity;
     unsigned int flags : 8;
     unsigned int op_specifier : 8;
-    unsigned int op_priority : 16;
+    unsigned int op_priority : 15;
+    unsigned int source_builtin : 1;    /* Defined by builtin source */
     p_db_builtin builtin_func;
     p_db_arith arith_func;
     p_class_info *class_info;
     p_term *predicate;
+    unsigned int index_depth;   /* Declared depth + 1, or 0 if none */
+    p_table_trie *tables;       /* Tables for tabled predicates */
+    p_table_dep *table_readers; /* Tables that called the predicate */
 };
 
 struct p_builtin
@@ -75,13 +85,26 @@ void _p_db_init(p_context *context);
 void _p_db_init_builtins(p_context *context);
 void _p_db_init_arith(p_context *context);
 void _p_db_init_io(p_context *context);
+void _p_db_init_findall(p_context *context);
 void _p_db_init_fuzzy(p_context *context);
 void _p_db_init_sort(p_context *context);
+void _p_db_init_table(p_context *context);
+
+void _p_table_record_read(p_context *context, p_database_info *info);
+void _p_table_invalidate(p_context *context, p_database_info *info);
 
 p_database_info *_p_db_find_arity(const p_term *atom, unsigned int arity);
 p_database_info *_p_db_create_arity(p_term *atom, unsigned int arity);
 
+/* Generation number for the predicate database, which is incremented
+ * whenever a change is made that may cause a call to resolve to a
+ * different predicate than before */
+extern unsigned int _p_db_generation;
+
 p_term *_p_db_clause_assert_last(p_context *context, p_term *clause);
+int _p_db_clause_consult(p_context *context, p_term *clause);
+void _p_db_set_index_depth
+    (p_context *context, p_term *name, int arity, unsigned int depth);
 
 /** @endcond */
 
@@ -122,6 +122,31 @@
  * \ref asserta_1 "asserta/1" and friends.
  */
 
+/**
+ * \var P_PREDICATE_NO_OCCURS_CHECK
+ * \ingroup database
+ * Head unification for the clauses of the predicate is performed
+ * without an occurs check.  This flag must be set before the
+ * clauses are added to the predicate.
+ * \sa p_context_set_occurs_check()
+ */
+
+/**
+ * \var P_PREDICATE_TABLED
+ * \ingroup database
+ * Calls to the predicate are evaluated with tabling.  The answers
+ * for each variant of a call are remembered, and repeated calls
+ * return the remembered answers instead of executing the clauses.
+ */
+
+/**
+ * \var P_PREDICATE_MEMO
+ * \ingroup database
+ * The predicate implements a grammar rule nonterminal whose results
+ * are memoised for each input position.  Always used together
+ * with P_PREDICATE_TABLED.
+ */
+
 void _p_db_init(p_context *context)
 {
     struct p_db_op_info
@@ -205,6 +230,8 @@ void _p_db_init(p_context *context)
     }
 }
 
+unsigned int _p_db_generation = 0;
+
 P_INLINE p_database_info *p_db_find_arity(const p_term *atom, unsigned int arity)
 {
     p_database_info *info = atom->atom.db_info;
@@ -228,6 +255,8 @@ P_INLINE p_database_info *p_db_create_arity(p_term *atom, unsigned int arity)
         info->next = atom->atom.db_info;
         info->arity = arity;
         atom->atom.db_info = info;
+        p_term_pin_atom(atom);
+        ++_p_db_generation;
     }
     return info;
 }
@@ -485,13 +514,29 @@ void _p_db_register_ariths(p_context *context, const struct p_arith *ariths)
     }
 }
 
-/* Register a table of Plang source strings for builtin predicates */
+/* Register a table of Plang source strings for builtin predicates.
+ * The predicates are marked so that saved images leave them out,
+ * because every new context defines them again */
 void _p_db_register_sources(p_context *context, const char * const *sources)
 {
+    struct p_term_atom_link *link;
+    p_database_info *info;
+    size_t index;
     while (*sources != 0) {
         p_context_consult_string(context, *sources);
         ++sources;
     }
+    for (index = 0; index < context->atom_hash_size; ++index) {
+        for (link = context->atom_hash[index]; link; link = link->next) {
+            if (!link->pinned)
+                continue;
+            info = link->pinned->atom.db_info;
+            for (; info; info = info->next) {
+                if (info->predicate)
+                    info->source_builtin = 1;
+            }
+        }
+    }
 }
 
 /* Extract the predicate name and arity from a clause */
@@ -564,15 +609,22 @@ int p_db_clause_assert_first(p_context *context, p_term *clause)
         predicate = p_term_create_predicate(context, name, arity);
         if (!predicate)
             return 0;
+        if (info->index_depth)
+            predicate->predicate.index_depth = info->index_depth - 1;
         info->predicate = predicate;
     }
     p_term_add_clause_first
         (context, predicate, p_db_convert_clause(context, clause));
+    if (info->table_readers)
+        _p_table_invalidate(context, info);
     return 1;
 }
 
-/* Assert a clause and return the predicate it was asserted into */
-p_term *_p_db_clause_assert_last(p_context *context, p_term *clause)
+/* Assert a clause and return the predicate it was asserted into.
+ * If "lazy" is non-zero, then the clause is compiled when the
+ * predicate is first called rather than straight away */
+static p_term *p_db_clause_assert_last_inner
+    (p_context *context, p_term *clause, int lazy)
 {
     p_database_info *info;
     p_term *name;
@@ -599,13 +651,35 @@ p_term *_p_db_clause_assert_last(p_context *context, p_term *clause)
         predicate = p_term_create_predicate(context, name, arity);
         if (!predicate)
             return 0;
+        if (info->index_depth)
+            predicate->predicate.index_depth = info->index_depth - 1;
         info->predicate = predicate;
     }
-    p_term_add_clause_last
-        (context, predicate, p_db_convert_clause(context, clause));
+    if (lazy) {
+        p_term_add_clause_last
+            (context, predicate,
+             _p_term_create_lazy_clause(context, p_term_deref(clause)));
+    } else {
+        p_term_add_clause_last
+            (context, predicate, p_db_convert_clause(context, clause));
+    }
+    if (info->table_readers)
+        _p_table_invalidate(context, info);
     return predicate;
 }
 
+/* Assert a clause and return the predicate it was asserted into */
+p_term *_p_db_clause_assert_last(p_context *context, p_term *clause)
+{
+    return p_db_clause_assert_last_inner(context, clause, 0);
+}
+
+/* Assert a clause that was read from a source file being consulted */
+int _p_db_clause_consult(p_context *context, p_term *clause)
+{
+    return p_db_clause_assert_last_inner(context, clause, 1) != 0;
+}
+
 /**
  * \brief Asserts \a clause as the last clause in a database
  * predicate on \a context.
@@ -677,6 +751,8 @@ int p_db_clause_retract(p_context *context, p_term *clause)
                 predicate->predicate.clauses.tail = prev;
             if (!predicate->predicate.clauses.head)
                 info->predicate = 0;    /* Completely removed */
+            if (info->table_readers)
+                _p_table_invalidate(context, info);
             return 1;
         }
         prev = list;
@@ -716,6 +792,8 @@ int p_db_clause_abolish(p_context *context, const p_term *name, int arity)
 
     /* Retract all of the clauses */
     info->predicate = 0;
+    if (info->table_readers)
+        _p_table_invalidate(context, info);
     return 1;
 }
 
@@ -770,6 +848,7 @@ int p_db_local_clause_assert_first(p_context *context, p_term *database, p_term
         if (!predicate)
             return 0;
         node->value = predicate;
+        ++_p_db_generation;
     }
 
     /* Add the clause to the head of the list */
@@ -829,6 +908,7 @@ int p_db_local_clause_assert_last(p_context *context, p_term *database, p_term *
         if (!predicate)
             return 0;
         node->value = predicate;
+        ++_p_db_generation;
     }
 
     /* Add the clause to the tail of the list */
@@ -895,6 +975,7 @@ int p_db_local_clause_retract(p_context *context, p_term *database, p_term *clau
                 /* The predicate has been completely removed */
                 _p_rbtree_remove
                     (&(database->database.predicates), &key);
+                ++_p_db_generation;
             }
             return 1;
         }
@@ -938,9 +1019,32 @@ int p_db_local_clause_abolish(p_context *context, p_term *database, const p_term
 
     /* Remove the predicate from the tree, which abolishs all clauses */
     _p_rbtree_remove(&(database->database.predicates), &key);
+    ++_p_db_generation;
     return 1;
 }
 
+/* Sets the maximum depth for indexing on the sub-terms of
+ * compound arguments of the predicate "name" / "arity" */
+void _p_db_set_index_depth
+    (p_context *context, p_term *name, int arity, unsigned int depth)
+{
+    p_database_info *info;
+    p_term *predicate;
+    name = p_term_deref(name);
+    if (!name || name->header.type != P_TERM_ATOM)
+        return;
+    info = p_db_create_arity(name, (unsigned int)arity);
+    if (!info)
+        return;
+    info->index_depth = depth + 1;
+    predicate = info->predicate;
+    if (predicate) {
+        /* Discard the existing indexes so that they are rebuilt */
+        predicate->predicate.index_depth = depth;
+        predicate->predicate.indexes = 0;
+    }
+}
+
 /**
  * \brief Returns the flags associated with the predicate
  * \a name / \a arity in \a context.
@@ -39,7 +39,11 @@ enum {
     P_ARG_MEMBER_LARGE,
     P_ARG_RESET,
     P_ARG_RESET_LARGE,
-    P_ARG_LABEL
+    P_ARG_LABEL,
+    P_ARG_CALL,
+    P_ARG_SWITCH_ON_TERM,
+    P_ARG_SWITCH_TABLE,
+    P_ARG_TRY_CLAUSES
 };
 
 enum {
@@ -151,10 +155,15 @@ static p_inst_info const instructions[] = {
     {"return_true",                 P_ARG_NONE, P_TYPE_STOP},
     {"throw",                       P_ARG_X, P_TYPE_STOP},
 
-#if 0
-    P_OP_CALL,
-    P_OP_EXECUTE,
+    {"call",                        P_ARG_CALL, P_TYPE_STOP},
+    {"execute",                     P_ARG_CALL, P_TYPE_STOP},
+
+    {"switch_on_term",              P_ARG_SWITCH_ON_TERM, P_TYPE_STOP},
+    {"switch_on_constant",          P_ARG_SWITCH_TABLE, P_TYPE_STOP},
+    {"switch_on_structure",         P_ARG_SWITCH_TABLE, P_TYPE_STOP},
+    {"try_clauses",                 P_ARG_TRY_CLAUSES, P_TYPE_STOP},
 
+#if 0
     P_OP_TRY_ME_ELSE,
     P_OP_RETRY_ME_ELSE,
     P_OP_TRUST_ME,
@@ -167,6 +176,69 @@ static p_inst_info const instructions[] = {
     {"end",                         P_ARG_NONE, P_TYPE_STOP}
 };
 
+/* Returns the size of the instruction at "inst" */
+size_t _p_code_inst_size(const p_inst *inst)
+{
+    switch (instructions[p_inst_opcode(inst)].arg_types) {
+    case P_ARG_NONE:
+    default:
+        return sizeof(inst->header);
+    case P_ARG_X:
+    case P_ARG_Y:
+        return sizeof(inst->one_reg);
+    case P_ARG_X_X:
+    case P_ARG_Y_X:
+    case P_ARG_X_Y:
+    case P_ARG_RESET:
+        return sizeof(inst->two_reg);
+    case P_ARG_X_X_LARGE:
+    case P_ARG_Y_X_LARGE:
+    case P_ARG_X_Y_LARGE:
+    case P_ARG_RESET_LARGE:
+        return sizeof(inst->large_two_reg);
+    case P_ARG_FUNCTOR:
+    case P_ARG_MEMBER:
+        return sizeof(inst->functor);
+    case P_ARG_FUNCTOR_LARGE:
+    case P_ARG_MEMBER_LARGE:
+        return sizeof(inst->large_functor);
+    case P_ARG_CONSTANT:
+    case P_ARG_CONSTANT_X:
+        return sizeof(inst->constant);
+    case P_ARG_LABEL:
+        return sizeof(inst->label);
+    case P_ARG_CALL:
+        return sizeof(inst->call);
+    case P_ARG_SWITCH_ON_TERM:
+        return sizeof(inst->switch_on_term);
+    case P_ARG_SWITCH_TABLE:
+        return sizeof(inst->switch_table);
+    case P_ARG_TRY_CLAUSES:
+        return sizeof(inst->try_clauses);
+    }
+}
+
+/* Returns the number of bytes of code in "clause", including the
+ * final "end" instruction but not the jumps between code blocks */
+size_t _p_code_clause_size(const p_code_clause *clause)
+{
+    const p_inst *inst = (p_inst *)(clause->code->inst);
+    size_t size = 0;
+    p_opcode opcode;
+    for (;;) {
+        opcode = p_inst_opcode(inst);
+        if (opcode == P_OP_JUMP) {
+            inst = inst->label.label;
+            continue;
+        }
+        size += _p_code_inst_size(inst);
+        if (opcode == P_OP_END)
+            break;
+        inst = (p_inst *)(((char *)inst) + _p_code_inst_size(inst));
+    }
+    return size;
+}
+
 void _p_code_disassemble
     (FILE *output, p_context *context, const p_code_clause *clause)
 {
@@ -174,7 +246,7 @@ void _p_code_disassemble
     size_t size;
     const p_inst *inst = (p_inst *)(clause->code->inst);
     for (;;) {
-        opcode = (p_opcode)(inst->header.opcode);
+        opcode = p_inst_opcode(inst);
         if (opcode == P_OP_JUMP) {
             /* Jump to next continuation code block - not important */
             inst = inst->label.label;
@@ -286,21 +358,118 @@ void _p_code_disassemble
             fprintf(output, " %08lx", (long)(inst->label.label));
             size = sizeof(inst->label);
             break;
+        case P_ARG_CALL:
+            fprintf(output, " X%u", inst->call.reg1);
+            size = sizeof(inst->call);
+            break;
+        case P_ARG_SWITCH_ON_TERM:
+            fprintf(output, " X%u, %08lx, %08lx, %08lx, %08lx",
+                    inst->switch_on_term.reg1,
+                    (long)(inst->switch_on_term.var_label),
+                    (long)(inst->switch_on_term.constant_label),
+                    (long)(inst->switch_on_term.list_label),
+                    (long)(inst->switch_on_term.structure_label));
+            size = sizeof(inst->switch_on_term);
+            break;
+        case P_ARG_SWITCH_TABLE:
+            fprintf(output, " X%u, %u, %08lx",
+                    inst->switch_table.reg1,
+                    inst->switch_table.num_entries,
+                    (long)(inst->switch_table.default_label));
+            size = sizeof(inst->switch_table);
+            break;
+        case P_ARG_TRY_CLAUSES:
+            fprintf(output, " %u", inst->try_clauses.count);
+            size = sizeof(inst->try_clauses);
+            break;
         }
         putc('\n', output);
         inst = (p_inst *)(((char *)inst) + size);
     }
 }
 
+/* Extract the key for a "unify" instruction that matches a
+ * sub-argument, descending into the first argument of compound
+ * terms while "depth" is greater than 1 */
+static int p_code_subterm_key
+    (p_rbkey *key, const p_inst *inst, unsigned int depth)
+{
+    for (;;) {
+        switch (p_inst_opcode(inst)) {
+        case P_OP_JUMP:
+            /* Jump to next continuation code block */
+            inst = inst->label.label;
+            continue;
+        case P_OP_UNIFY_FUNCTOR:
+        case P_OP_UNIFY_IN_FUNCTOR:
+            key->type = P_TERM_FUNCTOR;
+            key->size = inst->functor.arity;
+            key->name = inst->functor.name;
+            break;
+        case P_OP_UNIFY_FUNCTOR_LARGE:
+        case P_OP_UNIFY_IN_FUNCTOR_LARGE:
+            key->type = P_TERM_FUNCTOR;
+            key->size = inst->large_functor.arity;
+            key->name = inst->large_functor.name;
+            break;
+        case P_OP_UNIFY_LIST:
+        case P_OP_UNIFY_IN_LIST:
+            key->type = P_TERM_LIST;
+            key->size = 0;
+            key->name = 0;
+            return 1;
+        case P_OP_UNIFY_ATOM:
+        case P_OP_UNIFY_IN_ATOM:
+            key->type = P_TERM_ATOM;
+            key->size = 0;
+            key->name = inst->constant.value;
+            return 1;
+        case P_OP_UNIFY_CONSTANT:
+        case P_OP_UNIFY_IN_CONSTANT:
+            key->type = inst->constant.value->header.type;
+#if defined(P_TERM_64BIT)
+            if (key->type == P_TERM_INTEGER) {
+                key->size = p_term_integer_value(inst->constant.value);
+                key->name = 0;
+                return 1;
+            }
+#endif
+            key->size = 0;
+            key->name = inst->constant.value;
+            return 1;
+        default:
+            /* Variable or member reference, which isn't indexable */
+            return 0;
+        }
+
+        /* The instruction after a functor unifies its first argument */
+        if (--depth == 0 || !(key->size))
+            return 1;
+        inst = (p_inst *)(((char *)inst) + _p_code_inst_size(inst));
+    }
+}
+
 /* Extract the red-black key for a specific "get" argument */
 int _p_code_argument_key
     (p_rbkey *key, const p_code_clause *clause, unsigned int arg)
+{
+    return _p_code_argument_deep_key(key, clause, arg, 0);
+}
+
+/* Extract the key for a specific "get" argument.  If "depth" is
+ * non-zero and the argument is a compound term, then descend into
+ * its first argument up to "depth" levels.  The descent stops early
+ * at the first argument that is not a compound term, in the same
+ * way as p_term_index_key() in term.c does for the arguments
+ * of a goal */
+int _p_code_argument_deep_key
+    (p_rbkey *key, const p_code_clause *clause, unsigned int arg,
+     unsigned int depth)
 {
     p_opcode opcode;
-    size_t size;
     const p_inst *inst = (p_inst *)(clause->code->inst);
     for (;;) {
-        opcode = (p_opcode)(inst->header.opcode);
+        opcode = p_inst_opcode(inst);
         if (opcode == P_OP_JUMP) {
             /* Jump to next continuation code block */
             inst = inst->label.label;
@@ -346,6 +515,11 @@ int _p_code_argument_key
                 key->type = P_TERM_FUNCTOR;
                 key->size = inst->functor.arity;
                 key->name = inst->functor.name;
+                if (depth > 0 && key->size > 0) {
+                    return p_code_subterm_key
+                        (key, (p_inst *)(((char *)inst) +
+                                    _p_code_inst_size(inst)), depth);
+                }
                 return 1;
             case P_OP_GET_FUNCTOR_LARGE:
             case P_OP_GET_IN_FUNCTOR_LARGE:
@@ -354,6 +528,11 @@ int _p_code_argument_key
                 key->type = P_TERM_FUNCTOR;
                 key->size = inst->large_functor.arity;
                 key->name = inst->large_functor.name;
+                if (depth > 0 && key->size > 0) {
+                    return p_code_subterm_key
+                        (key, (p_inst *)(((char *)inst) +
+                                    _p_code_inst_size(inst)), depth);
+                }
                 return 1;
             case P_OP_GET_LIST:
             case P_OP_GET_IN_LIST:
@@ -406,64 +585,7 @@ int _p_code_argument_key
 
         case P_TYPE_SKIP: break;
         }
-        switch (instructions[opcode].arg_types) {
-        case P_ARG_NONE:
-        default:
-            size = sizeof(inst->header);
-            break;
-        case P_ARG_X:
-            size = sizeof(inst->one_reg);
-            break;
-        case P_ARG_Y:
-            size = sizeof(inst->one_reg);
-            break;
-        case P_ARG_X_X:
-            size = sizeof(inst->two_reg);
-            break;
-        case P_ARG_Y_X:
-            size = sizeof(inst->two_reg);
-            break;
-        case P_ARG_X_Y:
-            size = sizeof(inst->two_reg);
-            break;
-        case P_ARG_X_X_LARGE:
-            size = sizeof(inst->large_two_reg);
-            break;
-        case P_ARG_Y_X_LARGE:
-            size = sizeof(inst->large_two_reg);
-            break;
-        case P_ARG_X_Y_LARGE:
-            size = sizeof(inst->large_two_reg);
-            break;
-        case P_ARG_FUNCTOR:
-            size = sizeof(inst->functor);
-            break;
-        case P_ARG_FUNCTOR_LARGE:
-            size = sizeof(inst->large_functor);
-            break;
-        case P_ARG_CONSTANT:
-            size = sizeof(inst->constant);
-            break;
-        case P_ARG_CONSTANT_X:
-            size = sizeof(inst->constant);
-            break;
-        case P_ARG_MEMBER:
-            size = sizeof(inst->functor);
-            break;
-        case P_ARG_MEMBER_LARGE:
-            size = sizeof(inst->large_functor);
-            break;
-        case P_ARG_RESET:
-            size = sizeof(inst->two_reg);
-            break;
-        case P_ARG_RESET_LARGE:
-            size = sizeof(inst->large_two_reg);
-            break;
-        case P_ARG_LABEL:
-            size = sizeof(inst->label);
-            break;
-        }
-        inst = (p_inst *)(((char *)inst) + size);
+        inst = (p_inst *)(((char *)inst) + _p_code_inst_size(inst));
     }
     return 0;
 }
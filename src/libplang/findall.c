@@ -0,0 +1,452 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+#include <plang/database.h>
+#include <plang/errors.h>
+#include "term-priv.h"
+#include "context-priv.h"
+#include "database-priv.h"
+
+/* The solutions of findall/3 and friends are collected in a buffer
+ * that is shared by all active findall calls in the context.
+ * Each call remembers where its solutions start in the buffer, and
+ * nested calls stack their solutions on top of those of the outer
+ * call.  Solutions are copied once as they are found, and the
+ * result list is built when the goal has no more solutions */
+
+/* '$$findall_begin'(Start) - starts a new collection of solutions */
+static p_goal_result p_builtin_findall_begin
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *start = p_term_create_integer
+        (context, (int)(context->findall_top));
+    if (p_term_unify(context, args[0], start, P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* Pushes a term onto the solution buffer */
+static int p_findall_push(p_context *context, p_term *term)
+{
+    p_term **terms;
+    if (context->findall_top >= context->findall_max) {
+        size_t max = context->findall_max * 2;
+        if (max < 64)
+            max = 64;
+        terms = (p_term **)GC_REALLOC
+            (context->findall_terms, max * sizeof(p_term *));
+        if (!terms)
+            return 0;
+        context->findall_terms = terms;
+        context->findall_max = max;
+    }
+    context->findall_terms[(context->findall_top)++] = term;
+    return 1;
+}
+
+/* '$$findall_add'(Term) - adds a copy of a solution to the
+ * innermost collection */
+static p_goal_result p_builtin_findall_add
+    (p_context *context, p_term **args, p_term **error)
+{
+    if (p_findall_push(context, _p_term_clone_persistent(context, args[0])))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* '$$findall_end'(Start, List) - ends a collection of solutions
+ * and unifies List with the solutions that were found */
+static p_goal_result p_builtin_findall_end
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *start_term = p_term_deref_member(context, args[0]);
+    p_term *list = context->nil_atom;
+    size_t start;
+    if (p_term_type(start_term) != P_TERM_INTEGER)
+        return P_RESULT_FAIL;
+    start = (size_t)p_term_integer_value(start_term);
+    while (context->findall_top > start) {
+        --(context->findall_top);
+        list = p_term_create_list
+            (context, context->findall_terms[context->findall_top], list);
+        context->findall_terms[context->findall_top] = 0;
+    }
+    if (p_term_unify(context, args[1], list, P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+p_goal_result p_arith_eval
+    (p_context *context, p_arith_value *result,
+     p_term *expr, p_term **error);
+
+/* Aggregates such as aggregate_all(count, Goal, N) fold each
+ * solution into an accumulator that occupies a single slot in
+ * the solution buffer, so they run in constant space no matter
+ * how many solutions the goal has.  The slot is null until the
+ * first solution arrives for max(Expr) and min(Expr) */
+
+/* '$$aggregate_begin'(Start, Spec) - starts a new aggregate */
+static p_goal_result p_builtin_aggregate_begin
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *spec = p_term_deref_member(context, args[1]);
+    p_term *start = p_term_create_integer
+        (context, (int)(context->findall_top));
+    p_term *initial = p_term_create_integer(context, 0);
+    if (p_term_type(spec) == P_TERM_FUNCTOR &&
+            p_term_functor(spec) != p_term_create_atom(context, "sum"))
+        initial = 0;
+    if (!p_term_unify(context, args[0], start, P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    if (p_findall_push(context, initial))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* Reports "error" against aggregate_all/3 rather than the internal
+ * '$$aggregate_add'/2 builtin that detected it */
+static p_term *p_aggregate_error(p_context *context, p_term *error)
+{
+    p_term *wrapped;
+    p_term *pred;
+    error = p_term_deref(error);
+    if (p_term_type(error) != P_TERM_FUNCTOR || p_term_arg_count(error) != 2 ||
+            p_term_functor(error) != p_term_create_atom(context, "error"))
+        return error;
+    pred = p_term_create_functor(context, context->slash_atom, 2);
+    p_term_bind_functor_arg
+        (pred, 0, p_term_create_atom(context, "aggregate_all"));
+    p_term_bind_functor_arg(pred, 1, p_term_create_integer(context, 3));
+    wrapped = p_term_create_functor(context, p_term_functor(error), 2);
+    p_term_bind_functor_arg(wrapped, 0, p_term_arg(error, 0));
+    p_term_bind_functor_arg(wrapped, 1, pred);
+    return wrapped;
+}
+
+/* '$$aggregate_add'(Start, Spec) - folds the current solution
+ * into the aggregate that starts at Start */
+static p_goal_result p_builtin_aggregate_add
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *start_term = p_term_deref_member(context, args[0]);
+    p_term *spec = p_term_deref_member(context, args[1]);
+    p_term **slot;
+    p_term *name;
+    p_arith_value value;
+    p_arith_value acc;
+    p_goal_result result;
+    size_t start;
+    int cmp;
+
+    /* Locate the accumulator slot */
+    if (p_term_type(start_term) != P_TERM_INTEGER)
+        return P_RESULT_FAIL;
+    start = (size_t)p_term_integer_value(start_term);
+    if (start >= context->findall_top)
+        return P_RESULT_FAIL;
+    slot = &(context->findall_terms[start]);
+
+    /* Count the solution if the template is "count" */
+    if (p_term_type(spec) != P_TERM_FUNCTOR) {
+        *slot = p_term_create_integer
+            (context, p_term_integer_value(*slot) + 1);
+        return P_RESULT_TRUE;
+    }
+
+    /* Evaluate the expression for this solution */
+    result = p_arith_eval
+        (context, &value, p_term_arg(spec, 0), error);
+    if (result != P_RESULT_TRUE) {
+        if (result == P_RESULT_ERROR)
+            *error = p_aggregate_error(context, *error);
+        return result;
+    }
+    if (value.type != P_TERM_INTEGER && value.type != P_TERM_REAL) {
+        *error = p_aggregate_error
+            (context, p_create_type_error
+                (context, "number", p_term_arg(spec, 0)));
+        return P_RESULT_ERROR;
+    }
+
+    /* Fold the value into the accumulator */
+    name = p_term_functor(spec);
+    if (*slot) {
+        acc.type = p_term_type(*slot);
+        if (acc.type == P_TERM_INTEGER)
+            acc.integer_value = p_term_integer_value(*slot);
+        else
+            acc.real_value = p_term_real_value(*slot);
+    } else {
+        acc = value;
+    }
+    if (name == p_term_create_atom(context, "sum")) {
+        if (acc.type == P_TERM_INTEGER && value.type == P_TERM_INTEGER) {
+            acc.integer_value += value.integer_value;
+        } else {
+            if (acc.type == P_TERM_INTEGER)
+                acc.real_value = acc.integer_value;
+            if (value.type == P_TERM_INTEGER)
+                acc.real_value += value.integer_value;
+            else
+                acc.real_value += value.real_value;
+            acc.type = P_TERM_REAL;
+        }
+    } else {
+        if (acc.type == P_TERM_INTEGER && value.type == P_TERM_INTEGER) {
+            cmp = (value.integer_value > acc.integer_value) -
+                  (value.integer_value < acc.integer_value);
+        } else {
+            double v1 = (value.type == P_TERM_INTEGER)
+                ? value.integer_value : value.real_value;
+            double v2 = (acc.type == P_TERM_INTEGER)
+                ? acc.integer_value : acc.real_value;
+            cmp = (v1 > v2) - (v1 < v2);
+        }
+        if (name == p_term_create_atom(context, "max")) {
+            if (cmp > 0)
+                acc = value;
+        } else if (cmp < 0) {
+            acc = value;
+        }
+    }
+    if (acc.type == P_TERM_INTEGER)
+        *slot = p_term_create_integer(context, acc.integer_value);
+    else
+        *slot = p_term_create_real(context, acc.real_value);
+    if (*slot)
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* '$$aggregate_end'(Start, Result) - ends an aggregate and
+ * unifies Result with its value, or fails if there is no value */
+static p_goal_result p_builtin_aggregate_end
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *start_term = p_term_deref_member(context, args[0]);
+    p_term *value;
+    size_t start;
+    if (p_term_type(start_term) != P_TERM_INTEGER)
+        return P_RESULT_FAIL;
+    start = (size_t)p_term_integer_value(start_term);
+    if (start >= context->findall_top)
+        return P_RESULT_FAIL;
+    value = context->findall_terms[start];
+    while (context->findall_top > start) {
+        --(context->findall_top);
+        context->findall_terms[context->findall_top] = 0;
+    }
+    if (value && p_term_unify(context, args[1], value, P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* Map between the variables of two terms being checked for variance */
+typedef struct p_variant_map p_variant_map;
+struct p_variant_map
+{
+    p_term **vars;
+    size_t count;
+    size_t max;
+};
+
+static int p_variant_map_vars
+    (p_variant_map *map, p_term *var1, p_term *var2)
+{
+    size_t index;
+    for (index = 0; index < map->count; index += 2) {
+        if (map->vars[index] == var1)
+            return map->vars[index + 1] == var2;
+        if (map->vars[index + 1] == var2)
+            return 0;
+    }
+    if (map->count >= map->max) {
+        size_t max = map->max * 2;
+        p_term **vars;
+        if (max < 16)
+            max = 16;
+        vars = (p_term **)GC_REALLOC(map->vars, max * sizeof(p_term *));
+        if (!vars)
+            return 0;
+        map->vars = vars;
+        map->max = max;
+    }
+    map->vars[(map->count)++] = var1;
+    map->vars[(map->count)++] = var2;
+    return 1;
+}
+
+/* Determine if two terms are identical up to a consistent
+ * renaming of their variables */
+static int p_term_is_variant
+    (p_context *context, p_term *term1, p_term *term2, p_variant_map *map)
+{
+    unsigned int index;
+    for (;;) {
+        term1 = p_term_deref_member(context, term1);
+        term2 = p_term_deref_member(context, term2);
+        if (term1 == term2)
+            return 1;
+        if (!term1 || !term2)
+            return 0;
+        if (term1->header.type != term2->header.type)
+            return 0;
+        switch (term1->header.type) {
+        case P_TERM_VARIABLE:
+            return p_variant_map_vars(map, term1, term2);
+        case P_TERM_FUNCTOR:
+            if (term1->header.size != term2->header.size ||
+                    term1->functor.functor_name !=
+                        term2->functor.functor_name)
+                return 0;
+            for (index = 0; index < term1->header.size - 1; ++index) {
+                if (!p_term_is_variant
+                        (context, term1->functor.arg[index],
+                         term2->functor.arg[index], map))
+                    return 0;
+            }
+            term1 = term1->functor.arg[index];
+            term2 = term2->functor.arg[index];
+            break;
+        case P_TERM_LIST:
+            if (!p_term_is_variant
+                    (context, term1->list.head, term2->list.head, map))
+                return 0;
+            term1 = term1->list.tail;
+            term2 = term2->list.tail;
+            break;
+        default:
+            return p_term_precedes(context, term1, term2) == 0;
+        }
+    }
+}
+
+/* '$$bagof_groups'(Solutions, Groups) - groups a list of
+ * Witness - Template solutions by witness for bagof/3.
+ *
+ * The solutions are sorted on the witness, and then solutions whose
+ * witnesses are variants of each other are gathered into a single
+ * Witness - Bag pair in Groups.  The witnesses of a group are unified
+ * so that the variables of the templates in the bag are shared.
+ * Sorting brings identical ground witnesses together, so only
+ * witnesses with variables need to be checked against the
+ * rest of the solutions */
+static p_goal_result p_builtin_bagof_groups
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *sorted = p_term_sort(context, args[0], P_SORT_KEYED);
+    p_term **solutions;
+    p_term **bag;
+    p_term *groups;
+    p_term *group;
+    p_term *key;
+    p_term *list;
+    p_variant_map map;
+    size_t count, index, posn, bag_size;
+    int ground;
+
+    /* Copy the sorted solutions into an array */
+    if (!sorted || sorted == context->nil_atom)
+        return P_RESULT_FAIL;
+    count = 0;
+    for (list = sorted; list != context->nil_atom;
+            list = p_term_deref(list->list.tail))
+        ++count;
+    solutions = (p_term **)GC_MALLOC(count * 2 * sizeof(p_term *));
+    if (!solutions)
+        return P_RESULT_FAIL;
+    bag = solutions + count;
+    count = 0;
+    for (list = sorted; list != context->nil_atom;
+            list = p_term_deref(list->list.tail))
+        solutions[count++] = p_term_deref(list->list.head);
+
+    /* Gather up the groups, which are built in reverse order */
+    groups = context->nil_atom;
+    map.vars = 0;
+    map.max = 0;
+    for (index = 0; index < count; ++index) {
+        if (!solutions[index])
+            continue;
+        key = p_term_arg(solutions[index], 0);
+        ground = p_term_is_ground(key);
+        bag[0] = p_term_arg(solutions[index], 1);
+        bag_size = 1;
+        for (posn = index + 1; posn < count; ++posn) {
+            if (!solutions[posn])
+                continue;
+            map.count = 0;
+            if (p_term_is_variant
+                    (context, key, p_term_arg(solutions[posn], 0), &map)) {
+                if (!ground &&
+                        !p_term_unify(context, key,
+                                      p_term_arg(solutions[posn], 0),
+                                      P_BIND_DEFAULT))
+                    return P_RESULT_FAIL;
+                bag[bag_size++] = p_term_arg(solutions[posn], 1);
+                solutions[posn] = 0;
+            } else if (ground) {
+                break;
+            }
+        }
+        list = context->nil_atom;
+        while (bag_size > 0) {
+            --bag_size;
+            list = p_term_create_list(context, bag[bag_size], list);
+        }
+        group = p_term_create_functor
+            (context, p_term_functor(solutions[index]), 2);
+        p_term_bind_functor_arg(group, 0, key);
+        p_term_bind_functor_arg(group, 1, list);
+        groups = p_term_create_list(context, group, groups);
+    }
+
+    /* Reverse the groups into witness order */
+    list = context->nil_atom;
+    while (groups != context->nil_atom) {
+        list = p_term_create_list(context, groups->list.head, list);
+        groups = groups->list.tail;
+    }
+    if (p_term_unify(context, args[1], list, P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+void _p_db_init_findall(p_context *context)
+{
+    static struct p_builtin const builtins[] = {
+        {"$$aggregate_add", 2, p_builtin_aggregate_add},
+        {"$$aggregate_begin", 2, p_builtin_aggregate_begin},
+        {"$$aggregate_end", 2, p_builtin_aggregate_end},
+        {"$$bagof_groups", 2, p_builtin_bagof_groups},
+        {"$$findall_add", 1, p_builtin_findall_add},
+        {"$$findall_begin", 1, p_builtin_findall_begin},
+        {"$$findall_end", 2, p_builtin_findall_end},
+        {0, 0, 0}
+    };
+    _p_db_register_builtins(context, builtins);
+}
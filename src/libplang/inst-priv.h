@@ -123,6 +123,11 @@ typedef enum {
 
     P_OP_CALL,
     P_OP_EXECUTE,
+
+    P_OP_SWITCH_ON_TERM,
+    P_OP_SWITCH_ON_CONSTANT,
+    P_OP_SWITCH_ON_STRUCTURE,
+    P_OP_TRY_CLAUSES,
     P_OP_TRY_ME_ELSE,
 
     P_OP_RETRY_ME_ELSE,
@@ -136,6 +141,21 @@ typedef enum {
 
 } p_opcode;
 
+/* Direct-threaded dispatch is only possible with GCC's "labels as
+ * values" extension, and on 64-bit systems where there is room in
+ * the opcode field to hold the handler offset for the instruction.
+ * Once a clause has been finished, the low 8 bits of the opcode
+ * field contain the plain opcode and the upper 24 bits contain the
+ * signed offset of the handler within the interpreter */
+#if defined(P_THREADED_DISPATCH) && defined(__GNUC__) && \
+        defined(P_TERM_64BIT)
+#define P_INST_THREADED     1
+#endif
+#define P_INST_OPCODE_BITS  8
+#define P_INST_OPCODE_MASK  ((1U << P_INST_OPCODE_BITS) - 1)
+#define p_inst_opcode(inst) \
+    ((p_opcode)((inst)->header.opcode & P_INST_OPCODE_MASK))
+
 /* Header that appears on all instructions */
 struct p_inst_header
 {
@@ -265,6 +285,91 @@ struct p_inst_label
     p_inst *label;
 };
 
+/* Cache of the predicate that the goal at a call site resolved to
+ * the last time that the call was executed.  The cache is only used
+ * if the name, arity, and local database are the same as before and
+ * the predicate database has not changed since (_p_db_generation).
+ * The builtin and global predicate are fetched from "info" each
+ * time because they can be changed without altering "info" */
+typedef struct p_call_cache p_call_cache;
+struct p_call_cache
+{
+    p_term *name;
+    unsigned int arity;
+    unsigned int generation;
+    p_database_info *info;
+    p_term *database;
+    p_term *local_predicate;
+};
+
+/* Instruction that calls a goal in a register */
+struct p_inst_call
+{
+#if defined(P_TERM_64BIT)
+    unsigned int opcode;
+    unsigned int reg1;
+#else
+    unsigned int opcode : 8;
+    unsigned int reg1   : 24;
+#endif
+    p_call_cache cache;
+};
+
+/* Clause selection instructions.  These are generated for a whole
+ * predicate by _p_code_generate_switch() rather than for a single
+ * clause, and are run by _p_code_select_clauses().  A null label
+ * indicates that no clauses can match */
+struct p_inst_switch_on_term
+{
+#if defined(P_TERM_64BIT)
+    unsigned int opcode;
+    unsigned int reg1;
+#else
+    unsigned int opcode : 8;
+    unsigned int reg1   : 24;
+#endif
+    p_inst *var_label;
+    p_inst *constant_label;
+    p_inst *list_label;
+    p_inst *structure_label;
+};
+typedef struct p_switch_entry p_switch_entry;
+struct p_switch_entry
+{
+    p_rbkey key;
+    unsigned int hash;
+    p_inst *label;
+};
+struct p_inst_switch_table
+{
+#if defined(P_TERM_64BIT)
+    unsigned int opcode;
+    unsigned int reg1;
+#else
+    unsigned int opcode : 8;
+    unsigned int reg1   : 24;
+#endif
+    unsigned int num_entries;
+    unsigned int mask;              /* Zero for a linear table */
+    p_inst *default_label;
+    p_switch_entry *entries;
+};
+struct p_inst_try_clauses
+{
+#if defined(P_TERM_64BIT)
+    unsigned int opcode;
+    unsigned int count;
+#else
+    unsigned int opcode : 8;
+    unsigned int count  : 24;
+#endif
+    struct p_term_clause **clauses; /* Null-terminated */
+};
+
+/* Tables with more entries than this use hashing instead
+ * of a linear search to find the key */
+#define P_SWITCH_LINEAR_MAX     8
+
 union p_inst
 {
     struct p_inst_header        header;
@@ -276,8 +381,15 @@ union p_inst
     struct p_inst_set_value     set_value;
     struct p_inst_constant      constant;
     struct p_inst_label         label;
+    struct p_inst_call          call;
+    struct p_inst_switch_on_term switch_on_term;
+    struct p_inst_switch_table  switch_table;
+    struct p_inst_try_clauses   try_clauses;
 };
 
+/* Code is generated into fixed-size blocks that are chained with
+ * P_OP_JUMP, and then compacted by _p_code_finish() into a single
+ * allocation of the exact size once the clause is complete */
 #define P_CODE_BLOCK_WORDS      64
 #define P_CODE_BLOCK_SIZE       (P_CODE_BLOCK_WORDS * sizeof(void *))
 
@@ -306,6 +418,8 @@ struct p_code
     int force_large_regs;
 };
 
+struct p_exec_code_node;
+
 void _p_code_allocate_args(p_code *code, int arity);
 int _p_code_generate_builder
     (p_context *context, p_term *term, p_code *code, int preferred_reg);
@@ -315,6 +429,8 @@ void _p_code_generate_matcher
      int input_only);
 void _p_code_generate_dynamic_clause
     (p_context *context, p_term *head, p_term *body, p_code *code);
+void _p_code_generate_clause
+    (p_context *context, p_term *head, p_term *body, p_code *code);
 
 p_code *_p_code_new(void);
 void _p_code_finish(p_code *code, p_code_clause *clause);
@@ -322,11 +438,28 @@ void _p_code_finish(p_code *code, p_code_clause *clause);
 void _p_code_set_xreg(p_context *context, int reg, p_term *value);
 p_goal_result _p_code_run
     (p_context *context, const p_code_clause *clause, p_term **error);
+p_goal_result _p_code_resume
+    (p_context *context, const p_code_clause *clause,
+     const p_inst *pc, p_term **yregs, p_term **error,
+     struct p_exec_code_node **cont);
 
+#if defined(P_INST_THREADED)
+void _p_code_thread(p_code_clause *clause);
+#endif
+
+size_t _p_code_inst_size(const p_inst *inst);
+size_t _p_code_clause_size(const p_code_clause *clause);
 void _p_code_disassemble
     (FILE *output, p_context *context, const p_code_clause *clause);
 int _p_code_argument_key
     (p_rbkey *key, const p_code_clause *clause, unsigned int arg);
+int _p_code_argument_deep_key
+    (p_rbkey *key, const p_code_clause *clause, unsigned int arg,
+     unsigned int depth);
+
+p_inst *_p_code_generate_switch(p_term *predicate);
+struct p_term_clause **_p_code_select_clauses
+    (const p_inst *inst, const p_term *goal, unsigned int *count);
 
 /** @endcond */
 
@@ -22,6 +22,37 @@
 
 /** @cond */
 
+#if defined(P_INST_THREADED)
+
+/* Direct-threaded dispatch: jump straight to the handler whose
+ * offset was stored in the instruction by _p_code_thread() */
+#define P_INST_DISPATCH     \
+    goto *(&&p_inst_base + (((int)(inst->header.opcode)) >> \
+                            P_INST_OPCODE_BITS))
+#define P_INST_START_LOOP   \
+    P_INST_DISPATCH; \
+    p_inst_base: P_INST_FAIL;
+#define P_INST_END_LOOP
+
+#define P_INST_BEGIN(opcode)            p_inst_##opcode: {
+#define P_INST_BEGIN_LARGE(opcode)      p_inst_large_##opcode: {
+#define P_INST_END(type)    \
+    inst = (p_inst *)(((char *)inst) + sizeof(inst->type)); \
+    P_INST_DISPATCH; }
+#define P_INST_END_NO_ADVANCE   \
+    P_INST_DISPATCH; }
+
+#define P_INST_LABEL(opcode)        \
+    (&&p_inst_##opcode - &&p_inst_base)
+#define P_INST_LABEL_LARGE(opcode)  \
+    (&&p_inst_large_##opcode - &&p_inst_base)
+
+/* Offsets of the instruction handlers, set on the first call
+ * to _p_code_resume() with a null clause */
+static const int *p_inst_offsets = 0;
+
+#else /* !P_INST_THREADED */
+
 #define P_INST_START_LOOP   \
     for (;;) { \
         switch (inst->header.opcode) {
@@ -38,6 +69,8 @@
 #define P_INST_END_NO_ADVANCE   \
     break; }
 
+#endif /* !P_INST_THREADED */
+
 #define P_INST_FAIL     return P_RESULT_FAIL /* FIXME */
 
 void _p_code_set_xreg(p_context *context, int reg, p_term *value)
@@ -56,15 +89,160 @@ void _p_code_set_xreg(p_context *context, int reg, p_term *value)
 
 p_goal_result _p_code_run
     (p_context *context, const p_code_clause *clause, p_term **error)
+{
+    return _p_code_resume(context, clause, 0, 0, error, 0);
+}
+
+#if defined(P_INST_THREADED)
+
+/* Converts the opcodes in "clause" into direct-threaded form by
+ * storing the offset of each instruction's handler alongside it */
+void _p_code_thread(p_code_clause *clause)
+{
+    p_inst *inst = (p_inst *)(clause->code->inst);
+    p_opcode opcode;
+    if (!p_inst_offsets)
+        _p_code_resume(0, 0, 0, 0, 0, 0);
+    for (;;) {
+        opcode = p_inst_opcode(inst);
+        inst->header.opcode = ((unsigned int)opcode) |
+            (((unsigned int)(p_inst_offsets[opcode]))
+                    << P_INST_OPCODE_BITS);
+        if (opcode == P_OP_JUMP)
+            inst = inst->label.label;
+        else if (opcode == P_OP_END)
+            break;
+        else
+            inst = (p_inst *)(((char *)inst) + _p_code_inst_size(inst));
+    }
+}
+
+#endif
+
+/* Runs the code for "clause" starting at "pc" with the environment
+ * "yregs".  If "pc" is null, then execution starts at the beginning
+ * of the clause with a fresh environment.  When a "call" instruction
+ * is reached, the continuation is returned in "cont" */
+p_goal_result _p_code_resume
+    (p_context *context, const p_code_clause *clause,
+     const p_inst *pc, p_term **yregs, p_term **error,
+     p_exec_code_node **cont)
 {
     const p_inst *inst;
     p_term *term;
     p_term *term2;
     p_term **xregs;
-    p_term **yregs = 0;
     p_term **put_ptr = 0;
+    p_exec_code_node *node;
+    int bind_flags;
+
+#if defined(P_INST_THREADED)
+    /* Handler offsets for each opcode.  Opcodes that do not have
+     * a handler are given an offset of zero, which will fail */
+    static const int offsets[P_OP_END + 1] = {
+        [P_OP_PUT_X_VARIABLE] = P_INST_LABEL(P_OP_PUT_X_VARIABLE),
+        [P_OP_PUT_X_VARIABLE2] = P_INST_LABEL(P_OP_PUT_X_VARIABLE2),
+        [P_OP_PUT_X_VARIABLE2 + 1] = P_INST_LABEL_LARGE(P_OP_PUT_X_VARIABLE2),
+        [P_OP_PUT_Y_VARIABLE2] = P_INST_LABEL(P_OP_PUT_Y_VARIABLE2),
+        [P_OP_PUT_Y_VARIABLE2 + 1] = P_INST_LABEL_LARGE(P_OP_PUT_Y_VARIABLE2),
+        [P_OP_PUT_X_VALUE] = P_INST_LABEL(P_OP_PUT_X_VALUE),
+        [P_OP_PUT_X_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_PUT_X_VALUE),
+        [P_OP_PUT_Y_VALUE] = P_INST_LABEL(P_OP_PUT_Y_VALUE),
+        [P_OP_PUT_Y_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_PUT_Y_VALUE),
+        [P_OP_PUT_FUNCTOR] = P_INST_LABEL(P_OP_PUT_FUNCTOR),
+        [P_OP_PUT_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_PUT_FUNCTOR),
+        [P_OP_PUT_LIST] = P_INST_LABEL(P_OP_PUT_LIST),
+        [P_OP_PUT_CONSTANT] = P_INST_LABEL(P_OP_PUT_CONSTANT),
+        [P_OP_PUT_MEMBER_VARIABLE] = P_INST_LABEL(P_OP_PUT_MEMBER_VARIABLE),
+        [P_OP_PUT_MEMBER_VARIABLE + 1] = P_INST_LABEL_LARGE(P_OP_PUT_MEMBER_VARIABLE),
+        [P_OP_PUT_MEMBER_VARIABLE_AUTO] = P_INST_LABEL(P_OP_PUT_MEMBER_VARIABLE_AUTO),
+        [P_OP_PUT_MEMBER_VARIABLE_AUTO + 1] = P_INST_LABEL_LARGE(P_OP_PUT_MEMBER_VARIABLE_AUTO),
+        [P_OP_SET_X_VARIABLE] = P_INST_LABEL(P_OP_SET_X_VARIABLE),
+        [P_OP_SET_Y_VARIABLE] = P_INST_LABEL(P_OP_SET_Y_VARIABLE),
+        [P_OP_SET_X_VALUE] = P_INST_LABEL(P_OP_SET_X_VALUE),
+        [P_OP_SET_Y_VALUE] = P_INST_LABEL(P_OP_SET_Y_VALUE),
+        [P_OP_SET_FUNCTOR] = P_INST_LABEL(P_OP_SET_FUNCTOR),
+        [P_OP_SET_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_SET_FUNCTOR),
+        [P_OP_SET_LIST] = P_INST_LABEL(P_OP_SET_LIST),
+        [P_OP_SET_LIST_TAIL] = P_INST_LABEL(P_OP_SET_LIST_TAIL),
+        [P_OP_SET_NIL_TAIL] = P_INST_LABEL(P_OP_SET_NIL_TAIL),
+        [P_OP_SET_CONSTANT] = P_INST_LABEL(P_OP_SET_CONSTANT),
+        [P_OP_SET_VOID] = P_INST_LABEL(P_OP_SET_VOID),
+        [P_OP_GET_Y_VARIABLE] = P_INST_LABEL(P_OP_GET_Y_VARIABLE),
+        [P_OP_GET_Y_VARIABLE + 1] = P_INST_LABEL_LARGE(P_OP_GET_Y_VARIABLE),
+        [P_OP_GET_X_VALUE] = P_INST_LABEL(P_OP_GET_X_VALUE),
+        [P_OP_GET_X_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_GET_X_VALUE),
+        [P_OP_GET_Y_VALUE] = P_INST_LABEL(P_OP_GET_Y_VALUE),
+        [P_OP_GET_Y_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_GET_Y_VALUE),
+        [P_OP_GET_FUNCTOR] = P_INST_LABEL(P_OP_GET_FUNCTOR),
+        [P_OP_GET_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_GET_FUNCTOR),
+        [P_OP_GET_LIST] = P_INST_LABEL(P_OP_GET_LIST),
+        [P_OP_GET_LIST + 1] = P_INST_LABEL_LARGE(P_OP_GET_LIST),
+        [P_OP_GET_ATOM] = P_INST_LABEL(P_OP_GET_ATOM),
+        [P_OP_GET_CONSTANT] = P_INST_LABEL(P_OP_GET_CONSTANT),
+        [P_OP_GET_IN_X_VALUE] = P_INST_LABEL(P_OP_GET_IN_X_VALUE),
+        [P_OP_GET_IN_X_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_GET_IN_X_VALUE),
+        [P_OP_GET_IN_Y_VALUE] = P_INST_LABEL(P_OP_GET_IN_Y_VALUE),
+        [P_OP_GET_IN_Y_VALUE + 1] = P_INST_LABEL_LARGE(P_OP_GET_IN_Y_VALUE),
+        [P_OP_GET_IN_FUNCTOR] = P_INST_LABEL(P_OP_GET_IN_FUNCTOR),
+        [P_OP_GET_IN_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_GET_IN_FUNCTOR),
+        [P_OP_GET_IN_LIST] = P_INST_LABEL(P_OP_GET_IN_LIST),
+        [P_OP_GET_IN_LIST + 1] = P_INST_LABEL_LARGE(P_OP_GET_IN_LIST),
+        [P_OP_GET_IN_ATOM] = P_INST_LABEL(P_OP_GET_IN_ATOM),
+        [P_OP_GET_IN_CONSTANT] = P_INST_LABEL(P_OP_GET_IN_CONSTANT),
+        [P_OP_UNIFY_X_VARIABLE] = P_INST_LABEL(P_OP_UNIFY_X_VARIABLE),
+        [P_OP_UNIFY_Y_VARIABLE] = P_INST_LABEL(P_OP_UNIFY_Y_VARIABLE),
+        [P_OP_UNIFY_X_VALUE] = P_INST_LABEL(P_OP_UNIFY_X_VALUE),
+        [P_OP_UNIFY_Y_VALUE] = P_INST_LABEL(P_OP_UNIFY_Y_VALUE),
+        [P_OP_UNIFY_FUNCTOR] = P_INST_LABEL(P_OP_UNIFY_FUNCTOR),
+        [P_OP_UNIFY_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_UNIFY_FUNCTOR),
+        [P_OP_UNIFY_LIST] = P_INST_LABEL(P_OP_UNIFY_LIST),
+        [P_OP_UNIFY_LIST_TAIL] = P_INST_LABEL(P_OP_UNIFY_LIST_TAIL),
+        [P_OP_UNIFY_NIL_TAIL] = P_INST_LABEL(P_OP_UNIFY_NIL_TAIL),
+        [P_OP_UNIFY_ATOM] = P_INST_LABEL(P_OP_UNIFY_ATOM),
+        [P_OP_UNIFY_CONSTANT] = P_INST_LABEL(P_OP_UNIFY_CONSTANT),
+        [P_OP_UNIFY_VOID] = P_INST_LABEL(P_OP_UNIFY_VOID),
+        [P_OP_UNIFY_IN_X_VALUE] = P_INST_LABEL(P_OP_UNIFY_IN_X_VALUE),
+        [P_OP_UNIFY_IN_Y_VALUE] = P_INST_LABEL(P_OP_UNIFY_IN_Y_VALUE),
+        [P_OP_UNIFY_IN_FUNCTOR] = P_INST_LABEL(P_OP_UNIFY_IN_FUNCTOR),
+        [P_OP_UNIFY_IN_FUNCTOR + 1] = P_INST_LABEL_LARGE(P_OP_UNIFY_IN_FUNCTOR),
+        [P_OP_UNIFY_IN_LIST] = P_INST_LABEL(P_OP_UNIFY_IN_LIST),
+        [P_OP_UNIFY_IN_LIST_TAIL] = P_INST_LABEL(P_OP_UNIFY_IN_LIST_TAIL),
+        [P_OP_UNIFY_IN_NIL_TAIL] = P_INST_LABEL(P_OP_UNIFY_IN_NIL_TAIL),
+        [P_OP_UNIFY_IN_ATOM] = P_INST_LABEL(P_OP_UNIFY_IN_ATOM),
+        [P_OP_UNIFY_IN_CONSTANT] = P_INST_LABEL(P_OP_UNIFY_IN_CONSTANT),
+        [P_OP_UNIFY_IN_VOID] = P_INST_LABEL(P_OP_UNIFY_IN_VOID),
+        [P_OP_RESET_ARGUMENT] = P_INST_LABEL(P_OP_RESET_ARGUMENT),
+        [P_OP_RESET_ARGUMENT + 1] = P_INST_LABEL_LARGE(P_OP_RESET_ARGUMENT),
+        [P_OP_RESET_TAIL] = P_INST_LABEL(P_OP_RESET_TAIL),
+        [P_OP_JUMP] = P_INST_LABEL(P_OP_JUMP),
+        [P_OP_PROCEED] = P_INST_LABEL(P_OP_PROCEED),
+        [P_OP_FAIL] = P_INST_LABEL(P_OP_FAIL),
+        [P_OP_RETURN] = P_INST_LABEL(P_OP_RETURN),
+        [P_OP_RETURN_TRUE] = P_INST_LABEL(P_OP_RETURN_TRUE),
+        [P_OP_THROW] = P_INST_LABEL(P_OP_THROW),
+        [P_OP_CALL] = P_INST_LABEL(P_OP_CALL),
+        [P_OP_EXECUTE] = P_INST_LABEL(P_OP_EXECUTE),
+        [P_OP_END] = P_INST_LABEL(P_OP_END),
+    };
+    if (!clause) {
+        p_inst_offsets = offsets;
+        return P_RESULT_TRUE;
+    }
+#endif
 
-    inst = (p_inst *)(clause->code->inst);
+    /* Allocate a new environment if starting at the beginning */
+    if (pc) {
+        inst = pc;
+    } else {
+        inst = (p_inst *)(clause->code->inst);
+        if (clause->num_yregs > 0) {
+            yregs = (p_term **)GC_MALLOC
+                (sizeof(p_term *) * clause->num_yregs);
+            if (!yregs)
+                return P_RESULT_FAIL;
+        }
+    }
 
     /* Extend the X register array if this clause needs more */
     xregs = context->xregs;
@@ -77,6 +255,14 @@ p_goal_result _p_code_run
         context->num_xregs = num;
     }
 
+    /* Determine if "get_value" and "unify_value" need to perform
+     * an occurs check.  Instructions that bind a variable to a
+     * freshly created functor, list, or constant never need the
+     * check because the new term cannot contain the variable */
+    bind_flags = clause->bind_flags;
+    if (context->no_occurs_check)
+        bind_flags |= P_BIND_NO_OCCURS_CHECK;
+
     P_INST_START_LOOP
 
     /* put_variable Xn
@@ -276,44 +462,47 @@ p_goal_result _p_code_run
     /* get_variable Xn, Ym
      *      Moves the value in Xn to Yn.  We create an extra variable
      *      shell around the value because Y registers must be vars.
+     *      The value is dereferenced first so that passing a
+     *      variable down through a recursive call does not build
+     *      up an ever-longer chain of shells.
      *      Note: "get_x_variable" is the same as "put_x_value" so
      *      we don't need a special instruction for that */
     P_INST_BEGIN(P_OP_GET_Y_VARIABLE)
         term = p_term_create_variable(context);
-        term->var.value = xregs[inst->two_reg.reg1];
+        term->var.value = p_term_deref(xregs[inst->two_reg.reg1]);
         yregs[inst->two_reg.reg2] = term;
     P_INST_END(two_reg)
     P_INST_BEGIN_LARGE(P_OP_GET_Y_VARIABLE)
         term = p_term_create_variable(context);
-        term->var.value = xregs[inst->large_two_reg.reg1];
+        term->var.value = p_term_deref(xregs[inst->large_two_reg.reg1]);
         yregs[inst->large_two_reg.reg2] = term;
     P_INST_END(large_two_reg)
 
     /* get_value Xn, Xm
      *      Unify the contents of Xn and Xm */
     P_INST_BEGIN(P_OP_GET_X_VALUE)
-        if (!p_term_unify(context, xregs[inst->two_reg.reg1],
-                          xregs[inst->two_reg.reg2], P_BIND_DEFAULT))
+        if (!_p_term_unify_no_undo(context, xregs[inst->two_reg.reg1],
+                          xregs[inst->two_reg.reg2], bind_flags))
             P_INST_FAIL;
     P_INST_END(two_reg)
     P_INST_BEGIN_LARGE(P_OP_GET_X_VALUE)
-        if (!p_term_unify(context, xregs[inst->large_two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, xregs[inst->large_two_reg.reg1],
                           xregs[inst->large_two_reg.reg2],
-                          P_BIND_DEFAULT))
+                          bind_flags))
             P_INST_FAIL;
     P_INST_END(large_two_reg)
 
     /* get_value Yn, Xm
      *      Unify the contents of Yn and Xm */
     P_INST_BEGIN(P_OP_GET_Y_VALUE)
-        if (!p_term_unify(context, yregs[inst->two_reg.reg1],
-                          xregs[inst->two_reg.reg2], P_BIND_DEFAULT))
+        if (!_p_term_unify_no_undo(context, yregs[inst->two_reg.reg1],
+                          xregs[inst->two_reg.reg2], bind_flags))
             P_INST_FAIL;
     P_INST_END(two_reg)
     P_INST_BEGIN_LARGE(P_OP_GET_Y_VALUE)
-        if (!p_term_unify(context, yregs[inst->large_two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, yregs[inst->large_two_reg.reg1],
                           xregs[inst->large_two_reg.reg2],
-                          P_BIND_DEFAULT))
+                          bind_flags))
             P_INST_FAIL;
     P_INST_END(large_two_reg)
 
@@ -329,7 +518,8 @@ p_goal_result _p_code_run
         } else if (term->header.type & P_TERM_VARIABLE) {
             term2 = p_term_create_functor
                 (context, inst->functor.name, inst->functor.arity);
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, term2,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             put_ptr = &(term2->functor.arg[0]);
         } else {
@@ -347,7 +537,8 @@ p_goal_result _p_code_run
             term2 = p_term_create_functor
                 (context, inst->large_functor.name,
                  inst->large_functor.arity);
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, term2,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             put_ptr = &(term2->functor.arg[0]);
         } else {
@@ -365,7 +556,8 @@ p_goal_result _p_code_run
             put_ptr = &(term->list.head);
         } else if (term->header.type & P_TERM_VARIABLE) {
             term2 = p_term_create_list(context, 0, 0);
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, term2,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             xregs[inst->two_reg.reg2] = term2;
             put_ptr = &(term2->list.head);
@@ -380,7 +572,8 @@ p_goal_result _p_code_run
             put_ptr = &(term->list.head);
         } else if (term->header.type & P_TERM_VARIABLE) {
             term2 = p_term_create_list(context, 0, 0);
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, term2,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             xregs[inst->large_two_reg.reg2] = term2;
             put_ptr = &(term2->list.head);
@@ -397,8 +590,8 @@ p_goal_result _p_code_run
             if (term != inst->constant.value)
                 P_INST_FAIL;
         } else if (term->header.type & P_TERM_VARIABLE) {
-            if (!p_term_unify(context, term, inst->constant.value,
-                              P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, inst->constant.value,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
         } else {
             P_INST_FAIL;
@@ -410,9 +603,13 @@ p_goal_result _p_code_run
     P_INST_BEGIN(P_OP_GET_CONSTANT)
         term = p_term_deref_member(context, xregs[inst->constant.reg1]);
         term2 = inst->constant.value;
-        if (term->header.type == term2->header.type ||
-                (term->header.type & P_TERM_VARIABLE) != 0) {
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+        if (term == term2) {
+            /* Atoms and small integers are shared, so the
+             * constant is already matched */
+        } else if (term->header.type == term2->header.type ||
+                   (term->header.type & P_TERM_VARIABLE) != 0) {
+            if (!_p_term_unify_no_undo(context, term, term2,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
         } else {
             P_INST_FAIL;
@@ -423,12 +620,12 @@ p_goal_result _p_code_run
      *      Unify the contents of Xn and Xm, without binding
      *      variables within Xm */
     P_INST_BEGIN(P_OP_GET_IN_X_VALUE)
-        if (!p_term_unify(context, xregs[inst->two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, xregs[inst->two_reg.reg1],
                           xregs[inst->two_reg.reg2], P_BIND_ONE_WAY))
             P_INST_FAIL;
     P_INST_END(two_reg)
     P_INST_BEGIN_LARGE(P_OP_GET_IN_X_VALUE)
-        if (!p_term_unify(context, xregs[inst->large_two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, xregs[inst->large_two_reg.reg1],
                           xregs[inst->large_two_reg.reg2],
                           P_BIND_ONE_WAY))
             P_INST_FAIL;
@@ -438,12 +635,12 @@ p_goal_result _p_code_run
      *      Unify the contents of Yn and Xm, without binding
      *      variables within Xm */
     P_INST_BEGIN(P_OP_GET_IN_Y_VALUE)
-        if (!p_term_unify(context, yregs[inst->two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, yregs[inst->two_reg.reg1],
                           xregs[inst->two_reg.reg2], P_BIND_ONE_WAY))
             P_INST_FAIL;
     P_INST_END(two_reg)
     P_INST_BEGIN_LARGE(P_OP_GET_IN_Y_VALUE)
-        if (!p_term_unify(context, yregs[inst->large_two_reg.reg1],
+        if (!_p_term_unify_no_undo(context, yregs[inst->large_two_reg.reg1],
                           xregs[inst->large_two_reg.reg2],
                           P_BIND_ONE_WAY))
             P_INST_FAIL;
@@ -517,8 +714,10 @@ p_goal_result _p_code_run
     P_INST_BEGIN(P_OP_GET_IN_CONSTANT)
         term = p_term_deref_member(context, xregs[inst->constant.reg1]);
         term2 = inst->constant.value;
-        if (term->header.type == term2->header.type) {
-            if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+        if (term == term2) {
+            /* Shared atom or small integer */
+        } else if (term->header.type == term2->header.type) {
+            if (!_p_term_unify_no_undo(context, term, term2, P_BIND_DEFAULT))
                 P_INST_FAIL;
         } else {
             P_INST_FAIL;
@@ -559,8 +758,8 @@ p_goal_result _p_code_run
         term = *put_ptr;
         if (term) {
             ++put_ptr;
-            if (!p_term_unify(context, term, xregs[inst->one_reg.reg1],
-                              P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, xregs[inst->one_reg.reg1],
+                              bind_flags))
                 P_INST_FAIL;
         } else {
             *put_ptr++ = xregs[inst->one_reg.reg1];
@@ -573,8 +772,8 @@ p_goal_result _p_code_run
         term = *put_ptr;
         if (term) {
             ++put_ptr;
-            if (!p_term_unify(context, term, yregs[inst->one_reg.reg1],
-                              P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, yregs[inst->one_reg.reg1],
+                              bind_flags))
                 P_INST_FAIL;
         } else {
             *put_ptr++ = yregs[inst->one_reg.reg1];
@@ -597,7 +796,8 @@ p_goal_result _p_code_run
             } else if (term->header.type & P_TERM_VARIABLE) {
                 term2 = p_term_create_functor
                     (context, inst->functor.name, inst->functor.arity);
-                if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+                if (!_p_term_unify_no_undo(context, term, term2,
+                                  P_BIND_NO_OCCURS_CHECK))
                     P_INST_FAIL;
                 xregs[inst->functor.reg1] = term2;
                 put_ptr = &(term2->functor.arg[0]);
@@ -626,7 +826,8 @@ p_goal_result _p_code_run
                 term2 = p_term_create_functor
                     (context, inst->large_functor.name,
                      inst->large_functor.arity);
-                if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+                if (!_p_term_unify_no_undo(context, term, term2,
+                                  P_BIND_NO_OCCURS_CHECK))
                     P_INST_FAIL;
                 xregs[inst->large_functor.reg1] = term2;
                 put_ptr = &(term2->functor.arg[0]);
@@ -655,7 +856,8 @@ p_goal_result _p_code_run
                 put_ptr = &(term->list.head);
             } else if (term->header.type & P_TERM_VARIABLE) {
                 term2 = p_term_create_list(context, 0, 0);
-                if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+                if (!_p_term_unify_no_undo(context, term, term2,
+                                  P_BIND_NO_OCCURS_CHECK))
                     P_INST_FAIL;
                 xregs[inst->one_reg.reg1] = term2;
                 put_ptr = &(term2->list.head);
@@ -682,7 +884,8 @@ p_goal_result _p_code_run
                 put_ptr = &(term->list.head);
             } else if (term->header.type & P_TERM_VARIABLE) {
                 term2 = p_term_create_list(context, 0, 0);
-                if (!p_term_unify(context, term, term2, P_BIND_DEFAULT))
+                if (!_p_term_unify_no_undo(context, term, term2,
+                                  P_BIND_NO_OCCURS_CHECK))
                     P_INST_FAIL;
                 xregs[inst->one_reg.reg1] = term2;
                 put_ptr = &(term2->list.head);
@@ -704,8 +907,8 @@ p_goal_result _p_code_run
         if (term->list.tail) {
             term = p_term_deref_member(context, term->list.tail);
             if (term->header.type & P_TERM_VARIABLE) {
-                if (!p_term_unify(context, term, context->nil_atom,
-                                  P_BIND_DEFAULT))
+                if (!_p_term_unify_no_undo(context, term, context->nil_atom,
+                                  P_BIND_NO_OCCURS_CHECK))
                     P_INST_FAIL;
             } else if (term != context->nil_atom) {
                 P_INST_FAIL;
@@ -722,8 +925,8 @@ p_goal_result _p_code_run
         if (term == inst->constant.value) {
             ++put_ptr;
         } else if (term) {
-            if (!p_term_unify(context, term, inst->constant.value,
-                              P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, inst->constant.value,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             ++put_ptr;
         } else {
@@ -736,8 +939,8 @@ p_goal_result _p_code_run
     P_INST_BEGIN(P_OP_UNIFY_CONSTANT)
         term = *put_ptr;
         if (term) {
-            if (!p_term_unify(context, term, inst->constant.value,
-                              P_BIND_DEFAULT))
+            if (!_p_term_unify_no_undo(context, term, inst->constant.value,
+                              P_BIND_NO_OCCURS_CHECK))
                 P_INST_FAIL;
             ++put_ptr;
         } else {
@@ -761,7 +964,7 @@ p_goal_result _p_code_run
      *      without modifying the put pointer's contents */
     P_INST_BEGIN(P_OP_UNIFY_IN_X_VALUE)
         term = *put_ptr++;
-        if (!p_term_unify(context, xregs[inst->one_reg.reg1], term,
+        if (!_p_term_unify_no_undo(context, xregs[inst->one_reg.reg1], term,
                           P_BIND_ONE_WAY))
             P_INST_FAIL;
     P_INST_END(one_reg)
@@ -771,7 +974,7 @@ p_goal_result _p_code_run
      *      without modifying the put pointer's contents */
     P_INST_BEGIN(P_OP_UNIFY_IN_Y_VALUE)
         term = *put_ptr++;
-        if (!p_term_unify(context, yregs[inst->one_reg.reg1], term,
+        if (!_p_term_unify_no_undo(context, yregs[inst->one_reg.reg1], term,
                           P_BIND_ONE_WAY))
             P_INST_FAIL;
     P_INST_END(one_reg)
@@ -860,7 +1063,7 @@ p_goal_result _p_code_run
     P_INST_BEGIN(P_OP_UNIFY_IN_CONSTANT)
         term = p_term_deref_member(context, *put_ptr);
         if (term->header.type == inst->constant.value->header.type) {
-            if (!p_term_unify(context, term, inst->constant.value,
+            if (!_p_term_unify_no_undo(context, term, inst->constant.value,
                               P_BIND_DEFAULT))
                 P_INST_FAIL;
             ++put_ptr;
@@ -903,7 +1106,6 @@ p_goal_result _p_code_run
     /* proceed
      *      Returns from the current predicate and succeeds */
     P_INST_BEGIN(P_OP_PROCEED)
-        /* FIXME */
         return P_RESULT_TRUE;
     P_INST_END_NO_ADVANCE
 
@@ -936,10 +1138,35 @@ p_goal_result _p_code_run
         return P_RESULT_ERROR;
     P_INST_END_NO_ADVANCE
 
-#if 0
-    P_OP_CALL,
-    P_OP_EXECUTE,
+    /* call Xn
+     *      Calls the goal in Xn and then continues with the next
+     *      instruction when the goal succeeds */
+    P_INST_BEGIN(P_OP_CALL)
+        if (!cont)
+            P_INST_FAIL;
+        node = p_exec_new(context, p_exec_code_node);
+        if (!node)
+            P_INST_FAIL;
+        node->parent.goal = context->resume_atom;
+        node->clause = clause;
+        node->pc = (const p_inst *)
+            (((char *)inst) + sizeof(inst->call));
+        node->yregs = yregs;
+        *cont = node;
+        *error = xregs[inst->call.reg1];
+        context->call_cache = (p_call_cache *)&(inst->call.cache);
+        return P_RESULT_CALL_BODY;
+    P_INST_END_NO_ADVANCE
+
+    /* execute Xn
+     *      Executes the goal in Xn as the last goal in the clause */
+    P_INST_BEGIN(P_OP_EXECUTE)
+        *error = xregs[inst->call.reg1];
+        context->call_cache = (p_call_cache *)&(inst->call.cache);
+        return P_RESULT_RETURN_BODY;
+    P_INST_END_NO_ADVANCE
 
+#if 0
     P_OP_TRY_ME_ELSE,
     P_OP_RETRY_ME_ELSE,
     P_OP_TRUST_ME,
@@ -960,4 +1187,91 @@ p_goal_result _p_code_run
     P_INST_END_LOOP
 }
 
+/* Look up a key in a "switch_on_constant" or "switch_on_structure"
+ * table and return the label to jump to */
+static const p_inst *p_code_switch_lookup
+    (const struct p_inst_switch_table *table, const p_rbkey *key)
+{
+    const p_switch_entry *entry;
+    unsigned int hash, posn;
+    if (!table->mask) {
+        entry = table->entries;
+        for (posn = 0; posn < table->num_entries; ++posn, ++entry) {
+            if (_p_rbkey_equal_keys(&(entry->key), key))
+                return entry->label;
+        }
+    } else {
+        hash = _p_rbkey_hash(key);
+        posn = hash & table->mask;
+        while ((entry = &(table->entries[posn]))->label != 0) {
+            if (entry->hash == hash &&
+                    _p_rbkey_equal_keys(&(entry->key), key))
+                return entry->label;
+            posn = (posn + 1) & table->mask;
+        }
+    }
+    return table->default_label;
+}
+
+/* Runs the clause selection code at "inst" against the arguments
+ * of "goal" and returns the null-terminated list of clauses that
+ * should be tried in order, with the length in "count".  Returns
+ * null if no clause can match */
+struct p_term_clause **_p_code_select_clauses
+    (const p_inst *inst, const p_term *goal, unsigned int *count)
+{
+    const p_term *arg;
+    p_rbkey key;
+    while (inst != 0) {
+        switch (p_inst_opcode(inst)) {
+        case P_OP_SWITCH_ON_TERM:
+            /* switch_on_term An, Lvar, Lconstant, Llist, Lstructure
+             *      Jump to a label based on the type of argument An.
+             *      Unusual terms such as objects are treated the same
+             *      as variables, which tries all clauses */
+            arg = p_term_deref
+                (p_term_arg(goal, (int)(inst->switch_on_term.reg1)));
+            switch (arg ? arg->header.type : P_TERM_VARIABLE) {
+            case P_TERM_ATOM:
+            case P_TERM_INTEGER:
+            case P_TERM_REAL:
+            case P_TERM_STRING:
+                inst = inst->switch_on_term.constant_label;
+                break;
+            case P_TERM_LIST:
+                inst = inst->switch_on_term.list_label;
+                break;
+            case P_TERM_FUNCTOR:
+                inst = inst->switch_on_term.structure_label;
+                break;
+            default:
+                inst = inst->switch_on_term.var_label;
+                break;
+            }
+            break;
+
+        case P_OP_SWITCH_ON_CONSTANT:
+        case P_OP_SWITCH_ON_STRUCTURE:
+            /* switch_on_constant An, Table, Ldefault
+             * switch_on_structure An, Table, Ldefault
+             *      Look up the constant or functor in argument An
+             *      and jump to the associated label, or Ldefault */
+            arg = p_term_arg(goal, (int)(inst->switch_table.reg1));
+            if (!_p_rbkey_init(&key, arg))
+                return 0;
+            inst = p_code_switch_lookup(&(inst->switch_table), &key);
+            break;
+
+        case P_OP_TRY_CLAUSES:
+            /* try_clauses Clauses
+             *      Try the listed clauses in order */
+            *count = inst->try_clauses.count;
+            return inst->try_clauses.clauses;
+
+        default: return 0;
+        }
+    }
+    return 0;
+}
+
 /** @endcond */
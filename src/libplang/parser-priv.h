@@ -73,6 +73,18 @@ struct p_input_stream
 #define YY_EXTRA_TYPE p_input_stream *
 #endif
 
+int _p_context_consult_declarations
+    (p_context *context, p_input_stream *stream, int ok);
+int _p_context_import_file
+    (p_context *context, p_input_stream *stream, const char *name);
+
+int _p_context_load_cache
+    (p_context *context, p_input_stream *stream,
+     char **source, size_t *source_len);
+void _p_context_save_cache
+    (p_context *context, p_input_stream *stream,
+     const char *source, size_t source_len);
+
 /** @endcond */
 
 #ifdef __cplusplus
@@ -406,6 +406,15 @@ int p_context_builtin_import(p_context *context, const char *name)
     return p_context_import(0, context, 0, name);
 }
 
+/* Imports "name" relative to the source file for "stream" */
+int _p_context_import_file
+    (p_context *context, p_input_stream *stream, const char *name)
+{
+    YYLTYPE loc;
+    memset(&loc, 0, sizeof(loc));
+    return p_context_import(&loc, context, stream, name);
+}
+
 /* Create the head part of a class member clause */
 static p_term *create_clause_head
     (p_context *context, p_input_stream *stream,
@@ -40,25 +40,16 @@ struct p_rbnode
     unsigned int size : 24;
 #endif
     const p_term *name;
-    union {
-        p_term *value;
-        struct p_term_clause_list clauses;
-    };
+    p_term *value;
     p_rbnode *parent;
     p_rbnode *left;
     p_rbnode *right;
 };
 
-typedef struct p_rbkey p_rbkey;
-struct p_rbkey
-{
-    unsigned int type;
-    unsigned int size;
-    const p_term *name;
-};
-
 int _p_rbkey_init(p_rbkey *key, const p_term *term);
 int _p_rbkey_compare_keys(const p_rbkey *key1, const p_rbkey *key2);
+int _p_rbkey_equal_keys(const p_rbkey *key1, const p_rbkey *key2);
+unsigned int _p_rbkey_hash(const p_rbkey *key);
 
 void _p_rbtree_init(p_rbtree *tree);
 void _p_rbtree_free(p_rbtree *tree);
@@ -81,6 +81,9 @@ P_INLINE int _p_rbkey_compare(const p_rbkey *key, const p_rbnode *node)
     else if (key->type > node->type)
         return 1;
     switch (key->type) {
+    case P_TERM_LIST:
+        /* Lists normally have a null name, but memoised term tries
+         * key lists on their identity, with a size of 1 */
     case P_TERM_FUNCTOR:
         if (key->size < node->size)
             return -1;
@@ -114,6 +117,13 @@ P_INLINE int _p_rbkey_compare(const p_rbkey *key, const p_rbnode *node)
             return 1;
 #endif
         break;
+    case P_TERM_VARIABLE:
+        /* Variables are numbered by the size field in term tries */
+        if (key->size < node->size)
+            return -1;
+        else if (key->size > node->size)
+            return 1;
+        break;
     default: break;
     }
     return 0;
@@ -130,6 +140,71 @@ int _p_rbkey_compare_keys(const p_rbkey *key1, const p_rbkey *key2)
     return _p_rbkey_compare(key1, &node);
 }
 
+/* Determine if two keys are equal.  This is faster than calling
+ * _p_rbkey_compare_keys() when only equality is required */
+int _p_rbkey_equal_keys(const p_rbkey *key1, const p_rbkey *key2)
+{
+    if (key1->type != key2->type || key1->size != key2->size)
+        return 0;
+    if (key1->name == key2->name)
+        return 1;
+    switch (key1->type) {
+    case P_TERM_STRING:
+        return p_term_strcmp(key1->name, key2->name) == 0;
+    case P_TERM_REAL:
+        return key1->name->real.value == key2->name->real.value;
+#if !defined(P_TERM_64BIT)
+    case P_TERM_INTEGER:
+        return key1->name->integer.value == key2->name->integer.value;
+#endif
+    default: break;
+    }
+    return 0;
+}
+
+/* Computes a hash value for a key.  Keys that are equal according
+ * to _p_rbkey_equal_keys() will have the same hash value */
+unsigned int _p_rbkey_hash(const p_rbkey *key)
+{
+    unsigned int hash = key->type * 0x01000193U;
+    switch (key->type) {
+    case P_TERM_STRING: {
+        const unsigned char *name =
+            (const unsigned char *)(key->name->string.name);
+        unsigned int len = key->name->header.size;
+        while (len-- > 0)
+            hash = (hash ^ *name++) * 0x01000193U;
+        break; }
+    case P_TERM_REAL: {
+        /* Hash the bits of the value, with -0.0 the same as 0.0 */
+        double value = key->name->real.value;
+        const unsigned char *bytes = (const unsigned char *)&value;
+        size_t len = sizeof(value);
+        if (value == 0.0)
+            break;
+        while (len-- > 0)
+            hash = (hash ^ *bytes++) * 0x01000193U;
+        break; }
+#if !defined(P_TERM_64BIT)
+    case P_TERM_INTEGER:
+        hash ^= (unsigned int)(key->name->integer.value);
+        break;
+#endif
+    default:
+        hash ^= key->size * 0x9E3779B1U;
+        hash ^= (unsigned int)(((size_t)(key->name)) >> 3);
+        break;
+    }
+
+    /* Mix the bits so that the low bits can be used as a bucket */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
 /* Initialize a red-black tree structure */
 void _p_rbtree_init(p_rbtree *tree)
 {
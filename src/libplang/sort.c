@@ -83,8 +83,7 @@ P_INLINE int p_term_sort_compare
         return cmp;
 }
 
-/* Recursive merge sort within an array.  "Algorithms in C++",
- * Robert Sedgewick, Addison-Wesley, 1992 */
+/* Recursive merge sort within an array */
 static void p_term_sort_section
     (p_context *context, p_term **array, p_term **temp,
      int left, int right, int flags)
@@ -95,15 +94,18 @@ static void p_term_sort_section
     middle = (left + right) / 2;
     p_term_sort_section(context, array, temp, left, middle, flags);
     p_term_sort_section(context, array, temp, middle + 1, right, flags);
-    for (i = middle + 1; i > left; --i)
-        temp[i - 1] = array[i - 1];
-    for (j = middle; j < right; ++j)
-        temp[right + middle - j] = array[j + 1];
+    for (k = left; k <= right; ++k)
+        temp[k] = array[k];
+    i = left;
+    j = middle + 1;
     for (k = left; k <= right; ++k) {
-        if (p_term_sort_compare(context, temp[i], temp[j], flags) <= 0)
+        /* Take from the left half when the keys are equal,
+         * to keep the sort stable */
+        if (j > right || (i <= middle &&
+                p_term_sort_compare(context, temp[i], temp[j], flags) <= 0))
             array[k] = temp[i++];
         else
-            array[k] = temp[j--];
+            array[k] = temp[j++];
     }
 }
 
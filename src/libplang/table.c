@@ -0,0 +1,1045 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+#include <plang/database.h>
+#include <plang/errors.h>
+#include "term-priv.h"
+#include "context-priv.h"
+#include "database-priv.h"
+#include "rbtree-priv.h"
+
+/* Calls to a tabled predicate are looked up by variant in a term
+ * trie that hangs off the predicate's database information.  Each
+ * distinct call pattern has a table that holds the answers found so
+ * far, with a second trie to reject answers that are variants of
+ * answers that are already in the table.
+ *
+ * Tables are evaluated by iterating the predicate's clauses to a
+ * fixpoint.  A call to a table that is still being evaluated returns
+ * the answers found so far instead of running the clauses again,
+ * which is what stops left-recursive definitions from looping.
+ * Tables that consume answers from an older table that is still
+ * being evaluated form part of that table's strongly connected
+ * component, and are not complete until the "leader" of the
+ * component reaches a fixpoint where no table in the component
+ * gained a new answer during a pass.  Tables that don't consume
+ * incomplete answers are complete after a single pass.
+ *
+ * While a table is being evaluated, the predicates and tables that it
+ * calls are recorded.  Asserting or retracting a clause marks the
+ * tables that called the predicate as stale, along with the tables
+ * that called those tables, and so on.  Stale tables are evaluated
+ * again the next time that they are called.  Tables that did not
+ * depend upon the predicate keep their answers.
+ *
+ * Grammar rule nonterminals that are declared with memo_nonterminal/1
+ * are tabled on their input position.  Input lists that were built
+ * without variables can never change, so the call trie keys them on
+ * the identity of the list cell instead of walking the rest of the
+ * input.  Ground lists that were built by binding variables are
+ * replaced with a fixed copy when the nonterminal is called.  The
+ * input, and the remainder of the input in each answer, are shared
+ * with the answers instead of being copied.
+ *
+ * The list cells that are known to be fixed are only remembered
+ * until the next call to a tabled predicate from outside of any
+ * table evaluation, so that parsing many inputs does not hold on
+ * to all of them.  The fixed copies are kept with the tables that
+ * are keyed on them, until abolish_all_tables/0 */
+
+/* Node in a term trie.  The children are keyed on the next symbol
+ * of the term in pre-order, with variables numbered in order of
+ * first occurrence so that variant terms map to the same node */
+struct p_table_trie
+{
+    p_rbtree children;
+    struct p_table *table;              /* Table at the end of a call */
+    int is_leaf;                        /* End of an answer */
+};
+
+typedef enum {
+    P_TABLE_NEW,
+    P_TABLE_EVALUATING,
+    P_TABLE_INCOMPLETE,
+    P_TABLE_COMPLETE
+} p_table_status;
+
+typedef struct p_table_answer p_table_answer;
+struct p_table_answer
+{
+    p_term *answer;
+    p_term *output;                     /* Shared remainder of input */
+    int ground;
+};
+
+typedef struct p_table p_table;
+struct p_table_dep
+{
+    p_table *table;
+    unsigned int generation;            /* Generation of the table */
+    p_table_dep *next;
+};
+
+struct p_table
+{
+    int id;
+    p_database_info *info;
+    p_table_status status;
+    p_table_trie answer_trie;
+    p_table_answer *answers;
+    size_t num_answers;
+    size_t max_answers;
+    size_t dfn;                         /* Position on the table stack */
+    size_t low;                         /* Oldest table depended on */
+    size_t incomplete_mark;             /* Incomplete tables at start */
+    unsigned int iteration;             /* Pass when last evaluated */
+    int recursive;                      /* Consumed incomplete answers */
+    int listed;                         /* On the incomplete list */
+    int saved_changed;
+    unsigned int generation;            /* Incremented when renewed */
+    int stale;                          /* Must be evaluated again */
+    p_table_dep *dependents;            /* Tables that called this one */
+    p_database_info **reads;            /* Predicates that were called */
+    size_t num_reads;
+    size_t max_reads;
+    p_term *answer_list;                /* Answers once complete */
+    int answers_ground;
+    p_term *input;                      /* Shared input of a memo call */
+};
+
+/* Map from variables to their numbers while walking a term trie */
+typedef struct p_table_var_map p_table_var_map;
+struct p_table_var_map
+{
+    p_term **vars;
+    unsigned int count;
+    unsigned int max;
+};
+
+static p_table_trie *p_table_trie_child
+    (p_table_trie *trie, const p_rbkey *key, int create)
+{
+    p_rbnode *node;
+    if (create) {
+        node = _p_rbtree_insert(&(trie->children), key);
+        if (!node)
+            return 0;
+        if (!node->value) {
+            node->value = (p_term *)GC_NEW(p_table_trie);
+            if (!node->value)
+                return 0;
+        }
+    } else {
+        node = _p_rbtree_lookup(&(trie->children), key);
+        if (!node)
+            return 0;
+    }
+    return (p_table_trie *)(node->value);
+}
+
+static unsigned int p_table_var_number
+    (p_table_var_map *map, p_term *var)
+{
+    unsigned int index;
+    for (index = 0; index < map->count; ++index) {
+        if (map->vars[index] == var)
+            return index;
+    }
+    if (map->count >= map->max) {
+        unsigned int max = map->max * 2;
+        p_term **vars;
+        if (max < 16)
+            max = 16;
+        vars = (p_term **)GC_REALLOC(map->vars, max * sizeof(p_term *));
+        if (!vars)
+            return map->count;
+        map->vars = vars;
+        map->max = max;
+    }
+    map->vars[map->count] = var;
+    return (map->count)++;
+}
+
+/* Walks the trie for a term, creating nodes if "create" is set.
+ * Returns null if the term is not in the trie, or if it contains
+ * terms such as objects that cannot be tabled */
+static p_table_trie *p_table_trie_walk
+    (p_context *context, p_table_trie *trie, p_term *term,
+     p_table_var_map *map, int create)
+{
+    p_rbkey key;
+    unsigned int index;
+    for (;;) {
+        term = p_term_deref_member(context, term);
+        if (!term)
+            return 0;
+        if (term->header.type == P_TERM_VARIABLE) {
+            key.type = P_TERM_VARIABLE;
+            key.size = p_table_var_number(map, term);
+            key.name = 0;
+        } else if (!_p_rbkey_init(&key, term)) {
+            return 0;
+        }
+        trie = p_table_trie_child(trie, &key, create);
+        if (!trie)
+            return 0;
+        if (term->header.type == P_TERM_FUNCTOR) {
+            for (index = 0; index < term->header.size - 1; ++index) {
+                trie = p_table_trie_walk
+                    (context, trie, term->functor.arg[index], map, create);
+                if (!trie)
+                    return 0;
+            }
+            term = term->functor.arg[index];
+        } else if (term->header.type == P_TERM_LIST) {
+            trie = p_table_trie_walk
+                (context, trie, term->list.head, map, create);
+            if (!trie)
+                return 0;
+            term = term->list.tail;
+        } else {
+            return trie;
+        }
+    }
+}
+
+/* Determines if a term was built without variables, bound or
+ * unbound.  Such a term can never change, even on backtracking */
+static int p_table_is_fixed(const p_term *term)
+{
+    unsigned int index;
+    for (;;) {
+        if (!term)
+            return 0;
+        switch (term->header.type) {
+        case P_TERM_ATOM:
+        case P_TERM_STRING:
+        case P_TERM_INTEGER:
+        case P_TERM_REAL:
+            return 1;
+        case P_TERM_FUNCTOR:
+            for (index = 0; index < term->header.size - 1; ++index) {
+                if (!p_table_is_fixed(term->functor.arg[index]))
+                    return 0;
+            }
+            term = term->functor.arg[index];
+            break;
+        case P_TERM_LIST:
+            if (!p_table_is_fixed(term->list.head))
+                return 0;
+            term = term->list.tail;
+            break;
+        default:
+            return 0;
+        }
+    }
+}
+
+/* Determines if a list was built without variables.  Every cell
+ * of a fixed list is remembered, so that checking the same list
+ * again at a later position does not walk the rest of the list */
+static int p_table_is_fixed_list(p_context *context, p_term *list)
+{
+    p_term *cell;
+    p_rbnode *node;
+    p_rbkey key;
+    if (!context->table_fixed) {
+        context->table_fixed = GC_NEW(p_rbtree);
+        if (!context->table_fixed)
+            return 0;
+    }
+    key.type = P_TERM_LIST;
+    key.size = 1;
+    for (cell = list; cell && cell->header.type == P_TERM_LIST;
+            cell = cell->list.tail) {
+        key.name = cell;
+        node = _p_rbtree_lookup(context->table_fixed, &key);
+        if (node)
+            break;
+        if (!p_table_is_fixed(cell->list.head))
+            return 0;
+    }
+    if (!cell)
+        return 0;
+    if (cell->header.type != P_TERM_LIST && !p_table_is_fixed(cell))
+        return 0;
+    for (cell = list; cell->header.type == P_TERM_LIST;
+            cell = cell->list.tail) {
+        key.name = cell;
+        node = _p_rbtree_insert(context->table_fixed, &key);
+        if (!node || node->value)
+            break;
+        node->value = cell;
+    }
+    return 1;
+}
+
+/* Gets a fixed copy of a ground list that contains variables.
+ * The copy is remembered so that later calls with the same list
+ * use the same copy, as long as the list has not changed since */
+static p_term *p_table_fixed_copy(p_context *context, p_term *list)
+{
+    p_rbnode *node;
+    p_rbkey key;
+    p_term *copy;
+    key.type = P_TERM_LIST;
+    key.size = 1;
+    key.name = list;
+    if (!context->table_copies) {
+        context->table_copies = GC_NEW(p_rbtree);
+        if (!context->table_copies)
+            return 0;
+    }
+    node = _p_rbtree_lookup(context->table_copies, &key);
+    if (node && p_term_unify(context, list, node->value, P_BIND_EQUALITY))
+        return node->value;
+    if (!p_term_is_ground(list))
+        return 0;
+    copy = p_term_clone(context, list);
+    if (!copy || !p_table_is_fixed_list(context, copy))
+        return 0;
+    node = _p_rbtree_insert(context->table_copies, &key);
+    if (node)
+        node->value = copy;
+    return copy;
+}
+
+/* Determines if an argument of a memoised nonterminal is a fixed
+ * list that can be keyed on its identity and shared with answers */
+static p_term *p_table_shared_arg(p_context *context, p_term *arg)
+{
+    arg = p_term_deref_member(context, arg);
+    if (arg && arg->header.type == P_TERM_LIST &&
+            p_table_is_fixed_list(context, arg))
+        return arg;
+    return 0;
+}
+
+/* Gets the child of a trie node for a fixed list, which is keyed
+ * on the identity of the list cell */
+static p_table_trie *p_table_trie_shared
+    (p_table_trie *trie, const p_term *list, int create)
+{
+    p_rbkey key;
+    key.type = P_TERM_LIST;
+    key.size = 1;
+    key.name = list;
+    return p_table_trie_child(trie, &key, create);
+}
+
+/* Walks the trie for the arguments of a goal.  If "input" or
+ * "output" is not null, then the input or output argument of a
+ * memoised nonterminal is keyed on its identity */
+static p_table_trie *p_table_trie_walk_args
+    (p_context *context, p_table_trie *trie, p_term *goal,
+     p_term *input, p_term *output, int create)
+{
+    p_table_var_map map;
+    unsigned int index;
+    map.vars = 0;
+    map.count = 0;
+    map.max = 0;
+    if (goal->header.type != P_TERM_FUNCTOR)
+        return trie;
+    for (index = 0; index < goal->header.size && trie; ++index) {
+        if (input && index == goal->header.size - 2) {
+            trie = p_table_trie_shared(trie, input, create);
+        } else if (output && index == goal->header.size - 1) {
+            trie = p_table_trie_shared(trie, output, create);
+        } else {
+            trie = p_table_trie_walk
+                (context, trie, goal->functor.arg[index], &map, create);
+        }
+    }
+    return trie;
+}
+
+/* Copies an answer, sharing the input and output lists of a
+ * memoised nonterminal instead of copying them */
+static p_term *p_table_copy_answer
+    (p_context *context, p_term *answer, p_term *input,
+     p_term *output, int *ground)
+{
+    unsigned int size;
+    unsigned int index;
+    p_term *rest;
+    p_term *copy;
+    if (!input) {
+        copy = _p_term_clone_persistent(context, answer);
+        if (ground)
+            *ground = p_term_is_ground(copy);
+        return copy;
+    }
+    size = answer->header.size;
+    rest = p_term_create_functor
+        (context, answer->functor.functor_name, (int)size);
+    for (index = 0; index < size; ++index) {
+        if (index == size - 2 || (output && index == size - 1))
+            p_term_bind_functor_arg(rest, index, context->nil_atom);
+        else
+            p_term_bind_functor_arg(rest, index, answer->functor.arg[index]);
+    }
+    copy = _p_term_clone_persistent(context, rest);
+    if (!copy)
+        return 0;
+    if (ground)
+        *ground = p_term_is_ground(copy);
+    copy->functor.arg[size - 2] = input;
+    if (output)
+        copy->functor.arg[size - 1] = output;
+    return copy;
+}
+
+static int p_table_push
+    (p_table ***array, size_t *size, size_t *max, p_table *table)
+{
+    if (*size >= *max) {
+        size_t new_max = *max * 2;
+        p_table **new_array;
+        if (new_max < 16)
+            new_max = 16;
+        new_array = (p_table **)GC_REALLOC
+            (*array, new_max * sizeof(p_table *));
+        if (!new_array)
+            return 0;
+        *array = new_array;
+        *max = new_max;
+    }
+    (*array)[(*size)++] = table;
+    return 1;
+}
+
+/* Fetches the table that is referred to by a handle */
+static p_table *p_table_from_handle(p_context *context, p_term *handle)
+{
+    int id;
+    handle = p_term_deref_member(context, handle);
+    if (p_term_type(handle) != P_TERM_INTEGER)
+        return 0;
+    id = p_term_integer_value(handle);
+    if (id < 0 || (size_t)id >= context->num_tables)
+        return 0;
+    return context->tables[id];
+}
+
+/* Throws away the answers in a table so that it can be evaluated
+ * again from scratch */
+static void p_table_reset(p_table *table)
+{
+    table->status = P_TABLE_NEW;
+    _p_rbtree_init(&(table->answer_trie.children));
+    table->answers = 0;
+    table->num_answers = 0;
+    table->max_answers = 0;
+    table->recursive = 0;
+    table->listed = 0;
+    table->answer_list = 0;
+}
+
+/* Discards a stale table so that it can be evaluated again.  Entries
+ * in dependency lists that refer to the old generation of the table
+ * are ignored from now on */
+static void p_table_renew(p_table *table)
+{
+    p_table_reset(table);
+    ++(table->generation);
+    table->stale = 0;
+    table->dependents = 0;
+    table->reads = 0;
+    table->num_reads = 0;
+    table->max_reads = 0;
+}
+
+/* Records that "table" depends upon the entity that owns "list" */
+static void p_table_add_dep(p_table_dep **list, p_table *table)
+{
+    p_table_dep *dep;
+    while (*list && (*list)->generation != (*list)->table->generation)
+        *list = (*list)->next;
+    if (*list && (*list)->table == table)
+        return;
+    dep = GC_NEW(p_table_dep);
+    if (!dep)
+        return;
+    dep->table = table;
+    dep->generation = table->generation;
+    dep->next = *list;
+    *list = dep;
+}
+
+/* Marks a table as stale, together with all of the tables that
+ * depend upon it directly or indirectly */
+static void p_table_mark_stale(p_table *table)
+{
+    p_table **stack = 0;
+    size_t top = 0;
+    size_t max = 0;
+    p_table_dep *dep;
+    if (table->stale)
+        return;
+    table->stale = 1;
+    if (!p_table_push(&stack, &top, &max, table))
+        return;
+    while (top > 0) {
+        table = stack[--top];
+        for (dep = table->dependents; dep; dep = dep->next) {
+            if (dep->generation != dep->table->generation ||
+                    dep->table->stale)
+                continue;
+            dep->table->stale = 1;
+            if (!p_table_push(&stack, &top, &max, dep->table))
+                return;
+        }
+        table->dependents = 0;
+    }
+}
+
+/* Records that the table on the top of the table stack called the
+ * predicate described by "info" */
+void _p_table_record_read(p_context *context, p_database_info *info)
+{
+    p_table *table = context->table_stack[context->table_top - 1];
+    size_t index;
+    for (index = 0; index < table->num_reads; ++index) {
+        if (table->reads[index] == info)
+            return;
+    }
+    if (table->num_reads >= table->max_reads) {
+        size_t max = table->max_reads * 2;
+        p_database_info **reads;
+        if (max < 8)
+            max = 8;
+        reads = (p_database_info **)GC_REALLOC
+            (table->reads, max * sizeof(p_database_info *));
+        if (!reads)
+            return;
+        table->reads = reads;
+        table->max_reads = max;
+    }
+    table->reads[(table->num_reads)++] = info;
+    p_table_add_dep(&(info->table_readers), table);
+}
+
+/* Marks the tables that called the predicate described by "info"
+ * as stale after its clauses have been modified */
+void _p_table_invalidate(p_context *context, p_database_info *info)
+{
+    p_table_dep *dep = info->table_readers;
+    info->table_readers = 0;
+    while (dep) {
+        if (dep->generation == dep->table->generation)
+            p_table_mark_stale(dep->table);
+        dep = dep->next;
+    }
+}
+
+/* '$$table_call'(Goal, Table, Status, Call) - looks up the table for
+ * a call to a tabled predicate and determines what to do with it.
+ * Call is the goal to evaluate and return answers for, which differs
+ * from Goal if the input of a memoised nonterminal was copied */
+static p_goal_result p_builtin_table_call
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *goal = p_term_deref_member(context, args[0]);
+    p_database_info *info;
+    p_table_trie *trie;
+    p_table *table;
+    p_table *top;
+    p_term *input = 0;
+    p_term *call = goal;
+    p_term *arg;
+    unsigned int index;
+    const char *status;
+
+    /* Find the table for the call, creating it if necessary */
+    if (goal->header.type == P_TERM_FUNCTOR)
+        info = _p_db_find_arity(goal->functor.functor_name,
+                                goal->header.size);
+    else
+        info = _p_db_find_arity(goal, 0);
+    if (!info)
+        return P_RESULT_FAIL;
+    if (!info->tables) {
+        info->tables = GC_NEW(p_table_trie);
+        if (!info->tables)
+            return P_RESULT_FAIL;
+    }
+    if (!context->table_top) {
+        /* Outermost call, so forget the fixed cells of earlier inputs */
+        context->table_fixed = 0;
+    }
+    if ((info->flags & P_PREDICATE_MEMO) != 0 &&
+            goal->header.type == P_TERM_FUNCTOR && goal->header.size >= 2) {
+        arg = p_term_deref_member
+            (context, goal->functor.arg[goal->header.size - 2]);
+        input = p_table_shared_arg(context, arg);
+        if (!input && arg && arg->header.type == P_TERM_LIST) {
+            /* Evaluate a list that was built with variables using
+             * a fixed copy, so that the nested calls on the rest of
+             * the list will be keyed on the identity of the copy */
+            input = p_table_fixed_copy(context, arg);
+            if (input) {
+                call = p_term_create_functor
+                    (context, goal->functor.functor_name,
+                     (int)(goal->header.size));
+                for (index = 0; index < goal->header.size; ++index) {
+                    p_term_bind_functor_arg
+                        (call, index, goal->functor.arg[index]);
+                }
+                call->functor.arg[goal->header.size - 2] = input;
+            }
+        }
+    }
+    trie = p_table_trie_walk_args(context, info->tables, goal, input, 0, 1);
+    if (!trie) {
+        /* The call can't be tabled, so evaluate it normally */
+        status = "untabled";
+        table = 0;
+    } else {
+        table = trie->table;
+        if (!table) {
+            table = GC_NEW(p_table);
+            if (!table)
+                return P_RESULT_FAIL;
+            table->id = (int)(context->num_tables);
+            table->info = info;
+            table->input = input;
+            if (!p_table_push(&(context->tables), &(context->num_tables),
+                              &(context->max_tables), table))
+                return P_RESULT_FAIL;
+            trie->table = table;
+        } else if (table->stale && (table->status == P_TABLE_COMPLETE ||
+                                    table->status == P_TABLE_NEW)) {
+            p_table_renew(table);
+        }
+        if (context->table_top > 0) {
+            top = context->table_stack[context->table_top - 1];
+            if (top != table)
+                p_table_add_dep(&(table->dependents), top);
+        } else {
+            top = 0;
+        }
+        if (table->status == P_TABLE_COMPLETE) {
+            status = "complete";
+        } else if (table->status == P_TABLE_EVALUATING && top) {
+            /* Recursive call to a table that is being evaluated */
+            if (table->dfn < top->low)
+                top->low = table->dfn;
+            top->recursive = 1;
+            status = "consume";
+        } else if (table->status == P_TABLE_INCOMPLETE && top &&
+                   table->iteration == context->table_iteration) {
+            /* Already evaluated during this pass of its leader */
+            if (table->low < top->low)
+                top->low = table->low;
+            top->recursive = 1;
+            status = "consume";
+        } else {
+            status = "evaluate";
+        }
+    }
+
+    /* Return the table handle and status to the caller */
+    if (table && !p_term_unify
+            (context, args[1],
+             p_term_create_integer(context, table->id), P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    if (!p_term_unify(context, args[2],
+                      p_term_create_atom(context, status), P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    if (!p_term_unify(context, args[3], call, P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    return P_RESULT_TRUE;
+}
+
+/* '$$table_begin'(Table) - starts a pass over a table's clauses */
+static p_goal_result p_builtin_table_begin
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    if (!table)
+        return P_RESULT_FAIL;
+    table->status = P_TABLE_EVALUATING;
+    table->dfn = context->table_top;
+    table->low = table->dfn;
+    table->incomplete_mark = context->num_incomplete;
+    table->iteration = context->table_iteration;
+    table->recursive = 0;
+    table->saved_changed = context->table_changed;
+    context->table_changed = 0;
+    if (!p_table_push(&(context->table_stack), &(context->table_top),
+                      &(context->table_max), table))
+        return P_RESULT_FAIL;
+    return P_RESULT_TRUE;
+}
+
+/* '$$table_add'(Table, Answer) - adds an answer to a table */
+static p_goal_result p_builtin_table_add
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    p_term *answer = p_term_deref_member(context, args[1]);
+    p_table_answer *answers;
+    p_table_trie *trie;
+    p_term *output = 0;
+    if (!table)
+        return P_RESULT_FAIL;
+    if (table->input) {
+        output = p_table_shared_arg
+            (context, answer->functor.arg[answer->header.size - 1]);
+    }
+    trie = p_table_trie_walk_args
+        (context, &(table->answer_trie), answer, table->input, output, 1);
+    if (!trie || trie->is_leaf)
+        return P_RESULT_TRUE;
+    if (table->num_answers >= table->max_answers) {
+        size_t max = table->max_answers * 2;
+        if (max < 16)
+            max = 16;
+        answers = (p_table_answer *)GC_REALLOC
+            (table->answers, max * sizeof(p_table_answer));
+        if (!answers)
+            return P_RESULT_FAIL;
+        table->answers = answers;
+        table->max_answers = max;
+    }
+    answers = &(table->answers[(table->num_answers)++]);
+    answers->answer = p_table_copy_answer
+        (context, answer, table->input, output, &(answers->ground));
+    answers->output = output;
+    trie->is_leaf = 1;
+    context->table_changed = 1;
+    return P_RESULT_TRUE;
+}
+
+/* '$$table_end'(Table, Done) - ends a pass over a table's clauses
+ * and determines if another pass is required */
+static p_goal_result p_builtin_table_end
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    p_table *parent;
+    p_table *member;
+    int done = 1;
+    if (!table || !context->table_top ||
+            context->table_stack[context->table_top - 1] != table)
+        return P_RESULT_FAIL;
+    if (table->low < table->dfn) {
+        /* The table depends upon an older table that is still being
+         * evaluated, so it is incomplete until that table completes */
+        --(context->table_top);
+        table->status = P_TABLE_INCOMPLETE;
+        table->iteration = context->table_iteration;
+        if (!table->listed) {
+            if (!p_table_push(&(context->table_incomplete),
+                              &(context->num_incomplete),
+                              &(context->max_incomplete), table))
+                return P_RESULT_FAIL;
+            table->listed = 1;
+        }
+        parent = context->table_stack[context->table_top - 1];
+        if (table->low < parent->low)
+            parent->low = table->low;
+        parent->recursive = 1;
+        context->table_changed |= table->saved_changed;
+    } else if (table->recursive && context->table_changed) {
+        /* New answers were found, so go around again */
+        table->iteration = ++(context->table_iteration);
+        table->recursive = 0;
+        context->table_changed = 0;
+        done = 0;
+    } else {
+        /* The table and the tables that depend upon it are complete */
+        --(context->table_top);
+        table->status = P_TABLE_COMPLETE;
+        while (context->num_incomplete > table->incomplete_mark) {
+            member = context->table_incomplete
+                [--(context->num_incomplete)];
+            member->status = P_TABLE_COMPLETE;
+            member->listed = 0;
+        }
+        context->table_changed = table->saved_changed;
+    }
+    if (p_term_unify(context, args[1],
+                     done ? context->true_atom : context->fail_atom,
+                     P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* '$$table_abandon'(Table) - abandons the evaluation of a table,
+ * and the tables that depend upon it, after an error */
+static p_goal_result p_builtin_table_abandon
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    if (!table || table->status != P_TABLE_EVALUATING ||
+            table->dfn >= context->table_top ||
+            context->table_stack[table->dfn] != table)
+        return P_RESULT_TRUE;
+    while (context->table_top > table->dfn)
+        p_table_reset(context->table_stack[--(context->table_top)]);
+    while (context->num_incomplete > table->incomplete_mark) {
+        p_table_reset(context->table_incomplete
+            [--(context->num_incomplete)]);
+    }
+    context->table_changed = table->saved_changed;
+    return P_RESULT_TRUE;
+}
+
+/* '$$table_answer'(Table, Index, Answer) - fetches an answer */
+static p_goal_result p_builtin_table_answer
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    p_term *index = p_term_deref_member(context, args[1]);
+    p_table_answer *answer;
+    int posn;
+    if (!table || p_term_type(index) != P_TERM_INTEGER)
+        return P_RESULT_FAIL;
+    posn = p_term_integer_value(index);
+    if (posn < 0 || (size_t)posn >= table->num_answers)
+        return P_RESULT_FAIL;
+    answer = &(table->answers[posn]);
+    if (p_term_unify(context, args[2],
+                     answer->ground ? answer->answer
+                        : p_table_copy_answer
+                            (context, answer->answer, table->input,
+                             answer->output, 0),
+                     P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* '$$table_answer_list'(Table, List, Ground) - fetches the answers
+ * in a complete table as a list, which remains valid even if the
+ * table is evaluated again later.  Fails if the table is not complete */
+static p_goal_result p_builtin_table_answer_list
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    p_term *list;
+    size_t index;
+    if (!table || table->status != P_TABLE_COMPLETE)
+        return P_RESULT_FAIL;
+    if (!table->answer_list) {
+        list = context->nil_atom;
+        table->answers_ground = 1;
+        for (index = table->num_answers; index > 0; --index) {
+            list = p_term_create_list
+                (context, table->answers[index - 1].answer, list);
+            if (!table->answers[index - 1].ground)
+                table->answers_ground = 0;
+        }
+        table->answer_list = list;
+    }
+    if (!p_term_unify(context, args[1], table->answer_list, P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    if (!p_term_unify(context, args[2],
+                      table->answers_ground ? context->true_atom
+                                            : context->fail_atom,
+                      P_BIND_DEFAULT))
+        return P_RESULT_FAIL;
+    return P_RESULT_TRUE;
+}
+
+/* '$$table_rename'(Table, Answer, Copy) - renames the variables
+ * in an answer from the answer list of a table */
+static p_goal_result p_builtin_table_rename
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_table *table = p_table_from_handle(context, args[0]);
+    p_term *answer = p_term_deref_member(context, args[1]);
+    p_term *output;
+    p_term *copy;
+    if (table && table->input) {
+        output = p_table_shared_arg
+            (context, answer->functor.arg[answer->header.size - 1]);
+        copy = p_table_copy_answer
+            (context, answer, table->input, output, 0);
+    } else {
+        copy = p_term_clone(context, answer);
+    }
+    if (p_term_unify(context, args[2], copy, P_BIND_DEFAULT))
+        return P_RESULT_TRUE;
+    else
+        return P_RESULT_FAIL;
+}
+
+/* '$$tabled_clauses'(Goal) - calls the clauses of a tabled predicate
+ * directly, bypassing the tables */
+static p_goal_result p_builtin_tabled_clauses
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *goal = p_term_deref_member(context, args[0]);
+    p_database_info *info;
+    p_term_clause_iter clause_iter;
+    if (goal->header.type == P_TERM_FUNCTOR)
+        info = _p_db_find_arity(goal->functor.functor_name,
+                                goal->header.size);
+    else
+        info = _p_db_find_arity(goal, 0);
+    if (!info)
+        return P_RESULT_FAIL;
+    if (context->table_top > 0)
+        _p_table_record_read(context, info);
+    if (!info->predicate)
+        return P_RESULT_FAIL;
+    if (info->predicate->predicate.lazy_clauses)
+        _p_term_compile_clauses(context, info->predicate);
+    p_term_clauses_begin(info->predicate, goal, &clause_iter);
+    return _p_context_call_clauses(context, goal, &clause_iter);
+}
+
+/**
+ * \addtogroup clause_handling
+ * <hr>
+ * \anchor abolish_all_tables_0
+ * <b>abolish_all_tables/0</b> - removes all answer tables.
+ *
+ * \par Usage
+ * \b abolish_all_tables()
+ *
+ * \par Description
+ * Removes the answer tables of all predicates that were declared
+ * with \ref table_1 "table/1".  The answers will be computed
+ * again the next time that the predicates are called.
+ *
+ * \par Errors
+ *
+ * \li <tt>permission_error(modify, table, abolish_all_tables/0)</tt> -
+ *     a table is currently being evaluated.
+ *
+ * \par Compatibility
+ * \ref swi_prolog "SWI-Prolog".
+ *
+ * \par See Also
+ * \ref table_1 "table/1"
+ */
+static p_goal_result p_builtin_abolish_all_tables
+    (p_context *context, p_term **args, p_term **error)
+{
+    p_term *pred;
+    size_t index;
+    if (context->table_top > 0) {
+        pred = p_term_create_functor(context, context->slash_atom, 2);
+        p_term_bind_functor_arg
+            (pred, 0, p_term_create_atom(context, "abolish_all_tables"));
+        p_term_bind_functor_arg(pred, 1, p_term_create_integer(context, 0));
+        *error = p_create_permission_error(context, "modify", "table", pred);
+        return P_RESULT_ERROR;
+    }
+    for (index = 0; index < context->num_tables; ++index) {
+        /* Handles are not reused, so that stale handles that are
+         * held by callers that are still returning answers from
+         * the old tables will not refer to the new tables */
+        if (context->tables[index]) {
+            context->tables[index]->info->tables = 0;
+            context->tables[index]->info->table_readers = 0;
+            context->tables[index] = 0;
+        }
+    }
+    context->table_fixed = 0;
+    context->table_copies = 0;
+    context->num_incomplete = 0;
+    return P_RESULT_TRUE;
+}
+
+static char const p_builtin_tabled_call[] =
+    "'$$tabled_call'(Goal)\n"
+    "{\n"
+    "    '$$table_call'(Goal, Table, Status, Call);\n"
+    "    if (Status == complete) {\n"
+    "        '$$table_return'(Table, Call);\n"
+    "    } else if (Status == consume) {\n"
+    "        '$$table_answers'(Table, Call, 0);\n"
+    "    } else if (Status == evaluate) {\n"
+    "        '$$table_begin'(Table);\n"
+    "        catch('$$table_fixpoint'(Table, Call), Error,\n"
+    "              ('$$table_abandon'(Table), throw(Error)));\n"
+    "        '$$table_return'(Table, Call);\n"
+    "    } else {\n"
+    "        '$$tabled_clauses'(Goal);\n"
+    "    }\n"
+    "}\n"
+    "'$$table_return'(Table, Goal)\n"
+    "{\n"
+    "    if ('$$table_answer_list'(Table, Answers, Ground)) {\n"
+    "        if (Ground == true)\n"
+    "            '$$table_member'(Goal, Answers);\n"
+    "        else\n"
+    "            '$$table_copy_member'(Table, Goal, Answers);\n"
+    "    } else {\n"
+    "        '$$table_answers'(Table, Goal, 0);\n"
+    "    }\n"
+    "}\n"
+    "'$$table_fixpoint'(Table, Goal)\n"
+    "{\n"
+    "    ('$$table_solve'(Table, Goal) || true);\n"
+    "    '$$table_end'(Table, Done);\n"
+    "    if (Done == fail)\n"
+    "        '$$table_fixpoint'(Table, Goal);\n"
+    "}\n"
+    "'$$table_solve'(Table, Goal)\n"
+    "{\n"
+    "    '$$tabled_clauses'(Goal);\n"
+    "    '$$table_add'(Table, Goal);\n"
+    "    fail;\n"
+    "}\n"
+    "'$$table_answers'(Table, Goal, Index)\n"
+    "{\n"
+    "    '$$table_answer'(Table, Index, Answer);\n"
+    "    (Goal = Answer || (Next is Index + 1,\n"
+    "                       '$$table_answers'(Table, Goal, Next)));\n"
+    "}\n"
+    "'$$table_member'(Goal, [Goal|_]).\n"
+    "'$$table_member'(Goal, [_|Answers])\n"
+    "{\n"
+    "    '$$table_member'(Goal, Answers);\n"
+    "}\n"
+    "'$$table_copy_member'(Table, Goal, [Answer|Answers])\n"
+    "{\n"
+    "    ('$$table_rename'(Table, Answer, Goal) ||\n"
+    "     '$$table_copy_member'(Table, Goal, Answers));\n"
+    "}\n";
+
+void _p_db_init_table(p_context *context)
+{
+    static struct p_builtin const builtins[] = {
+        {"abolish_all_tables", 0, p_builtin_abolish_all_tables},
+        {"$$table_abandon", 1, p_builtin_table_abandon},
+        {"$$table_add", 2, p_builtin_table_add},
+        {"$$table_answer", 3, p_builtin_table_answer},
+        {"$$table_answer_list", 3, p_builtin_table_answer_list},
+        {"$$table_begin", 1, p_builtin_table_begin},
+        {"$$table_call", 4, p_builtin_table_call},
+        {"$$table_end", 2, p_builtin_table_end},
+        {"$$table_rename", 3, p_builtin_table_rename},
+        {"$$tabled_clauses", 1, p_builtin_tabled_clauses},
+        {0, 0, 0}
+    };
+    static const char * const builtin_sources[] = {
+        p_builtin_tabled_call,
+        0
+    };
+    _p_db_register_builtins(context, builtins);
+    _p_db_register_sources(context, builtin_sources);
+}
@@ -60,6 +60,13 @@ struct p_rbtree
 {
     p_rbnode *root;
 };
+typedef struct p_rbkey p_rbkey;
+struct p_rbkey
+{
+    unsigned int type;
+    unsigned int size;
+    const p_term *name;
+};
 
 struct p_term_header {
 #if defined(P_TERM_64BIT)
@@ -85,13 +92,33 @@ struct p_term_list {
 
 typedef struct p_database_info p_database_info;
 
+/* Older versions of libgc do not have the GC_ prefix on these */
+#if !defined(GC_HIDE_POINTER)
+#define GC_HIDE_POINTER(p)      HIDE_POINTER(p)
+#define GC_REVEAL_POINTER(p)    REVEAL_POINTER(p)
+#endif
+
+/* Entry in the atom table of a context.  The atom pointer is hidden
+ * from the garbage collector so that atoms which are no longer
+ * referenced can be reclaimed, after which the collector clears
+ * the "atom" field to zero.  Atoms that have database information
+ * attached are pinned so that they are never reclaimed */
+struct p_term_atom_link {
+    GC_word atom;                       /* Hidden pointer to the atom */
+    p_term *pinned;
+    struct p_term_atom_link *next;
+};
+
 struct p_term_atom {
     struct p_term_header header;
-    p_term *next;
+    unsigned int hash;                  /* Cached hash of the name */
+    struct p_term_atom_link *link;
     p_database_info *db_info;
     char name[1];
 };
 
+#define p_term_pin_atom(term)   ((term)->atom.link->pinned = (term))
+
 struct p_term_string {
     struct p_term_header header;
     char name[1];
@@ -102,6 +129,23 @@ struct p_term_var {
     p_term *value;
 };
 
+/* The size field of an unnamed variable holds its "age", which is
+ * used to avoid trailing bindings of variables that were created
+ * after the most recent choice point.  Named variables set the
+ * P_TERM_VAR_NAMED bit and hold the length of their name instead.
+ * They are treated as the oldest variables, which is always safe */
+#if defined(P_TERM_64BIT)
+#define P_TERM_VAR_NAMED        0x80000000U
+#else
+#define P_TERM_VAR_NAMED        0x00800000U
+#endif
+#define P_TERM_VAR_MAX_AGE      (P_TERM_VAR_NAMED - 1)
+#define p_term_var_age(term)    \
+    (((term)->header.size & P_TERM_VAR_NAMED) ? 0 : (term)->header.size)
+#define p_term_var_name_length(term)    \
+    (((term)->header.size & P_TERM_VAR_NAMED) ? \
+        ((term)->header.size & ~P_TERM_VAR_NAMED) : 0)
+
 struct p_term_member_var {
     struct p_term_header header;
     p_term *value;
@@ -116,6 +160,13 @@ struct p_term_integer {
 #endif
 };
 
+/* Integers in this range are pre-allocated and shared between
+ * all uses, so that creating them does not allocate memory.
+ * The range covers loop counters and list positions while keeping
+ * the table small (2048 terms) */
+#define P_TERM_SMALL_INT_MIN    (-1024)
+#define P_TERM_SMALL_INT_MAX    1023
+
 struct p_term_real {
     struct p_term_header header;
     double value;
@@ -142,23 +193,89 @@ struct p_term_clause_list
     struct p_term_clause *tail;
 };
 
+/* Argument indexes are built just in time, the first time that
+ * a call arrives with the argument bound.  Each key maps to a bucket
+ * containing the clauses with that key and the clauses with a
+ * variable in the argument, in clause order.  Buckets with more than
+ * P_TERM_INDEX_COMBINE clauses can have indexes of their own on
+ * other arguments, which handles calls with several bound arguments.
+ *
+ * The clause arrays in buckets are replaced rather than modified
+ * in place, except for appending, so that an iteration over an
+ * array is not disturbed by later changes to the predicate */
+typedef struct p_term_index p_term_index;
+typedef struct p_term_index_bucket p_term_index_bucket;
+struct p_term_index_bucket
+{
+    struct p_term_clause **clauses;
+    unsigned int count;
+    unsigned int max;
+    unsigned int num_keyed;             /* Clauses that have the key */
+    p_term_index *sub_indexes;
+};
+
+/* The keys of an index are held in an open-addressing hash table.
+ * When the table fills up, a larger table is allocated and the
+ * entries of the old table are moved across a few at a time on
+ * later insertions, so that asserting a clause never has to pay
+ * for rehashing the whole table at once */
+typedef struct p_term_index_entry p_term_index_entry;
+struct p_term_index_entry
+{
+    p_rbkey key;
+    unsigned int hash;
+    p_term_index_bucket *bucket;        /* Null if the entry is empty */
+};
+typedef struct p_term_index_table p_term_index_table;
+struct p_term_index_table
+{
+    p_term_index_entry *entries;
+    unsigned int size;                  /* Always a power of 2 */
+    unsigned int num_used;              /* Including deleted entries */
+    p_term_index_entry *old_entries;    /* Table being moved from */
+    unsigned int old_size;
+    unsigned int old_posn;              /* Next entry to be moved */
+};
+struct p_term_index
+{
+    p_term_index *next;
+    unsigned int arg;
+    unsigned int depth;                 /* Levels into compound terms */
+    unsigned int poor : 1;              /* Not selective enough */
+    unsigned int num_keys : 31;
+    unsigned int assessed_count;        /* Clauses when built */
+    p_term_index_table keys;
+    p_term_index_bucket var_clauses;
+};
+
+#define P_TERM_INDEX_COMBINE    8
+#define P_TERM_INDEX_MAX_DEPTH  4
+
+/* Arguments that are mostly compound terms with the same functor,
+ * such as node(1), node(2), ..., are indexed on the first argument
+ * of the compound term instead, descending up to "index_depth" levels.
+ * The default depth can be changed with the index_depth/2 directive */
+#define P_TERM_INDEX_SUBTERM_DEPTH  2
+#define P_TERM_INDEX_SUBTERM_MAX    8
+
 struct p_term_predicate {
     struct p_term_header header;
     p_term *name;                       /* Must be an atom */
     struct p_term_clause_list clauses;
-    struct p_term_clause_list var_clauses;
     unsigned int clause_count;
-    unsigned int index_arg : 30;
-    unsigned int is_indexed : 1;
-    unsigned int dont_index : 1;
-    p_rbtree index;
+    unsigned int index_arg;             /* For the switch code */
+    unsigned int index_depth;           /* Maximum sub-term depth */
+    p_term_index *indexes;
+    union p_inst *switch_code;          /* Null if not built yet */
+    unsigned int switch_calls;          /* Calls since last change */
+    unsigned int lazy_clauses;          /* Some clauses not compiled */
 };
 
-#if defined(P_TERM_64BIT)
-#define P_TERM_DEFAULT_CLAUSE_NUM   (((unsigned int)1) << 31)
-#else
-#define P_TERM_DEFAULT_CLAUSE_NUM   (((unsigned int)1) << 23)
-#endif
+/* Clause selection code for a predicate is built once the number
+ * of calls since the clause list last changed exceeds the number
+ * of clauses divided by this value.  Predicates that are modified
+ * between nearly every call will use the index instead */
+#define P_TERM_SWITCH_TRIGGER   4
 
 typedef union p_inst p_inst;
 typedef struct p_code_clause p_code_clause;
@@ -166,17 +283,35 @@ struct p_code_clause
 {
     int num_xregs;
     int num_yregs;
+    int bind_flags;
     struct p_code_block *code;
 };
 
 
+/* Clauses that are consulted from source files are not compiled
+ * until their predicate is first called.  Until then, the clause
+ * holds on to its source term in (:-)/2 form */
 struct p_term_clause {
     struct p_term_header header;
     struct p_term_clause *next_clause;
-    struct p_term_clause *next_index;
+    p_term *source;                     /* Null once compiled */
     p_code_clause clause_code;
+    p_code_clause exec_code;
 };
 
+/* Ground facts are stored as a tuple of their arguments rather
+ * than as compiled code, which is several times smaller and quicker
+ * to match.  The header size of a fact is its number of arguments
+ * plus one, which distinguishes it from a compiled clause */
+struct p_term_fact {
+    struct p_term_header header;
+    struct p_term_clause *next_clause;
+    p_term *arg[1];
+};
+#define p_term_clause_is_fact(clause)   ((clause)->header.size != 0)
+#define p_term_clause_is_lazy(clause)   \
+    (!p_term_clause_is_fact((clause)) && (clause)->source != 0)
+
 struct p_term_database {
     struct p_term_header header;
     p_rbtree predicates;
@@ -207,6 +342,7 @@ union p_term {
     struct p_term_object        object;
     struct p_term_predicate     predicate;
     struct p_term_clause        clause;
+    struct p_term_fact          fact;
     struct p_term_database      database;
     struct p_term_rename        rename;
     struct p_term_register      reg;
@@ -217,6 +353,22 @@ union p_term {
 
 int _p_term_next_utf8(const char *str, size_t len, size_t *size);
 
+int p_term_occurs_in(p_context *context, const p_term *var, const p_term *value);
+int _p_term_unify_no_undo(p_context *context, p_term *term1, p_term *term2, int flags);
+
+int _p_term_clause_key
+    (p_rbkey *key, const struct p_term_clause *clause,
+     unsigned int arg, unsigned int depth);
+int _p_term_unify_fact
+    (p_context *context, p_term *goal,
+     const struct p_term_clause *clause);
+p_term *_p_term_clone_persistent(p_context *context, p_term *term);
+
+p_term *_p_term_create_lazy_clause(p_context *context, p_term *source);
+void _p_term_compile_lazy_clause
+    (p_context *context, struct p_term_clause *clause);
+void _p_term_compile_clauses(p_context *context, p_term *predicate);
+
 int _p_term_retract_clause
     (p_context *context, p_term *predicate,
      struct p_term_clause *clause, p_term *clause2);
@@ -303,6 +303,42 @@ p_term *p_term_create_atom(p_context *context, const char *name)
     return p_term_create_atom_n(context, name, name ? strlen(name) : 0);
 }
 
+/* Doubles the size of the atom hash table on "context".  The links
+ * are moved to their new buckets using the cached hash values,
+ * dropping the links for atoms that have been reclaimed */
+static int p_term_grow_atom_hash(p_context *context)
+{
+    size_t old_size = context->atom_hash_size;
+    size_t new_size = old_size ? old_size * 2 : P_CONTEXT_HASH_SIZE;
+    struct p_term_atom_link **new_hash;
+    struct p_term_atom_link *link;
+    struct p_term_atom_link *next;
+    p_term *atom;
+    size_t index, bucket;
+    new_hash = (struct p_term_atom_link **)GC_MALLOC
+        (new_size * sizeof(struct p_term_atom_link *));
+    if (!new_hash)
+        return 0;
+    for (index = 0; index < old_size; ++index) {
+        link = context->atom_hash[index];
+        while (link != 0) {
+            next = link->next;
+            if (link->atom) {
+                atom = (p_term *)GC_REVEAL_POINTER(link->atom);
+                bucket = atom->atom.hash & (new_size - 1);
+                link->next = new_hash[bucket];
+                new_hash[bucket] = link;
+            } else {
+                --(context->atom_count);
+            }
+            link = next;
+        }
+    }
+    context->atom_hash = new_hash;
+    context->atom_hash_size = new_size;
+    return 1;
+}
+
 /**
  * \brief Creates an atom within \a context with the \a len bytes
  * at \a name as its atom name.
@@ -317,6 +353,11 @@ p_term *p_term_create_atom(p_context *context, const char *name)
  * of terms.  Atoms typically represent identifiers in the program,
  * whereas strings represent human-readable data for the program.
  *
+ * Atoms are reclaimed by the garbage collector once they are no
+ * longer referenced by any term, unless they name a predicate,
+ * operator, or class.  A reclaimed atom will be created afresh
+ * if its name is used again later.
+ *
  * The \a name should be encoded in the UTF-8 character.
  *
  * \ingroup term
@@ -328,36 +369,68 @@ p_term *p_term_create_atom_n(p_context *context, const char *name, size_t len)
     const char *n;
     size_t nlen;
     p_term *atom;
+    struct p_term_atom_link *link;
+    struct p_term_atom_link **prev;
 
-    /* Look for the name in the context's atom hash */
-    hash = 0;
+    /* Hash the name with FNV-1a, followed by a final mix so that
+     * the low bits used to select a bucket depend on every byte */
+    hash = 2166136261U;
     n = name;
     nlen = len;
     while (nlen > 0) {
-        hash = hash * 5 + (((unsigned int)(*n++)) & 0xFF);
+        hash = (hash ^ (((unsigned int)(*n++)) & 0xFF)) * 16777619U;
         --nlen;
     }
-    hash %= P_CONTEXT_HASH_SIZE;
-    atom = context->atom_hash[hash];
-    while (atom != 0) {
-        if (atom->header.size == len &&
-                !memcmp(atom->atom.name, name, len))
-            return atom;
-        atom = atom->atom.next;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+
+    /* Look for the name in the context's atom hash, removing the
+     * links for reclaimed atoms as we go */
+    if (context->atom_hash) {
+        prev = &(context->atom_hash[hash & (context->atom_hash_size - 1)]);
+        while ((link = *prev) != 0) {
+            if (!link->atom) {
+                *prev = link->next;
+                --(context->atom_count);
+                continue;
+            }
+            atom = (p_term *)GC_REVEAL_POINTER(link->atom);
+            if (atom->atom.hash == hash && atom->header.size == len &&
+                    !memcmp(atom->atom.name, name, len))
+                return atom;
+            prev = &(link->next);
+        }
     }
 
+    /* Grow the hash table if it is full */
+    if (context->atom_count >= context->atom_hash_size &&
+            !p_term_grow_atom_hash(context))
+        return 0;
+
     /* Create a new atom and add it to the hash */
     atom = p_term_malloc
         (context, p_term, sizeof(struct p_term_atom) + len);
     if (!atom)
         return 0;
+    link = GC_NEW(struct p_term_atom_link);
+    if (!link)
+        return 0;
     atom->header.type = P_TERM_ATOM;
     atom->header.size = (unsigned int)len;
-    atom->atom.next = context->atom_hash[hash];
+    atom->atom.hash = hash;
+    atom->atom.link = link;
     if (len > 0)
         memcpy(atom->atom.name, name, len);
     atom->atom.name[len] = '\0';
-    context->atom_hash[hash] = atom;
+    link->atom = GC_HIDE_POINTER(atom);
+    GC_general_register_disappearing_link((void **)&(link->atom), atom);
+    hash &= context->atom_hash_size - 1;
+    link->next = context->atom_hash[hash];
+    context->atom_hash[hash] = link;
+    ++(context->atom_count);
     return atom;
 }
 
@@ -439,9 +512,21 @@ p_term *p_term_create_variable(p_context *context)
     if (!term)
         return 0;
     term->header.type = P_TERM_VARIABLE;
+    term->header.size = context->var_age;
     return (p_term *)term;
 }
 
+/* Creates an unbound variable for a new property slot on an object.
+ * The slot is not removed on back-tracking, so the variable is given
+ * the oldest age to ensure that bindings of it are always trailed */
+static p_term *p_term_create_slot_variable(p_context *context)
+{
+    p_term *term = p_term_create_variable(context);
+    if (term)
+        term->header.size = 0;
+    return term;
+}
+
 /**
  * \brief Creates an unbound variable within \a context and associates
  * it with \a name.
@@ -463,7 +548,7 @@ p_term *p_term_create_named_variable(p_context *context, const char *name)
     if (!term)
         return 0;
     term->header.type = P_TERM_VARIABLE;
-    term->header.size = (unsigned int)len;
+    term->header.size = ((unsigned int)len) | P_TERM_VAR_NAMED;
     strcpy((char *)(term + 1), name);
     return (p_term *)term;
 }
@@ -500,19 +585,43 @@ p_term *p_term_create_member_variable(p_context *context, p_term *object, p_term
     return (p_term *)term;
 }
 
+/* Table of pre-allocated small integers.  The table is allocated
+ * as atomic memory so that the garbage collector does not scan it.
+ * Entries are filled in when they are handed out rather than up
+ * front, so that untouched pages of the table are never faulted in */
+static struct p_term_integer *p_term_small_ints = 0;
+
 /**
  * \brief Creates an integer within \a context with the specified
  * \a value.
  *
- * Returns the integer term.
+ * Returns the integer term.  Small integers are shared, so two
+ * calls with the same \a value may return the same term.
  *
  * \ingroup term
  * \sa p_term_create_real(), p_term_integer_value()
  */
 p_term *p_term_create_integer(p_context *context, int value)
 {
-    struct p_term_integer *term =
-        p_term_new(context, struct p_term_integer);
+    struct p_term_integer *term;
+    if (value >= P_TERM_SMALL_INT_MIN && value <= P_TERM_SMALL_INT_MAX) {
+        if (!p_term_small_ints) {
+            p_term_small_ints = (struct p_term_integer *)GC_MALLOC_ATOMIC
+                (sizeof(struct p_term_integer) *
+                 (P_TERM_SMALL_INT_MAX - P_TERM_SMALL_INT_MIN + 1));
+        }
+        if (p_term_small_ints) {
+            term = p_term_small_ints + (value - P_TERM_SMALL_INT_MIN);
+            term->header.type = P_TERM_INTEGER;
+#if defined(P_TERM_64BIT)
+            term->header.size = (unsigned int)value;
+#else
+            term->value = value;
+#endif
+            return (p_term *)term;
+        }
+    }
+    term = p_term_new(context, struct p_term_integer);
     if (!term)
         return 0;
     term->header.type = P_TERM_INTEGER;
@@ -646,7 +755,7 @@ p_term *p_term_deref_member(p_context *context, p_term *term)
     } else if (term->header.size) {
         /* Auto-create the property with an unbound variable slot,
          * and then bind this term to the new variable */
-        value = p_term_create_variable(context);
+        value = p_term_create_slot_variable(context);
         p_term_add_property
             (context, object, term->member_var.name, value);
         p_term_bind_variable(context, term, value, P_BIND_DEFAULT);
@@ -690,7 +799,7 @@ p_term *p_term_deref_own_member(p_context *context, p_term *term)
     } else if (term->header.size) {
         /* Auto-create the property with an unbound variable slot,
          * and then bind this term to the new variable */
-        value = p_term_create_variable(context);
+        value = p_term_create_slot_variable(context);
         p_term_add_property
             (context, object, term->member_var.name, value);
         p_term_bind_variable(context, term, value, P_BIND_DEFAULT);
@@ -766,7 +875,7 @@ const char *p_term_name(const p_term *term)
     case P_TERM_PREDICATE:
         return p_term_name(term->predicate.name);
     case P_TERM_VARIABLE:
-        if (term->header.size > 0)
+        if (term->header.size & P_TERM_VAR_NAMED)
             return (const char *)(&(term->var) + 1);
         break;
     case P_TERM_MEMBER_VARIABLE:
@@ -800,8 +909,9 @@ size_t p_term_name_length(const p_term *term)
         return p_term_name_length(term->predicate.name);
     case P_TERM_ATOM:
     case P_TERM_STRING:
-    case P_TERM_VARIABLE:
         return term->header.size;
+    case P_TERM_VARIABLE:
+        return p_term_var_name_length(term);
     case P_TERM_MEMBER_VARIABLE:
         return p_term_name_length(term->member_var.name);
     default: break;
@@ -906,7 +1016,7 @@ size_t p_term_name_length_utf8(const p_term *term)
         byte_len = term->header.size;
         break;
     case P_TERM_VARIABLE:
-        byte_len = term->header.size;
+        byte_len = p_term_var_name_length(term);
         if (!byte_len)
             return 0;
         name = (const char *)(&(term->var) + 1);
@@ -1487,46 +1597,232 @@ p_term *p_term_create_predicate(p_context *context, p_term *name, int arg_count)
     term->header.type = P_TERM_PREDICATE;
     term->header.size = (unsigned int)arg_count;
     term->name = name;
+    term->index_depth = P_TERM_INDEX_SUBTERM_DEPTH;
     return (p_term *)term;
 }
 
+/* Facts that are nested more deeply than this are compiled
+ * rather than stored as a tuple of their arguments */
+#define P_TERM_FACT_MAX_DEPTH   32
+
+/* Copies "term" for storage in a ground fact, with all bound
+ * variables dereferenced out of the copy.  Returns null if "term"
+ * is not ground.  Objects are not stored in facts because their
+ * properties can change after the fact is asserted */
+static p_term *p_term_fact_arg(p_context *context, p_term *term, int depth)
+{
+    p_term *copy;
+    p_term *arg;
+    p_term *cell;
+    p_term *last;
+    unsigned int index;
+    term = p_term_deref(term);
+    if (!term)
+        return 0;
+    switch (term->header.type) {
+    case P_TERM_ATOM:
+    case P_TERM_STRING:
+    case P_TERM_INTEGER:
+    case P_TERM_REAL:
+        return term;
+    case P_TERM_FUNCTOR:
+        if (depth >= P_TERM_FACT_MAX_DEPTH)
+            break;
+        copy = p_term_create_functor
+            (context, term->functor.functor_name,
+             (int)(term->header.size));
+        if (!copy)
+            break;
+        for (index = 0; index < term->header.size; ++index) {
+            arg = p_term_fact_arg
+                (context, term->functor.arg[index], depth + 1);
+            if (!arg)
+                return 0;
+            copy->functor.arg[index] = arg;
+        }
+        return copy;
+    case P_TERM_LIST:
+        /* Walk along the list rather than recursing on the tail,
+         * so that long lists can be stored */
+        if (depth >= P_TERM_FACT_MAX_DEPTH)
+            break;
+        copy = 0;
+        last = 0;
+        do {
+            arg = p_term_fact_arg(context, term->list.head, depth + 1);
+            if (!arg)
+                return 0;
+            cell = p_term_create_list(context, arg, 0);
+            if (!cell)
+                return 0;
+            if (last)
+                last->list.tail = cell;
+            else
+                copy = cell;
+            last = cell;
+            term = p_term_deref(term->list.tail);
+        } while (term && term->header.type == P_TERM_LIST);
+        arg = p_term_fact_arg(context, term, depth + 1);
+        if (!arg)
+            return 0;
+        last->list.tail = arg;
+        return copy;
+    default: break;
+    }
+    return 0;
+}
+
+/* Creates a ground fact from "head", or returns null if "head"
+ * is not ground and needs to be compiled instead */
+static p_term *p_term_create_fact(p_context *context, p_term *head)
+{
+    struct p_term_fact *term;
+    unsigned int arity, index;
+    head = p_term_deref(head);
+    if (!head)
+        return 0;
+    if (head->header.type == P_TERM_FUNCTOR)
+        arity = head->header.size;
+    else if (head->header.type == P_TERM_ATOM)
+        arity = 0;
+    else
+        return 0;
+    term = p_term_malloc
+        (context, struct p_term_fact,
+         sizeof(struct p_term_fact) +
+            sizeof(p_term *) * (arity > 0 ? arity - 1 : 0));
+    if (!term)
+        return 0;
+    term->header.type = P_TERM_CLAUSE;
+    term->header.size = arity + 1;
+    for (index = 0; index < arity; ++index) {
+        term->arg[index] = p_term_fact_arg
+            (context, head->functor.arg[index], 0);
+        if (!term->arg[index])
+            return 0;
+    }
+    return (p_term *)term;
+}
+
+/* Determine the bind flags for unifying against the head of a
+ * clause.  Head unification skips the occurs check if the predicate
+ * was declared with no_occurs_check/1 before the clause */
+static int p_term_clause_bind_flags(p_context *context, p_term *head)
+{
+    p_term *name = p_term_functor(head);
+    if (!name)
+        name = head;
+    if (p_db_predicate_flags(context, name, p_term_arg_count(head)) &
+            P_PREDICATE_NO_OCCURS_CHECK)
+        return P_BIND_NO_OCCURS_CHECK;
+    return P_BIND_DEFAULT;
+}
+
+/* Compiles the code for matching and executing "clause" */
+static int p_term_compile_clause
+    (p_context *context, struct p_term_clause *clause,
+     p_term *head, p_term *body, int bind_flags)
+{
+    p_code *code = _p_code_new();
+    if (!code)
+        return 0;
+    _p_code_generate_dynamic_clause(context, head, body, code);
+    _p_code_finish(code, &(clause->clause_code));
+
+    /* Compile the body into calls for execution.  Facts can
+     * share the matching code as there is no body to call */
+    if (body == context->true_atom) {
+        clause->exec_code = clause->clause_code;
+    } else {
+        code = _p_code_new();
+        if (!code)
+            return 0;
+        _p_code_generate_clause(context, head, body, code);
+        _p_code_finish(code, &(clause->exec_code));
+    }
+    clause->clause_code.bind_flags = bind_flags;
+    clause->exec_code.bind_flags = bind_flags;
+    return 1;
+}
+
 /**
  * \brief Creates a new clause within \a context with the
  * specified \a head and \a body.
  *
+ * If \a body is \c true and \a head is ground, then the clause
+ * is stored as a tuple of the head arguments rather than being
+ * compiled.
+ *
  * \ingroup term
  * \sa p_term_create_predicate(), p_term_add_clause_first()
  */
 p_term *p_term_create_dynamic_clause(p_context *context, p_term *head, p_term *body)
 {
-    struct p_term_clause *term =
-        p_term_new(context, struct p_term_clause);
-    p_code *code = _p_code_new();
-    if (!term || !code)
+    struct p_term_clause *term;
+    p_term *fact;
+    if (body == context->true_atom) {
+        fact = p_term_create_fact(context, head);
+        if (fact)
+            return fact;
+    }
+    term = p_term_new(context, struct p_term_clause);
+    if (!term)
         return 0;
     term->header.type = P_TERM_CLAUSE;
-    _p_code_generate_dynamic_clause(context, head, body, code);
-    _p_code_finish(code, &(term->clause_code));
+    if (!p_term_compile_clause
+            (context, term, head, body,
+             p_term_clause_bind_flags(context, head)))
+        return 0;
     return (p_term *)term;
 }
 
-/* Add a clause to an indexed clause list */
-P_INLINE void p_term_add_indexed_clause
-    (p_context *context, struct p_term_clause_list *list,
-     struct p_term_clause *clause, int first)
+/* Creates a clause from a consulted "source" term in (:-)/2 form.
+ * Compilation is deferred until the clause's predicate is called,
+ * unless the context has been set to compile eagerly */
+p_term *_p_term_create_lazy_clause(p_context *context, p_term *source)
 {
-    if (!list->head) {
-        list->head = clause;
-        list->tail = clause;
-        clause->next_index = 0;
-    } else if (!first) {
-        list->tail->next_index = clause;
-        clause->next_index = 0;
-        list->tail = clause;
-    } else {
-        clause->next_index = list->head;
-        list->head = clause;
+    struct p_term_clause *term;
+    p_term *head = p_term_arg(source, 0);
+    p_term *body = p_term_arg(source, 1);
+    p_term *fact;
+    if (context->eager_compile)
+        return p_term_create_dynamic_clause(context, head, body);
+    if (body == context->true_atom) {
+        /* Ground facts are cheap to create, so don't defer them */
+        fact = p_term_create_fact(context, head);
+        if (fact)
+            return fact;
+    }
+    term = p_term_new(context, struct p_term_clause);
+    if (!term)
+        return 0;
+    term->header.type = P_TERM_CLAUSE;
+    term->source = source;
+    term->clause_code.bind_flags = p_term_clause_bind_flags(context, head);
+    return (p_term *)term;
+}
+
+/* Compiles a clause that was created by _p_term_create_lazy_clause() */
+void _p_term_compile_lazy_clause
+    (p_context *context, struct p_term_clause *clause)
+{
+    p_term *source = clause->source;
+    if (p_term_compile_clause
+            (context, clause, p_term_arg(source, 0),
+             p_term_arg(source, 1), clause->clause_code.bind_flags))
+        clause->source = 0;
+}
+
+/* Compiles the lazy clauses of "predicate" ahead of its first call */
+void _p_term_compile_clauses(p_context *context, p_term *predicate)
+{
+    struct p_term_clause *clause = predicate->predicate.clauses.head;
+    while (clause != 0) {
+        if (p_term_clause_is_lazy(clause))
+            _p_term_compile_lazy_clause(context, clause);
+        clause = clause->next_clause;
     }
+    predicate->predicate.lazy_clauses = 0;
 }
 
 /* Add a clause to a regular (non-indexed) clause list */
@@ -1548,114 +1844,554 @@ P_INLINE void p_term_add_regular_clause
     }
 }
 
-/* Add a specific clause to a predicate's index */
-static void p_term_index_clause
-    (p_context *context, p_term *predicate,
-     struct p_term_clause *clause, int first)
+/* Marker for entries that have been deleted from an index table */
+static p_term_index_bucket p_term_index_deleted;
+
+#define P_TERM_INDEX_MIN_SIZE   16
+#define P_TERM_INDEX_MOVE_STEP  8
+
+/* Looks for "key" in a list of index table entries */
+static p_term_index_entry *p_term_index_probe
+    (p_term_index_entry *entries, unsigned int size,
+     const p_rbkey *key, unsigned int hash)
 {
-    p_rbkey key;
-    p_rbnode *node;
+    unsigned int mask = size - 1;
+    unsigned int posn = hash & mask;
+    p_term_index_entry *entry;
+    while ((entry = &(entries[posn]))->bucket != 0) {
+        if (entry->hash == hash &&
+                entry->bucket != &p_term_index_deleted &&
+                _p_rbkey_equal_keys(&(entry->key), key))
+            return entry;
+        posn = (posn + 1) & mask;
+    }
+    return 0;
+}
 
-    /* Turn the index argument into a key.  If that isn't possible
-     * (usually because the argument is a variable), then add it
-     * to the list of "variable clauses" */
-    if (!_p_code_argument_key(&key, &(clause->clause_code),
-                              predicate->predicate.index_arg)) {
-        p_term_add_indexed_clause
-            (context, &(predicate->predicate.var_clauses),
-             clause, first);
-        return;
+/* Looks up the bucket for "key" in an index table.  Returns null
+ * if the key is not present */
+static p_term_index_bucket *p_term_index_table_lookup
+    (const p_term_index_table *table, const p_rbkey *key,
+     unsigned int hash)
+{
+    p_term_index_entry *entry;
+    if (!table->size)
+        return 0;
+    entry = p_term_index_probe(table->entries, table->size, key, hash);
+    if (!entry && table->old_entries) {
+        entry = p_term_index_probe
+            (table->old_entries, table->old_size, key, hash);
     }
+    return entry ? entry->bucket : 0;
+}
 
-    /* Add the clause to the list associated with the key */
-    node = _p_rbtree_insert(&(predicate->predicate.index), &key);
-    if (!node)
-        return;
-    p_term_add_indexed_clause(context, &(node->clauses), clause, first);
+/* Adds an entry to an index table, which is assumed to have room */
+static p_term_index_entry *p_term_index_table_add
+    (p_term_index_table *table, const p_rbkey *key, unsigned int hash)
+{
+    unsigned int mask = table->size - 1;
+    unsigned int posn = hash & mask;
+    p_term_index_entry *entry;
+    while ((entry = &(table->entries[posn]))->bucket != 0)
+        posn = (posn + 1) & mask;
+    entry->key = *key;
+    entry->hash = hash;
+    ++(table->num_used);
+    return entry;
 }
 
-/* Add all clauses within a predicate to its index */
-static void p_term_index_all_clauses
-    (p_context *context, p_term *predicate)
+/* Moves up to "count" entries from the old table to the new one */
+static void p_term_index_table_move
+    (p_term_index_table *table, unsigned int count)
 {
-    struct p_term_clause *clause;
-    p_rbkey key;
-    p_rbkey keys[4];
-    unsigned int counts[4];
-    unsigned int arg;
-    unsigned int max_count;
-
-    /* Cannot index arity-0 predicates */
-    if (predicate->header.size == 0) {
-        predicate->predicate.dont_index = 1;
-        return;
+    p_term_index_entry *entry;
+    while (count-- > 0 && table->old_posn < table->old_size) {
+        entry = &(table->old_entries[(table->old_posn)++]);
+        if (entry->bucket && entry->bucket != &p_term_index_deleted) {
+            p_term_index_table_add(table, &(entry->key), entry->hash)
+                ->bucket = entry->bucket;
+            /* Stop visits from seeing the bucket twice */
+            entry->bucket = &p_term_index_deleted;
+        }
     }
+    if (table->old_posn >= table->old_size) {
+        GC_FREE(table->old_entries);
+        table->old_entries = 0;
+        table->old_size = 0;
+        table->old_posn = 0;
+    }
+}
 
-    /* Determine the best argument to use for indexing by counting
-     * the number of key changes in each argument.  The argument
-     * with the most key changes is used for indexing */
-    clause = predicate->predicate.clauses.head;
-    for (arg = 0; arg < 4 && arg < predicate->header.size; ++arg) {
-        if (!_p_code_argument_key
-                (&(keys[arg]), &(clause->clause_code), arg)) {
-            keys[arg].type = P_TERM_VARIABLE;
-            keys[arg].size = 0;
-            keys[arg].name = 0;
+/* Finds or creates the entry for "key" in an index table.  Returns
+ * an entry with a null bucket if the key was not already present */
+static p_term_index_entry *p_term_index_table_insert
+    (p_term_index_table *table, const p_rbkey *key, unsigned int hash,
+     unsigned int num_keys)
+{
+    p_term_index_entry *entry;
+    p_term_index_entry *entries;
+    unsigned int size;
+
+    /* Move some of the entries across from the old table */
+    if (table->old_entries)
+        p_term_index_table_move(table, P_TERM_INDEX_MOVE_STEP);
+
+    /* Is the key already present? */
+    if (table->size) {
+        entry = p_term_index_probe(table->entries, table->size, key, hash);
+        if (entry)
+            return entry;
+    }
+    if (table->old_entries) {
+        entry = p_term_index_probe
+            (table->old_entries, table->old_size, key, hash);
+        if (entry) {
+            /* Move the entry now so that the caller can modify it */
+            p_term_index_table_add(table, key, hash)->bucket =
+                entry->bucket;
+            entry->bucket = &p_term_index_deleted;
+            return p_term_index_probe
+                (table->entries, table->size, key, hash);
         }
-        counts[arg] = 0;
-    }
-    while ((clause = clause->next_clause) != 0) {
-        for (arg = 0; arg < 4 && arg < predicate->header.size; ++arg) {
-            if (!_p_code_argument_key
-                    (&key, &(clause->clause_code), arg)) {
-                key.type = P_TERM_VARIABLE;
-                key.size = 0;
-                key.name = 0;
+    }
+
+    /* Start a new table if the current one is more than 3/4 full.
+     * The new table is sized for the live keys, so deleted entries
+     * are dropped along the way */
+    if ((table->num_used + 1) * 4 > table->size * 3) {
+        if (table->old_entries)
+            p_term_index_table_move(table, table->old_size);
+        size = P_TERM_INDEX_MIN_SIZE;
+        while (size < (num_keys + 1) * 4)
+            size *= 2;
+        entries = (p_term_index_entry *)GC_MALLOC
+            (sizeof(p_term_index_entry) * size);
+        if (!entries)
+            return 0;
+        table->old_entries = table->entries;
+        table->old_size = table->size;
+        table->old_posn = 0;
+        table->entries = entries;
+        table->size = size;
+        table->num_used = 0;
+    }
+    entry = p_term_index_table_add(table, key, hash);
+    entry->bucket = 0;
+    return entry;
+}
+
+/* Removes "key" from an index table */
+static void p_term_index_table_remove
+    (p_term_index_table *table, const p_rbkey *key, unsigned int hash)
+{
+    p_term_index_entry *entry = 0;
+    if (table->size)
+        entry = p_term_index_probe(table->entries, table->size, key, hash);
+    if (!entry && table->old_entries) {
+        entry = p_term_index_probe
+            (table->old_entries, table->old_size, key, hash);
+    }
+    if (entry)
+        entry->bucket = &p_term_index_deleted;
+}
+
+/* Visits all buckets in an index table.  Set "posn" to zero
+ * before the first call.  Returns null at the end */
+static p_term_index_bucket *p_term_index_table_visit
+    (const p_term_index_table *table, unsigned int *posn)
+{
+    p_term_index_entry *entry;
+    while (*posn < table->size + table->old_size) {
+        if (*posn < table->size)
+            entry = &(table->entries[*posn]);
+        else
+            entry = &(table->old_entries[*posn - table->size]);
+        ++(*posn);
+        if (entry->bucket && entry->bucket != &p_term_index_deleted)
+            return entry->bucket;
+    }
+    return 0;
+}
+
+static void p_term_index_insert
+    (p_term_index *index, struct p_term_clause *clause, int first);
+static void p_term_index_remove
+    (p_term_index *index, struct p_term_clause *clause);
+
+/* Inserts a clause at the start or end of an index bucket.  The
+ * clause is also inserted into the bucket's own indexes */
+static void p_term_bucket_insert
+    (p_term_index_bucket *bucket, struct p_term_clause *clause, int first)
+{
+    struct p_term_clause **clauses;
+    p_term_index *index;
+    unsigned int max;
+    if (!first && bucket->count < bucket->max) {
+        /* Append in place, which does not affect iterations
+         * that are in progress over the existing clauses */
+        bucket->clauses[(bucket->count)++] = clause;
+    } else {
+        max = bucket->count < 4 ? 4 : bucket->count * 2;
+        clauses = (struct p_term_clause **)GC_MALLOC
+            (sizeof(struct p_term_clause *) * max);
+        if (!clauses)
+            return;
+        if (first) {
+            clauses[0] = clause;
+            if (bucket->count > 0) {
+                memcpy(clauses + 1, bucket->clauses,
+                       sizeof(struct p_term_clause *) * bucket->count);
             }
-            if (_p_rbkey_compare_keys(&(keys[arg]), &key) != 0) {
-                ++(counts[arg]);
-                keys[arg] = key;
+        } else {
+            if (bucket->count > 0) {
+                memcpy(clauses, bucket->clauses,
+                       sizeof(struct p_term_clause *) * bucket->count);
             }
+            clauses[bucket->count] = clause;
         }
+        bucket->clauses = clauses;
+        bucket->max = max;
+        ++(bucket->count);
+    }
+    for (index = bucket->sub_indexes; index != 0; index = index->next)
+        p_term_index_insert(index, clause, first);
+}
+
+/* Removes a clause from an index bucket and its indexes */
+static void p_term_bucket_remove
+    (p_term_index_bucket *bucket, struct p_term_clause *clause)
+{
+    struct p_term_clause **clauses;
+    p_term_index *index;
+    unsigned int posn;
+    for (posn = 0; posn < bucket->count; ++posn) {
+        if (bucket->clauses[posn] == clause)
+            break;
     }
-    max_count = counts[0];
-    predicate->predicate.index_arg = 0;
-    for (arg = 1; arg < 4 && arg < predicate->header.size; ++arg) {
-        if (counts[arg] > max_count) {
-            max_count = counts[arg];
-            predicate->predicate.index_arg = arg;
+    if (posn >= bucket->count)
+        return;
+    clauses = (struct p_term_clause **)GC_MALLOC
+        (sizeof(struct p_term_clause *) * bucket->max);
+    if (!clauses)
+        return;
+    memcpy(clauses, bucket->clauses,
+           sizeof(struct p_term_clause *) * posn);
+    memcpy(clauses + posn, bucket->clauses + posn + 1,
+           sizeof(struct p_term_clause *) * (bucket->count - posn - 1));
+    bucket->clauses = clauses;
+    --(bucket->count);
+    for (index = bucket->sub_indexes; index != 0; index = index->next)
+        p_term_index_remove(index, clause);
+}
+
+/* Inserts a clause into an argument index */
+static void p_term_index_insert
+    (p_term_index *index, struct p_term_clause *clause, int first)
+{
+    p_term_index_bucket *bucket;
+    p_term_index_entry *entry;
+    p_rbkey key;
+    unsigned int posn;
+
+    /* Poor indexes do not hold any clauses */
+    if (index->poor)
+        return;
+
+    /* Clauses with a variable argument go into every bucket */
+    if (!_p_term_clause_key(&key, clause, index->arg, index->depth)) {
+        p_term_bucket_insert(&(index->var_clauses), clause, first);
+        posn = 0;
+        while ((bucket = p_term_index_table_visit
+                    (&(index->keys), &posn)) != 0)
+            p_term_bucket_insert(bucket, clause, first);
+        return;
+    }
+
+    /* Find or create the bucket for the key.  New buckets start
+     * with all of the variable clauses seen so far */
+    entry = p_term_index_table_insert
+        (&(index->keys), &key, _p_rbkey_hash(&key), index->num_keys);
+    if (!entry)
+        return;
+    bucket = entry->bucket;
+    if (!bucket) {
+        bucket = GC_NEW(p_term_index_bucket);
+        if (!bucket)
+            return;
+        if (index->var_clauses.count > 0) {
+            bucket->max = index->var_clauses.count + 1;
+            bucket->clauses = (struct p_term_clause **)GC_MALLOC
+                (sizeof(struct p_term_clause *) * bucket->max);
+            if (!bucket->clauses)
+                return;
+            memcpy(bucket->clauses, index->var_clauses.clauses,
+                   sizeof(struct p_term_clause *) *
+                        index->var_clauses.count);
+            bucket->count = index->var_clauses.count;
         }
+        entry->bucket = bucket;
+        ++(index->num_keys);
     }
-    if (predicate->predicate.index_arg == 0 &&
-            keys[0].type == P_TERM_VARIABLE && !(counts[arg]) &&
-            predicate->header.size >= 2) {
-        /* Probably a class member predicate.  For some reason the
-         * first argument was chosen for indexing, but the second
-         * is more likely to be what we wanted */
-        predicate->predicate.index_arg = 1;
+    p_term_bucket_insert(bucket, clause, first);
+    ++(bucket->num_keyed);
+}
+
+/* Removes a clause from an argument index */
+static void p_term_index_remove
+    (p_term_index *index, struct p_term_clause *clause)
+{
+    p_term_index_bucket *bucket;
+    p_rbkey key;
+    unsigned int hash, posn;
+    if (index->poor)
+        return;
+    if (!_p_term_clause_key(&key, clause, index->arg, index->depth)) {
+        p_term_bucket_remove(&(index->var_clauses), clause);
+        posn = 0;
+        while ((bucket = p_term_index_table_visit
+                    (&(index->keys), &posn)) != 0)
+            p_term_bucket_remove(bucket, clause);
+        return;
+    }
+    hash = _p_rbkey_hash(&key);
+    bucket = p_term_index_table_lookup(&(index->keys), &key, hash);
+    if (!bucket)
+        return;
+    p_term_bucket_remove(bucket, clause);
+    if (--(bucket->num_keyed) == 0) {
+        /* No clauses have this key any more */
+        p_term_index_table_remove(&(index->keys), &key, hash);
+        --(index->num_keys);
+    }
+}
+
+/* Fills an index on "arg" with the "count" clauses in "clauses",
+ * looking "depth" levels into compound arguments for the keys */
+static void p_term_index_fill
+    (p_term_index *index, struct p_term_clause **clauses,
+     unsigned int count, unsigned int arg, unsigned int depth)
+{
+    unsigned int posn;
+    memset(&(index->keys), 0, sizeof(index->keys));
+    memset(&(index->var_clauses), 0, sizeof(index->var_clauses));
+    index->arg = arg;
+    index->depth = depth;
+    index->poor = 0;
+    index->num_keys = 0;
+    index->assessed_count = count;
+    for (posn = 0; posn < count; ++posn)
+        p_term_index_insert(index, clauses[posn], 0);
+}
+
+/* Determine if an index would be more selective one level deeper.
+ * This is the case if there are several clauses per key on average
+ * and most of the clauses have a compound term as their key */
+static int p_term_index_should_deepen
+    (const p_term_index *index, struct p_term_clause **clauses,
+     unsigned int count)
+{
+    unsigned int posn, compound;
+    p_rbkey key;
+    if (index->num_keys * 2 >= count)
+        return 0;
+    compound = 0;
+    for (posn = 0; posn < count; ++posn) {
+        if (_p_term_clause_key
+                (&key, clauses[posn], index->arg, index->depth) &&
+                key.type == P_TERM_FUNCTOR)
+            ++compound;
     }
+    return compound > count / 2;
+}
+
+/* Builds an index on "arg" for the "count" clauses in "clauses".
+ * If the arguments are mostly compound terms, then the index looks
+ * into them for better keys, up to "max_depth" levels.  If the index
+ * turns out to be poor at selecting clauses, then it is emptied and
+ * marked so that it won't be used */
+static void p_term_index_build
+    (p_term_index *index, struct p_term_clause **clauses,
+     unsigned int count, unsigned int arg, unsigned int max_depth)
+{
+    p_term_index deeper;
+    p_term_index *next = index->next;
+    p_term_index_fill(index, clauses, count, arg, 0);
+    while (index->depth < max_depth &&
+           p_term_index_should_deepen(index, clauses, count)) {
+        memset(&deeper, 0, sizeof(deeper));
+        p_term_index_fill
+            (&deeper, clauses, count, arg, index->depth + 1);
+        if (deeper.num_keys <= index->num_keys)
+            break;
+        *index = deeper;
+        index->next = next;
+    }
+    if (index->num_keys < 2 || index->var_clauses.count > count / 2) {
+        memset(&(index->keys), 0, sizeof(index->keys));
+        memset(&(index->var_clauses), 0, sizeof(index->var_clauses));
+        index->poor = 1;
+        index->num_keys = 0;
+    }
+}
+
+/* Computes the key for looking up "term" in an index that looks
+ * "depth" levels into compound terms.  This must descend in the
+ * same way as _p_code_argument_deep_key() does for clause heads */
+static int p_term_index_key
+    (p_rbkey *key, const p_term *term, unsigned int depth)
+{
+    term = p_term_deref(term);
+    while (depth > 0 && term && term->header.type == P_TERM_FUNCTOR &&
+           term->header.size > 0) {
+        term = p_term_deref(term->functor.arg[0]);
+        --depth;
+    }
+    return _p_rbkey_init(key, term);
+}
+
+/* Extracts the key for argument "arg" of "clause", looking "depth"
+ * levels into compound terms */
+int _p_term_clause_key
+    (p_rbkey *key, const struct p_term_clause *clause,
+     unsigned int arg, unsigned int depth)
+{
+    if (p_term_clause_is_fact(clause)) {
+        return p_term_index_key
+            (key, ((const struct p_term_fact *)clause)->arg[arg], depth);
+    }
+    return _p_code_argument_deep_key
+        (key, &(clause->clause_code), arg, depth);
+}
 
-    /* Add all existing clauses to the index */
+/* Makes an array containing all of the clauses in a predicate */
+static struct p_term_clause **p_term_all_clauses(p_term *predicate)
+{
+    struct p_term_clause **clauses;
+    struct p_term_clause *clause;
+    unsigned int posn = 0;
+    clauses = (struct p_term_clause **)GC_MALLOC
+        (sizeof(struct p_term_clause *) *
+            predicate->predicate.clause_count);
+    if (!clauses)
+        return 0;
     clause = predicate->predicate.clauses.head;
-    while (clause != 0) {
-        p_term_index_clause(context, predicate, clause, 0);
+    while (clause && posn < predicate->predicate.clause_count) {
+        clauses[posn++] = clause;
         clause = clause->next_clause;
     }
+    return clauses;
+}
 
-    /* The predicate is now indexed */
-    predicate->predicate.is_indexed = 1;
+/* Finds or builds the index on "arg" within "list", which indexes
+ * the clauses in "parent", or all clauses of "predicate" if "parent"
+ * is null.  Returns null if the argument is not selective enough
+ * to be worth indexing.  Poor indexes are assessed again once the
+ * number of clauses has doubled since the last time */
+static p_term_index *p_term_index_get
+    (p_term_index **list, p_term *predicate,
+     const p_term_index_bucket *parent, unsigned int arg)
+{
+    p_term_index *index = *list;
+    struct p_term_clause **clauses;
+    unsigned int count;
+    count = parent ? parent->count : predicate->predicate.clause_count;
+    while (index && index->arg != arg)
+        index = index->next;
+    if (index) {
+        if (!index->poor)
+            return index;
+        if (count < index->assessed_count * 2)
+            return 0;
+    } else {
+        index = GC_NEW(p_term_index);
+        if (!index)
+            return 0;
+        index->next = *list;
+        *list = index;
+    }
+    if (parent) {
+        p_term_index_build(index, parent->clauses, count, arg,
+                           predicate->predicate.index_depth);
+    } else {
+        clauses = p_term_all_clauses(predicate);
+        if (!clauses)
+            return 0;
+        p_term_index_build(index, clauses, count, arg,
+                           predicate->predicate.index_depth);
+        GC_FREE(clauses);
+    }
+    return index->poor ? 0 : index;
 }
 
-/* Renumber the clauses on a predicate because the clause number
- * has wrapped around to zero */
-static void p_term_renumber_clauses(p_term *predicate)
+/* Selects the clauses to try for "head" from the argument indexes
+ * of "predicate", improving on the clauses that are already in "iter".
+ * Every bound argument is looked up and the smallest bucket is chosen.
+ * Large buckets are then narrowed down by indexing them on another
+ * bound argument.  The "switch_arg" has already been used to select
+ * the clauses in "iter", so there is no point indexing on it again */
+static void p_term_index_select
+    (p_term *predicate, const p_term *head, int switch_arg,
+     p_term_clause_iter *iter)
 {
-    unsigned int clause_num = P_TERM_DEFAULT_CLAUSE_NUM -
-        predicate->predicate.clause_count / 2;
-    struct p_term_clause *clause = predicate->predicate.clauses.head;
-    while (clause != 0) {
-        clause->header.size = clause_num++;
-        clause = clause->next_clause;
+    p_term_index_bucket *parent = 0;
+    p_term_index_bucket *best = 0;
+    p_term_index **list = &(predicate->predicate.indexes);
+    p_term_index *index;
+    p_term_index_bucket *bucket;
+    unsigned int used[P_TERM_INDEX_MAX_DEPTH];
+    unsigned int depth, arg, posn;
+    unsigned int arity = predicate->header.size;
+    unsigned int best_count;
+    unsigned int best_arg = 0;
+    const p_term *term;
+    p_rbkey key;
+
+    best_count = iter->group ? iter->group_size
+                             : predicate->predicate.clause_count;
+    for (depth = 0; depth < P_TERM_INDEX_MAX_DEPTH; ++depth) {
+        for (arg = 0; arg < arity && best_count > 1; ++arg) {
+            /* Skip arguments that have already been used.  The switch
+             * code only looks at the top level of compound terms, so
+             * an index that looks inside them may do better */
+            term = p_term_deref(p_term_arg(head, (int)arg));
+            if (!term || (term->header.type & P_TERM_VARIABLE) != 0)
+                continue;
+            if (depth == 0 && ((int)arg) == switch_arg &&
+                    term->header.type != P_TERM_FUNCTOR)
+                continue;
+            for (posn = 0; posn < depth; ++posn) {
+                if (used[posn] == arg)
+                    break;
+            }
+            if (posn < depth)
+                continue;
+
+            /* Look up the argument in its index */
+            index = p_term_index_get(list, predicate, parent, arg);
+            if (!index || !p_term_index_key(&key, term, index->depth))
+                continue;
+            bucket = p_term_index_table_lookup
+                (&(index->keys), &key, _p_rbkey_hash(&key));
+            if (!bucket)
+                bucket = &(index->var_clauses);
+            if (bucket->count < best_count) {
+                best = bucket;
+                best_count = bucket->count;
+                best_arg = arg;
+            }
+        }
+        if (best == parent || best_count <= P_TERM_INDEX_COMBINE)
+            break;
+
+        /* Try to narrow down the best bucket on another argument */
+        used[depth] = best_arg;
+        parent = best;
+        list = &(best->sub_indexes);
+    }
+    if (best) {
+        iter->next = 0;
+        iter->group = best_count ? best->clauses : 0;
+        iter->group_size = best_count;
     }
 }
 
@@ -1675,25 +2411,21 @@ static void p_term_renumber_clauses(p_term *predicate)
  */
 void p_term_add_clause_first(p_context *context, p_term *predicate, p_term *clause)
 {
-    unsigned int clause_num;
-    if (predicate->predicate.clauses.head) {
-        struct p_term_clause *first = predicate->predicate.clauses.head;
-        clause_num = first->header.size - 1;
-    } else {
-        clause_num = P_TERM_DEFAULT_CLAUSE_NUM;
-    }
-    clause->header.size = clause_num;
+    p_term_index *index;
     p_term_add_regular_clause
         (context, &(predicate->predicate.clauses), clause, 1);
     ++(predicate->predicate.clause_count);
-    if (!clause->header.size)
-        p_term_renumber_clauses(predicate);
-    if (predicate->predicate.is_indexed) {
-        p_term_index_clause(context, predicate, &(clause->clause), 1);
-    } else if (!(predicate->predicate.dont_index) &&
-               predicate->predicate.clause_count > P_TERM_INDEX_TRIGGER) {
-        p_term_index_all_clauses(context, predicate);
+    predicate->predicate.switch_code = 0;
+    predicate->predicate.switch_calls = 0;
+    if (p_term_clause_is_lazy(&(clause->clause))) {
+        /* The indexes need the compiled code to find the keys */
+        if (predicate->predicate.indexes)
+            _p_term_compile_lazy_clause(context, &(clause->clause));
+        else
+            predicate->predicate.lazy_clauses = 1;
     }
+    for (index = predicate->predicate.indexes; index; index = index->next)
+        p_term_index_insert(index, &(clause->clause), 1);
 }
 
 /**
@@ -1712,25 +2444,21 @@ void p_term_add_clause_first(p_context *context, p_term *predicate, p_term *clau
  */
 void p_term_add_clause_last(p_context *context, p_term *predicate, p_term *clause)
 {
-    unsigned int clause_num;
-    if (predicate->predicate.clauses.tail) {
-        struct p_term_clause *last = predicate->predicate.clauses.tail;
-        clause_num = last->header.size + 1;
-    } else {
-        clause_num = P_TERM_DEFAULT_CLAUSE_NUM;
-    }
-    clause->header.size = clause_num;
+    p_term_index *index;
     p_term_add_regular_clause
         (context, &(predicate->predicate.clauses), clause, 0);
     ++(predicate->predicate.clause_count);
-    if (!clause->header.size)
-        p_term_renumber_clauses(predicate);
-    if (predicate->predicate.is_indexed) {
-        p_term_index_clause(context, predicate, &(clause->clause), 0);
-    } else if (!(predicate->predicate.dont_index) &&
-               predicate->predicate.clause_count > P_TERM_INDEX_TRIGGER) {
-        p_term_index_all_clauses(context, predicate);
+    predicate->predicate.switch_code = 0;
+    predicate->predicate.switch_calls = 0;
+    if (p_term_clause_is_lazy(&(clause->clause))) {
+        /* The indexes need the compiled code to find the keys */
+        if (predicate->predicate.indexes)
+            _p_term_compile_lazy_clause(context, &(clause->clause));
+        else
+            predicate->predicate.lazy_clauses = 1;
     }
+    for (index = predicate->predicate.indexes; index; index = index->next)
+        p_term_index_insert(index, &(clause->clause), 0);
 }
 
 /**
@@ -1763,70 +2491,31 @@ int _p_term_retract_clause
     (p_context *context, p_term *predicate,
      struct p_term_clause *clause, p_term *clause2)
 {
-    p_rbkey key;
-    p_rbnode *node;
+    p_term_index *index;
     p_term *body;
     void *marker;
-    struct p_term_clause_list *list;
-    struct p_term_clause *current;
-    struct p_term_clause *prev;
-
-    /* Compute the key for the index argument */
-    if (!predicate->predicate.is_indexed ||
-            !_p_code_argument_key
-                (&key, &(clause->clause_code),
-                 predicate->predicate.index_arg)) {
-        key.type = P_TERM_VARIABLE;
-        key.size = 0;
-        key.name = 0;
-    }
 
     /* Unify against the clause to see if this is the one we wanted */
     marker = p_context_mark_trail(context);
     body = p_term_unify_clause
         (context, p_term_arg(clause2, 0), (p_term *)clause);
-    if (!body)
+    if (!body) {
+        p_context_backtrack_trail(context, marker);
         return 0;
+    }
     if (!p_term_unify(context, body,
                       p_term_arg(clause2, 1), P_BIND_DEFAULT)) {
         p_context_backtrack_trail(context, marker);
         return 0;
     }
 
-    /* If the predicate is not indexed, then nothing more to do */
-    if (!predicate->predicate.is_indexed)
-        return 1;
+    /* The clause selection code will need to be rebuilt */
+    predicate->predicate.switch_code = 0;
+    predicate->predicate.switch_calls = 0;
 
-    /* Remove the clause from the index list it is a member of */
-    if (key.type != P_TERM_VARIABLE) {
-        node = _p_rbtree_lookup(&(predicate->predicate.index), &key);
-        if (node)
-            list = &(node->clauses);
-        else
-            list = &(predicate->predicate.var_clauses); /* Just in case */
-    } else {
-        list = &(predicate->predicate.var_clauses);
-    }
-    current = list->head;
-    prev = 0;
-    while (current != 0 && current != clause) {
-        prev = current;
-        current = current->next_index;
-    }
-    if (!current)
-        return 1;
-    if (prev) {
-        prev->next_index = current->next_index;
-        if (!current->next_index)
-            list->tail = prev;
-    } else {
-        list->head = current->next_index;
-        if (!(list->head)) {
-            list->tail = 0;
-            if (key.type != P_TERM_VARIABLE)
-                _p_rbtree_remove(&(predicate->predicate.index), &key);
-        }
-    }
+    /* Remove the clause from the argument indexes */
+    for (index = predicate->predicate.indexes; index; index = index->next)
+        p_term_index_remove(index, clause);
     return 1;
 }
 
@@ -1834,9 +2523,12 @@ int _p_term_retract_clause
  * \brief Starts an iteration over the clauses of \a predicate,
  * using \a iter as the iteration control information.
  *
- * If \a head is not null and the \a predicate is indexed,
- * then iterate over the best list of clauses that match \a head
- * according to the index.
+ * If \a head is not null, then iterate over the smallest list
+ * of clauses that may match \a head according to the clause
+ * selection code and the argument indexes of \a predicate.
+ * Indexes are built the first time they are needed.  All clauses
+ * are returned if \a predicate has clauses that were consulted but
+ * not compiled yet.
  *
  * Use p_term_clauses_next() to iterate through the returned list.
  *
@@ -1846,9 +2538,11 @@ int _p_term_retract_clause
  */
 void p_term_clauses_begin(const p_term *predicate, const p_term *head, p_term_clause_iter *iter)
 {
-    iter->next1 = 0;
-    iter->next2 = 0;
-    iter->next3 = 0;
+    p_term *pred;
+    int switch_arg = -1;
+    iter->next = 0;
+    iter->group = 0;
+    iter->group_size = 0;
     if (!predicate)
         return;
     if (predicate->header.type != P_TERM_PREDICATE) {
@@ -1856,21 +2550,36 @@ void p_term_clauses_begin(const p_term *predicate, const p_term *head, p_term_cl
         if (predicate->header.type != P_TERM_PREDICATE)
             return;
     }
-    if (head && predicate->predicate.is_indexed) {
-        p_rbkey key;
-        p_rbnode *node;
-        p_term *arg = p_term_arg(head, predicate->predicate.index_arg);
-        if (_p_rbkey_init(&key, arg)) {
-            node = _p_rbtree_lookup
-                (&(predicate->predicate.index), &key);
-            if (node) {
-                iter->next1 = node->clauses.head;
-                iter->next2 = predicate->predicate.var_clauses.head;
-                return;
-            }
-        }
+    iter->next = predicate->predicate.clauses.head;
+    if (!head || !predicate->predicate.clause_count)
+        return;
+
+    /* Clause selection needs compiled code to find the keys, so
+     * iterate over every clause if some are not compiled yet */
+    if (predicate->predicate.lazy_clauses)
+        return;
+
+    /* Build the clause selection code once the predicate has
+     * been called enough times since it was last modified */
+    pred = (p_term *)predicate;
+    if (!pred->predicate.switch_code &&
+            ++(pred->predicate.switch_calls) >
+                pred->predicate.clause_count / P_TERM_SWITCH_TRIGGER)
+        pred->predicate.switch_code = _p_code_generate_switch(pred);
+    if (pred->predicate.switch_code) {
+        iter->next = 0;
+        iter->group = _p_code_select_clauses
+            (pred->predicate.switch_code, head, &(iter->group_size));
+        if (!(iter->group))
+            iter->group_size = 0;
+        switch_arg = (int)(pred->predicate.index_arg);
     }
-    iter->next3 = predicate->predicate.clauses.head;
+
+    /* Narrow the list down further using the argument indexes */
+    if (pred->predicate.clause_count > P_TERM_INDEX_TRIGGER &&
+            (!(iter->group) || iter->group_size > 1) &&
+            (iter->group || iter->next))
+        p_term_index_select(pred, head, switch_arg, iter);
 }
 
 /**
@@ -1883,22 +2592,14 @@ void p_term_clauses_begin(const p_term *predicate, const p_term *head, p_term_cl
 p_term *p_term_clauses_next(p_term_clause_iter *iter)
 {
     struct p_term_clause *clause;
-    if (iter->next1) {
-        clause = iter->next1;
-        if (iter->next2 && iter->next2->header.size < clause->header.size) {
-            clause = iter->next2;
-            iter->next2 = clause->next_index;
-        } else {
-            iter->next1 = clause->next_index;
-            if (!(iter->next1)) {
-                iter->next1 = iter->next2;
-                iter->next2 = 0;
-            }
-        }
+    if (iter->group) {
+        clause = *(iter->group)++;
+        if (--(iter->group_size) == 0)
+            iter->group = 0;
         return (p_term *)clause;
-    } else if (iter->next3) {
-        clause = iter->next3;
-        iter->next3 = clause->next_clause;
+    } else if (iter->next) {
+        clause = iter->next;
+        iter->next = clause->next_clause;
         return (p_term *)clause;
     }
     return 0;
@@ -1913,7 +2614,7 @@ p_term *p_term_clauses_next(p_term_clause_iter *iter)
  */
 int p_term_clauses_has_more(const p_term_clause_iter *iter)
 {
-    return iter->next1 != 0 || iter->next3 != 0;
+    return iter->group != 0 || iter->next != 0;
 }
 
 /**
@@ -1956,6 +2657,7 @@ void p_term_database_add_predicate(p_term *database, p_term *predicate)
     if (!node)
         return;
     node->value = predicate;
+    ++_p_db_generation;
 }
 
 /**
@@ -2017,41 +2719,129 @@ p_term *p_term_create_member_name
     return result;
 }
 
-/* Perform an occurs check */
-int p_term_occurs_in(const p_term *var, const p_term *value)
+/* Push an entry onto the explicit work stack that is used by the
+ * iterative term traversals below.  Each entry records a functor or
+ * list cell whose children from "index" onwards have not been visited
+ * yet, with "term2" holding the corresponding term on the other side
+ * of a unify or comparison.  The stack belongs to the context and is
+ * reused between calls, so it only needs to be reallocated when a
+ * term is deeper than any that has come before.  Each traversal
+ * remembers the "base" of the stack when it starts and unwinds back
+ * to it, so traversals can safely nest */
+static int p_term_work_push
+    (p_context *context, p_term *term1, p_term *term2,
+     unsigned int index)
 {
-    unsigned int index;
-    if (!value)
+    p_term_work *work;
+    if (context->term_work_top >= context->term_work_max) {
+        size_t max = context->term_work_max * 2;
+        if (max < 64)
+            max = 64;
+        work = (p_term_work *)GC_REALLOC
+            (context->term_work, max * sizeof(p_term_work));
+        if (!work)
+            return 0;
+        context->term_work = work;
+        context->term_work_max = max;
+    }
+    work = &(context->term_work[(context->term_work_top)++]);
+    work->term1 = term1;
+    work->term2 = term2;
+    work->index = index;
+    return 1;
+}
+
+/* Fetch the next child to be visited from the top of the work stack,
+ * or return null if the stack has been unwound to "base".  The entry
+ * is popped when its last child is fetched, so that the last argument
+ * of a functor or the tail of a list is visited without leaving any
+ * state behind for its parent.  The child's index is returned in
+ * "index".  The returned pointer is only valid until the next push */
+P_INLINE p_term_work *p_term_work_next
+    (p_context *context, size_t base, unsigned int *index)
+{
+    p_term_work *work;
+    if (context->term_work_top <= base)
         return 0;
-    value = p_term_deref_non_null(value);
-    if (var == value)
-        return 1;
-    switch (value->header.type) {
-    case P_TERM_FUNCTOR:
-        /* Scan the functor arguments */
-        for (index = 0; index < value->header.size; ++index) {
-            if (p_term_occurs_in(var, value->functor.arg[index]))
-                return 1;
-        }
-        break;
-    case P_TERM_LIST:
-        /* Try to reduce depth of recursion issues with long lists */
-        do {
-            if (p_term_occurs_in(var, value->list.head))
-                return 1;
-            value = value->list.tail;
-            if (!value)
-                return 0;
+    work = &(context->term_work[context->term_work_top - 1]);
+    *index = work->index;
+    if (work->term1->header.type != P_TERM_FUNCTOR ||
+            ++(work->index) >= work->term1->header.size)
+        --(context->term_work_top);
+    return work;
+}
+
+/* Get the child of a functor or list cell with a specific index.
+ * The children of a list cell are its head (0) and tail (1) */
+P_INLINE p_term *p_term_work_child(const p_term *term, unsigned int index)
+{
+    if (term->header.type == P_TERM_FUNCTOR)
+        return term->functor.arg[index];
+    else if (index == 0)
+        return term->list.head;
+    else
+        return term->list.tail;
+}
+
+/* Perform an occurs check.  The arguments of a functor are scanned
+ * from left to right, with the functor on the work stack until its
+ * last argument is reached.  Deep right-recursive terms and long
+ * lists therefore use a constant amount of work stack */
+int p_term_occurs_in(p_context *context, const p_term *var, const p_term *value)
+{
+    size_t base = context->term_work_top;
+    p_term_work *work;
+    const p_term *head;
+    unsigned int index;
+    for (;;) {
+        if (value) {
             value = p_term_deref_non_null(value);
-        } while (value->header.type == P_TERM_LIST);
-        if (value->header.type != P_TERM_ATOM)
-            return p_term_occurs_in(var, value);
-        break;
-    case P_TERM_MEMBER_VARIABLE:
-        return p_term_occurs_in(var, value->member_var.object);
-    default: break;
+            if (var == value)
+                break;
+            switch (value->header.type) {
+            case P_TERM_FUNCTOR:
+                if (value->header.size > 1 &&
+                        !p_term_work_push(context, (p_term *)value, 0, 1))
+                    goto found;
+                value = value->functor.arg[0];
+                continue;
+            case P_TERM_LIST:
+                /* Step over simple list members without using
+                 * the work stack */
+                head = value->list.head;
+                if (head) {
+                    head = p_term_deref_non_null(head);
+                    if (var == head)
+                        goto found;
+                    if (head->header.type == P_TERM_FUNCTOR ||
+                            head->header.type == P_TERM_LIST ||
+                            head->header.type == P_TERM_MEMBER_VARIABLE) {
+                        if (!p_term_work_push
+                                (context, (p_term *)value, 0, 1))
+                            goto found;
+                        value = head;
+                        continue;
+                    }
+                }
+                value = value->list.tail;
+                continue;
+            case P_TERM_MEMBER_VARIABLE:
+                value = value->member_var.object;
+                continue;
+            default: break;
+            }
+        }
+        work = p_term_work_next(context, base, &index);
+        if (!work)
+            return 0;
+        value = p_term_work_child(work->term1, index);
     }
-    return 0;
+
+found:
+    /* Found the variable, or ran out of memory.  Report that the
+     * variable occurs so that the caller will not bind it */
+    context->term_work_top = base;
+    return 1;
 }
 
 /**
@@ -2105,6 +2895,17 @@ int p_term_occurs_in(const p_term *var, const p_term *value)
  * The second term is essentially "frozen".
  */
 
+/* Determine if the binding of "var" must be recorded in the trail.
+ * Variables that are younger than the most recent choice point
+ * will be discarded when backtracking to it, so there is no need
+ * to reset them.  Member variables are always recorded */
+P_INLINE int p_term_must_trail(p_context *context, const p_term *var)
+{
+    if (var->header.type != P_TERM_VARIABLE)
+        return 1;
+    return p_term_var_age(var) < context->trail_age;
+}
+
 /**
  * \brief Binds the variable \a var to \a value.
  *
@@ -2118,6 +2919,9 @@ int p_term_occurs_in(const p_term *var, const p_term *value)
  *
  * If \a flags does not contain P_BIND_NO_RECORD, then the binding
  * will be recorded in \a context for back-tracking purposes.
+ * Bindings of variables that were created after the most recent
+ * call to p_context_mark_trail() are not recorded, as back-tracking
+ * to the marker will discard the variable anyway.
  *
  * \ingroup term
  * \sa p_term_create_variable(), p_term_unify()
@@ -2130,10 +2934,10 @@ int p_term_bind_variable(p_context *context, p_term *var, p_term *value, int fla
     if ((var->header.type & P_TERM_VARIABLE) == 0)
         return 0;
     if ((flags & P_BIND_NO_OCCURS_CHECK) == 0) {
-        if (p_term_occurs_in(var, value))
+        if (p_term_occurs_in(context, var, value))
             return 0;
     }
-    if ((flags & P_BIND_NO_RECORD) == 0) {
+    if ((flags & P_BIND_NO_RECORD) == 0 && p_term_must_trail(context, var)) {
         if (!_p_context_record_in_trail(context, var))
             return 0;
     }
@@ -2145,10 +2949,10 @@ int p_term_bind_variable(p_context *context, p_term *var, p_term *value, int fla
 P_INLINE int p_term_bind_var(p_context *context, p_term *var, p_term *value, int flags)
 {
     if ((flags & P_BIND_NO_OCCURS_CHECK) == 0) {
-        if (p_term_occurs_in(var, value))
+        if (p_term_occurs_in(context, var, value))
             return 0;
     }
-    if ((flags & P_BIND_NO_RECORD) == 0) {
+    if ((flags & P_BIND_NO_RECORD) == 0 && p_term_must_trail(context, var)) {
         if (!_p_context_record_in_trail(context, var))
             return 0;
     }
@@ -2179,7 +2983,7 @@ static p_term *p_term_resolve_member(p_context *context, p_term *term, int flags
     value = p_term_property(context, object, term->member_var.name);
     if (!value && term->header.size && (flags & P_BIND_EQUALITY) == 0) {
         /* Add a new property to the object */
-        value = p_term_create_variable(context);
+        value = p_term_create_slot_variable(context);
         if (!p_term_add_property(context, object,
                                  term->member_var.name, value))
             return 0;
@@ -2210,60 +3014,10 @@ static int p_term_unify_variable(p_context *context, p_term *term1, p_term *term
     return p_term_bind_var(context, term1, term2, flags);
 }
 
-/* Inner implementation of unification */
-static int p_term_unify_inner(p_context *context, p_term *term1, p_term *term2, int flags)
+/* Unify two atomic terms that are not identical and not variables */
+static int p_term_unify_atomic(p_term *term1, p_term *term2)
 {
-    if (!term1 || !term2)
-        return 0;
-    term1 = p_term_deref_non_null(term1);
-    term2 = p_term_deref_non_null(term2);
-    if (term1 == term2)
-        return 1;
-    if (term1->header.type & P_TERM_VARIABLE)
-        return p_term_unify_variable(context, term1, term2, flags);
-    if (term2->header.type & P_TERM_VARIABLE) {
-        if (flags & P_BIND_ONE_WAY)
-            return 0;
-        return p_term_unify_variable
-            (context, term2, term1, flags & ~P_BIND_RECORD_ONE_WAY);
-    }
     switch (term1->header.type) {
-    case P_TERM_FUNCTOR:
-        /* Functor must have the same name and number of arguments */
-        if (term2->header.type == P_TERM_FUNCTOR &&
-                term1->header.size == term2->header.size &&
-                term1->functor.functor_name ==
-                        term2->functor.functor_name) {
-            unsigned int index;
-            for (index = 0; index < term1->header.size; ++index) {
-                if (!p_term_unify_inner
-                        (context, term1->functor.arg[index],
-                         term2->functor.arg[index], flags))
-                    return 0;
-            }
-            return 1;
-        }
-        break;
-    case P_TERM_LIST:
-        /* Unify the head and tail components of the list,
-         * while trying to reduce recursion depth */
-        if (term2->header.type != P_TERM_LIST)
-            return 0;
-        for (;;) {
-            if (!p_term_unify_inner(context, term1->list.head,
-                                    term2->list.head, flags))
-                break;
-            term1 = term1->list.tail;
-            term2 = term2->list.tail;
-            if (!term1 || !term2)
-                break;
-            term1 = p_term_deref_non_null(term1);
-            term2 = p_term_deref_non_null(term2);
-            if (term1->header.type != P_TERM_LIST ||
-                    term2->header.type != P_TERM_LIST)
-                return p_term_unify_inner(context, term1, term2, flags);
-        }
-        break;
     case P_TERM_ATOM:
         /* Atoms can unify only if their pointers are identical.
          * Identity has already been checked, so fail */
@@ -2305,6 +3059,69 @@ static int p_term_unify_inner(p_context *context, p_term *term1, p_term *term2,
     return 0;
 }
 
+/* Inner implementation of unification.  Pairs of functor arguments
+ * and list tails that still need to be unified are kept on the
+ * context's work stack rather than the C stack */
+static int p_term_unify_inner(p_context *context, p_term *term1, p_term *term2, int flags)
+{
+    size_t base = context->term_work_top;
+    p_term_work *work;
+    unsigned int index;
+    for (;;) {
+        if (!term1 || !term2)
+            break;
+        term1 = p_term_deref_non_null(term1);
+        term2 = p_term_deref_non_null(term2);
+        if (term1 == term2) {
+            /* Identical terms, so nothing to do */
+        } else if (term1->header.type & P_TERM_VARIABLE) {
+            if (!p_term_unify_variable(context, term1, term2, flags))
+                break;
+        } else if (term2->header.type & P_TERM_VARIABLE) {
+            if (flags & P_BIND_ONE_WAY)
+                break;
+            if (!p_term_unify_variable
+                    (context, term2, term1,
+                     flags & ~P_BIND_RECORD_ONE_WAY))
+                break;
+        } else if (term1->header.type == P_TERM_FUNCTOR) {
+            /* Functor must have the same name and number of arguments.
+             * Remember the functors and continue with the first argument */
+            if (term2->header.type != P_TERM_FUNCTOR ||
+                    term1->header.size != term2->header.size ||
+                    term1->functor.functor_name !=
+                            term2->functor.functor_name)
+                break;
+            if (term1->header.size > 1 &&
+                    !p_term_work_push(context, term1, term2, 1))
+                goto failed;
+            term1 = term1->functor.arg[0];
+            term2 = term2->functor.arg[0];
+            continue;
+        } else if (term1->header.type == P_TERM_LIST) {
+            /* Unify the heads and then the tails of the lists */
+            if (term2->header.type != P_TERM_LIST)
+                break;
+            if (!p_term_work_push(context, term1, term2, 1))
+                goto failed;
+            term1 = term1->list.head;
+            term2 = term2->list.head;
+            continue;
+        } else if (!p_term_unify_atomic(term1, term2)) {
+            break;
+        }
+        work = p_term_work_next(context, base, &index);
+        if (!work)
+            return 1;
+        term1 = p_term_work_child(work->term1, index);
+        term2 = p_term_work_child(work->term2, index);
+    }
+
+failed:
+    context->term_work_top = base;
+    return 0;
+}
+
 /**
  * \brief Unifies \a term1 with \a term2 within \a context.
  *
@@ -2316,13 +3133,75 @@ static int p_term_unify_inner(p_context *context, p_term *term1, p_term *term2,
  */
 int p_term_unify(p_context *context, p_term *term1, p_term *term2, int flags)
 {
-    void *marker = p_context_mark_trail(context);
-    int result = p_term_unify_inner(context, term1, term2, flags);
-    if (!result && (flags & P_BIND_NO_RECORD) == 0)
+    void *marker;
+    unsigned int var_age;
+    unsigned int trail_age;
+    int result;
+    if (flags & P_BIND_NO_RECORD)
+        return p_term_unify_inner(context, term1, term2, flags);
+
+    /* Record every binding so that a partial unification can be
+     * backed out on failure.  This is done without starting a new
+     * variable age, so that the ages are not used up by unifications
+     * that cannot be backtracked into.  On success, the bindings of
+     * variables that are younger than the most recent choice point
+     * are removed from the trail again */
+    marker = _p_context_trail_marker(context);
+    var_age = context->var_age;
+    trail_age = context->trail_age;
+    context->trail_age = var_age + 1;
+    result = p_term_unify_inner(context, term1, term2, flags);
+    if (!result) {
         p_context_backtrack_trail(context, marker);
+        if (context->var_age == var_age)
+            context->trail_age = trail_age;
+    } else if (context->var_age == var_age) {
+        context->trail_age = trail_age;
+        _p_context_prune_trail(context, marker);
+    }
     return result;
 }
 
+/* Unify two terms without backing out a partial unification on
+ * failure.  Used by compiled code, which always backtracks to the
+ * most recent choice point when a unification fails */
+int _p_term_unify_no_undo(p_context *context, p_term *term1, p_term *term2, int flags)
+{
+    return p_term_unify_inner(context, term1, term2, flags);
+}
+
+/* Unifies the arguments of "goal" with the ground fact "clause".
+ * The arguments of the fact never contain variables, so unbound
+ * goal arguments are bound directly without an occurs check.  Like
+ * compiled code, partial bindings are not backed out on failure */
+int _p_term_unify_fact
+    (p_context *context, p_term *goal,
+     const struct p_term_clause *clause)
+{
+    const struct p_term_fact *fact = (const struct p_term_fact *)clause;
+    unsigned int arity = fact->header.size - 1;
+    unsigned int index;
+    p_term *arg;
+    for (index = 0; index < arity; ++index) {
+        arg = p_term_deref_non_null(goal->functor.arg[index]);
+        if (arg == fact->arg[index])
+            continue;
+        if (arg->header.type == P_TERM_VARIABLE) {
+            if (!p_term_bind_var(context, arg, fact->arg[index],
+                                 P_BIND_NO_OCCURS_CHECK))
+                return 0;
+        } else if (arg->header.type == P_TERM_ATOM) {
+            /* Atoms are unique, so identity was the only way
+             * that this argument could match */
+            return 0;
+        } else if (!p_term_unify_inner(context, arg, fact->arg[index],
+                                       P_BIND_NO_OCCURS_CHECK)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /**
  * \typedef p_term_print_func
  * \ingroup term
@@ -2746,6 +3625,9 @@ void p_term_print_with_vars(p_context *context, const p_term *term, p_term_print
  */
 int p_term_precedes(p_context *context, const p_term *term1, const p_term *term2)
 {
+    size_t base = context->term_work_top;
+    p_term_work *work;
+    unsigned int index;
     int group1, group2, cmp;
     static unsigned char const precedes_ordering[] = {
         0,  /*  0: P_TERM_INVALID */
@@ -2764,117 +3646,137 @@ int p_term_precedes(p_context *context, const p_term *term1, const p_term *term2
         1   /* 17: P_TERM_MEMBER_VARIABLE */
     };
 
-    /* Dereference the terms */
-    if (!term1)
-        return term2 ? -1 : 0;
-    if (!term2)
-        return 1;
-    term1 = p_term_deref_non_null(term1);
-    term2 = p_term_deref_non_null(term2);
-    if (term1 == term2)
-        return 0;
+    /* Compare pairs of terms until a difference is found.  Functors
+     * and list cells are pushed onto the work stack so that their
+     * arguments are compared from left to right */
+    for (;;) {
+        cmp = 0;
 
-    /* Determine which groups the terms fall within */
-    group1 = precedes_ordering[term1->header.type];
-    group2 = precedes_ordering[term2->header.type];
-    if (group1 < group2)
-        return -1;
-    else if (group1 > group2)
-        return 1;
+        /* Dereference the terms */
+        if (!term1) {
+            cmp = term2 ? -1 : 0;
+            goto compared;
+        }
+        if (!term2) {
+            cmp = 1;
+            goto compared;
+        }
+        term1 = p_term_deref_non_null(term1);
+        term2 = p_term_deref_non_null(term2);
+        if (term1 == term2)
+            goto compared;
+
+        /* Determine which groups the terms fall within */
+        group1 = precedes_ordering[term1->header.type];
+        group2 = precedes_ordering[term2->header.type];
+        if (group1 < group2) {
+            cmp = -1;
+            goto compared;
+        } else if (group1 > group2) {
+            cmp = 1;
+            goto compared;
+        }
 
-    /* Compare based on the term type */
-    switch (term1->header.type) {
-    case P_TERM_FUNCTOR:
-    case P_TERM_LIST: {
-        p_term *name1;
-        p_term *name2;
-        unsigned int index;
-        if (term1->header.size < term2->header.size)
-            return -1;
-        else if (term1->header.size > term2->header.size)
-            return 1;
-        if (term1->header.type == P_TERM_FUNCTOR)
-            name1 = term1->functor.functor_name;
-        else
-            name1 = context->dot_atom;
-        if (term2->header.type == P_TERM_FUNCTOR)
-            name2 = term2->functor.functor_name;
-        else
-            name2 = context->dot_atom;
-        cmp = p_term_strcmp(name1, name2);
-        if (cmp < 0)
-            return -1;
-        else if (cmp > 0)
-            return 1;
-        if (term1->header.type == P_TERM_FUNCTOR &&
-                term2->header.type == P_TERM_FUNCTOR) {
-            for (index = 0; index < term1->header.size; ++index) {
-                cmp = p_term_precedes(context,
-                                      term1->functor.arg[index],
-                                      term2->functor.arg[index]);
-                if (cmp != 0)
-                    return cmp;
+        /* Compare based on the term type */
+        switch (term1->header.type) {
+        case P_TERM_FUNCTOR:
+        case P_TERM_LIST: {
+            p_term *name1;
+            p_term *name2;
+            if (term1->header.size < term2->header.size) {
+                cmp = -1;
+                break;
+            } else if (term1->header.size > term2->header.size) {
+                cmp = 1;
+                break;
             }
-        } else if (term1->header.type == P_TERM_LIST &&
-                   term2->header.type == P_TERM_LIST) {
-            do {
-                cmp = p_term_precedes
-                    (context, term1->list.head, term2->list.head);
-                if (cmp != 0)
-                    return cmp;
-                term1 = term1->list.tail;
-                term2 = term2->list.tail;
-                if (!term1 || !term2)
+            if (term1->header.type == P_TERM_FUNCTOR)
+                name1 = term1->functor.functor_name;
+            else
+                name1 = context->dot_atom;
+            if (term2->header.type == P_TERM_FUNCTOR)
+                name2 = term2->functor.functor_name;
+            else
+                name2 = context->dot_atom;
+            if (name1 != name2) {
+                cmp = p_term_strcmp(name1, name2);
+                if (cmp != 0) {
+                    cmp = (cmp < 0) ? -1 : 1;
                     break;
-                term1 = p_term_deref_non_null(term1);
-                term2 = p_term_deref_non_null(term2);
-            } while (term1->header.type == P_TERM_LIST &&
-                     term2->header.type == P_TERM_LIST);
-            return p_term_precedes(context, term1, term2);
-        } else {
+                }
+            }
+            if (term1->header.type == P_TERM_FUNCTOR &&
+                    term2->header.type == P_TERM_FUNCTOR) {
+                if (term1->header.size > 1 &&
+                        !p_term_work_push(context, (p_term *)term1,
+                                          (p_term *)term2, 1))
+                    goto pointer_order;
+                term1 = term1->functor.arg[0];
+                term2 = term2->functor.arg[0];
+                continue;
+            } else if (term1->header.type == P_TERM_LIST &&
+                       term2->header.type == P_TERM_LIST) {
+                if (!p_term_work_push(context, (p_term *)term1,
+                                      (p_term *)term2, 1))
+                    goto pointer_order;
+                term1 = term1->list.head;
+                term2 = term2->list.head;
+                continue;
+            }
+
             /* Shouldn't get here, because parsers will normally
              * convert '.' functors into list terms.  Have to do
              * something, so order the terms on pointer */
-            return (term1 < term2) ? -1 : 1;
-        }
-        break; }
-    case P_TERM_ATOM:
-    case P_TERM_STRING:
-        cmp = p_term_strcmp(term1, term2);
-        if (cmp < 0)
-            return -1;
-        else if (cmp > 0)
-            return 1;
-        break;
-    case P_TERM_INTEGER:
+        pointer_order:
+            cmp = (term1 < term2) ? -1 : 1;
+            break; }
+        case P_TERM_ATOM:
+        case P_TERM_STRING:
+            cmp = p_term_strcmp(term1, term2);
+            if (cmp != 0)
+                cmp = (cmp < 0) ? -1 : 1;
+            break;
+        case P_TERM_INTEGER:
 #if defined(P_TERM_64BIT)
-        if (((int)(term1->header.size)) < ((int)(term2->header.size)))
-            return -1;
-        else if (((int)(term1->header.size)) > ((int)(term2->header.size)))
-            return 1;
+            if (((int)(term1->header.size)) < ((int)(term2->header.size)))
+                cmp = -1;
+            else if (((int)(term1->header.size)) > ((int)(term2->header.size)))
+                cmp = 1;
 #else
-        if (term1->integer.value < term2->integer.value)
-            return -1;
-        else if (term1->integer.value > term2->integer.value)
-            return 1;
+            if (term1->integer.value < term2->integer.value)
+                cmp = -1;
+            else if (term1->integer.value > term2->integer.value)
+                cmp = 1;
 #endif
-        break;
-    case P_TERM_REAL:
-        if (term1->real.value < term2->real.value)
-            return -1;
-        else if (term1->real.value > term2->real.value)
-            return 1;
-        break;
-    case P_TERM_OBJECT:
-    case P_TERM_PREDICATE:
-    case P_TERM_CLAUSE:
-    case P_TERM_DATABASE:
-    case P_TERM_VARIABLE:
-    case P_TERM_MEMBER_VARIABLE:
-        return (term1 < term2) ? -1 : 1;
-    default: break;
+            break;
+        case P_TERM_REAL:
+            if (term1->real.value < term2->real.value)
+                cmp = -1;
+            else if (term1->real.value > term2->real.value)
+                cmp = 1;
+            break;
+        case P_TERM_OBJECT:
+        case P_TERM_PREDICATE:
+        case P_TERM_CLAUSE:
+        case P_TERM_DATABASE:
+        case P_TERM_VARIABLE:
+        case P_TERM_MEMBER_VARIABLE:
+            cmp = (term1 < term2) ? -1 : 1;
+            break;
+        default: break;
+        }
+
+    compared:
+        if (cmp != 0)
+            break;
+        work = p_term_work_next(context, base, &index);
+        if (!work)
+            break;
+        term1 = p_term_work_child(work->term1, index);
+        term2 = p_term_work_child(work->term2, index);
     }
-    return 0;
+    context->term_work_top = base;
+    return cmp;
 }
 
 /**
@@ -2928,56 +3830,15 @@ int p_term_is_ground(const p_term *term)
     return 0;
 }
 
-static p_term *p_term_clone_inner(p_context *context, p_term *term)
+/* Forward declaration */
+static p_term *p_term_clone_inner(p_context *context, p_term *term);
+
+/* Clone a term that is not a functor or list */
+static p_term *p_term_clone_leaf(p_context *context, p_term *term)
 {
     p_term *clone;
     p_term *rename;
-    if (!term)
-        return 0;
-    term = p_term_deref_non_null(term);
     switch (term->header.type) {
-    case P_TERM_FUNCTOR: {
-        /* Clone a functor term */
-        unsigned int index;
-        clone = p_term_create_functor
-            (context, term->functor.functor_name,
-             (int)(term->header.size));
-        if (!clone)
-            return 0;
-        for (index = 0; index < term->header.size; ++index) {
-            p_term *arg = p_term_clone_inner
-                (context, term->functor.arg[index]);
-            if (!arg)
-                return 0;
-            p_term_bind_functor_arg(clone, (int)index, arg);
-        }
-        return clone; }
-    case P_TERM_LIST: {
-        /* Clone a list term */
-        p_term *head;
-        p_term *tail = 0;
-        clone = 0;
-        do {
-            head = p_term_clone_inner(context, term->list.head);
-            if (!head)
-                return 0;
-            head = p_term_create_list(context, head, 0);
-            if (tail)
-                tail->list.tail = head;
-            else
-                clone = head;
-            tail = head;
-            term = term->list.tail;
-            if (!term)
-                return 0;
-            term = p_term_deref_non_null(term);
-        }
-        while (term->header.type == P_TERM_LIST);
-        head = p_term_clone_inner(context, term);
-        if (!head)
-            return 0;
-        tail->list.tail = head;
-        return clone; }
     case P_TERM_ATOM:
     case P_TERM_STRING:
     case P_TERM_INTEGER:
@@ -3036,6 +3897,77 @@ static p_term *p_term_clone_inner(p_context *context, p_term *term)
     return term;
 }
 
+/* Clone a term.  Each entry on the work stack holds a functor or
+ * list cell whose remaining children still need to be cloned, and
+ * the new functor or list cell that the clones should be stored into */
+static p_term *p_term_clone_inner(p_context *context, p_term *term)
+{
+    size_t base = context->term_work_top;
+    p_term_work *work;
+    p_term *result = 0;
+    p_term *parent = 0;
+    unsigned int index = 0;
+    p_term *clone;
+    p_term *next;
+    for (;;) {
+        if (!term)
+            goto failed;
+        term = p_term_deref_non_null(term);
+        if (term->header.type == P_TERM_FUNCTOR) {
+            /* Clone the functor and then its arguments */
+            clone = p_term_create_functor
+                (context, term->functor.functor_name,
+                 (int)(term->header.size));
+            if (!clone)
+                goto failed;
+            if (term->header.size > 1 &&
+                    !p_term_work_push(context, term, clone, 1))
+                goto failed;
+            next = term->functor.arg[0];
+        } else if (term->header.type == P_TERM_LIST) {
+            /* Clone the list cell and then its head and tail */
+            clone = p_term_create_list(context, 0, 0);
+            if (!clone)
+                goto failed;
+            if (!p_term_work_push(context, term, clone, 1))
+                goto failed;
+            next = term->list.head;
+        } else {
+            clone = p_term_clone_leaf(context, term);
+            if (!clone)
+                goto failed;
+            next = 0;
+        }
+
+        /* Store the clone into its parent */
+        if (!parent)
+            result = clone;
+        else if (parent->header.type == P_TERM_FUNCTOR)
+            parent->functor.arg[index] = clone;
+        else if (index == 0)
+            parent->list.head = clone;
+        else
+            parent->list.tail = clone;
+
+        /* Move on to the next term to be cloned */
+        if (next) {
+            parent = clone;
+            index = 0;
+            term = next;
+        } else {
+            work = p_term_work_next(context, base, &index);
+            if (!work)
+                return result;
+            term = p_term_work_child(work->term1, index);
+            parent = work->term2;
+        }
+    }
+
+failed:
+    context->term_work_top = base;
+    return 0;
+}
+
 /**
  * \brief Clones \a term within \a context to create a new
  * term that has freshly renamed versions of the variables
@@ -3056,6 +3988,23 @@ p_term *p_term_clone(p_context *context, p_term *term)
     return clone;
 }
 
+/* Clones "term" for storage in a location that survives back-tracking,
+ * such as the target of a destructive assignment.  The variables in
+ * the clone are given the oldest age so that their bindings are always
+ * recorded in the trail, even if they are bound after a choice point
+ * that the clone outlives */
+p_term *_p_term_clone_persistent(p_context *context, p_term *term)
+{
+    void *marker = p_context_mark_trail(context);
+    unsigned int var_age = context->var_age;
+    p_term *clone;
+    context->var_age = 0;
+    clone = p_term_clone_inner(context, term);
+    context->var_age = var_age;
+    p_context_backtrack_trail(context, marker);
+    return clone;
+}
+
 /**
  * \brief Unifies \a term with the renamed head of \a clause.
  *
@@ -3078,10 +4027,21 @@ p_term *p_term_unify_clause(p_context *context, p_term *term, p_term *clause)
     p_goal_result result;
     p_term *body = 0;
 
-    /* Copy the arguments to the head term into X registers */
+    /* Ground facts are matched directly against their arguments */
     term = p_term_deref(term);
     if (!term)
         return 0;
+    if (p_term_clause_is_fact(&(clause->clause))) {
+        if (p_term_arg_count(term) != (int)(clause->header.size - 1) ||
+                !_p_term_unify_fact(context, term, &(clause->clause)))
+            return 0;
+        return context->true_atom;
+    }
+
+    if (p_term_clause_is_lazy(&(clause->clause)))
+        _p_term_compile_lazy_clause(context, &(clause->clause));
+
+    /* Copy the arguments to the head term into X registers */
     if (term->header.type == P_TERM_FUNCTOR) {
         for (index = 0; index < term->header.size; ++index) {
             _p_code_set_xreg
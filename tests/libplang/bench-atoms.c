@@ -0,0 +1,75 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+/* Timing benchmark for the atom table: creates 10^4 up to 10^7
+ * distinct atoms in a new context, and then looks them all up
+ * again.  Run with "make bench".  The optional argument is the
+ * largest number of atoms to create */
+
+#include <plang/term.h>
+#include <plang/context.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double elapsed(clock_t start)
+{
+    return ((double)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+static void run_atoms(int num_atoms)
+{
+    p_context *context = p_context_create();
+    char name[32];
+    clock_t start;
+    double create_time, lookup_time;
+    int index;
+
+    start = clock();
+    for (index = 0; index < num_atoms; ++index) {
+        sprintf(name, "word_%d", index);
+        p_term_create_atom(context, name);
+    }
+    create_time = elapsed(start);
+
+    start = clock();
+    for (index = 0; index < num_atoms; ++index) {
+        sprintf(name, "word_%d", index);
+        p_term_create_atom(context, name);
+    }
+    lookup_time = elapsed(start);
+
+    printf("%9d atoms  create %7.3f (%6.0f ns/atom)"
+           "  lookup %7.3f (%6.0f ns/atom)\n",
+           num_atoms, create_time, create_time * 1e9 / num_atoms,
+           lookup_time, lookup_time * 1e9 / num_atoms);
+    p_context_free(context);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_atoms = 10000000;
+    int num_atoms;
+    if (argc > 1)
+        max_atoms = atoi(argv[1]);
+    printf("times in seconds\n");
+    for (num_atoms = 10000; num_atoms <= max_atoms; num_atoms *= 10)
+        run_atoms(num_atoms);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+/* Memory report for the clause database: loads a large table of
+ * facts and reports the number of bytes that are used per clause.
+ * Run with "make bench".  The optional argument is the number
+ * of facts to load */
+
+#include <plang/term.h>
+#include <plang/context.h>
+#include "term-priv.h"
+#include "inst-priv.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FACTS_PER_BATCH     1000
+
+static size_t live_bytes(void)
+{
+    GC_gcollect();
+    return GC_get_heap_size() - GC_get_free_bytes();
+}
+
+int main(int argc, char *argv[])
+{
+    p_context *context;
+    p_term *predicate;
+    p_term *clause;
+    p_term_clause_iter iter;
+    char *source;
+    size_t before, after, code_size;
+    int num_facts = 1000000;
+    int fact, batch, len, num_tuples;
+    if (argc > 1)
+        num_facts = atoi(argv[1]);
+    context = p_context_create();
+    source = (char *)malloc(FACTS_PER_BATCH * 64);
+
+    /* Load the facts in batches */
+    before = live_bytes();
+    for (fact = 0; fact < num_facts; fact += batch) {
+        len = 0;
+        for (batch = 0; batch < FACTS_PER_BATCH &&
+                        (fact + batch) < num_facts; ++batch) {
+            len += sprintf(source + len, "fact(%d, k%d, %d.5).\n",
+                           fact + batch, (fact + batch) % 1000,
+                           fact + batch);
+        }
+        if (p_context_consult_string(context, source) != 0) {
+            fprintf(stderr, "failed to load the facts\n");
+            return 1;
+        }
+    }
+    after = live_bytes();
+
+    /* Add up the size of the compiled code for the clauses.
+     * Ground facts are stored as tuples and have no code */
+    code_size = 0;
+    num_tuples = 0;
+    predicate = p_term_lookup_predicate
+        (context, p_term_create_atom(context, "fact"), 3);
+    p_term_clauses_begin(predicate, 0, &iter);
+    while ((clause = p_term_clauses_next(&iter)) != 0) {
+        if (p_term_clause_is_fact(&(clause->clause))) {
+            ++num_tuples;
+            continue;
+        }
+        code_size += _p_code_clause_size(&(clause->clause.clause_code));
+        if (clause->clause.exec_code.code) {
+            code_size += _p_code_clause_size
+                (&(clause->clause.exec_code));
+        }
+    }
+
+    printf("%d facts\n", num_facts);
+    printf("heap bytes per clause:  %8.1f\n",
+           ((double)(after - before)) / num_facts);
+    printf("code bytes per clause:  %8.1f\n",
+           ((double)code_size) / num_facts);
+    printf("stored as tuples:       %8d\n", num_tuples);
+
+    free(source);
+    p_context_free(context);
+    return 0;
+}
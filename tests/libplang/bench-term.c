@@ -0,0 +1,143 @@
+/*
+ * plang logic programming language
+ * Copyright (C) 2011,2012  Southern Storm Software, Pty Ltd.
+ *
+ * The plang package is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The plang package is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the libcompiler library.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ */
+
+/* Timing benchmark for the term traversal routines: unification,
+ * comparison, cloning, and the occurs check.  Run with "make bench".
+ * The optional argument scales the size of the test terms */
+
+#include <plang/term.h>
+#include <plang/context.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static p_context *context;
+
+enum {
+    SHAPE_RIGHT,        /* f(a, f(a, f(a, ...))) */
+    SHAPE_LEFT,         /* f(f(f(..., a), a), a) */
+    SHAPE_WIDE,         /* f(1, 2, 3, ..., N) */
+    SHAPE_LIST          /* [1, 2, 3, ..., N] */
+};
+
+static const char * const shape_names[] = {
+    "deep right", "deep left", "wide functor", "long list"
+};
+
+static p_term *build_term(int shape, int size, p_term *leaf)
+{
+    p_term *f_atom = p_term_create_atom(context, "f");
+    p_term *a_atom = p_term_create_atom(context, "a");
+    p_term *term;
+    p_term *next;
+    int index;
+    switch (shape) {
+    case SHAPE_RIGHT:
+    case SHAPE_LEFT:
+        term = leaf;
+        for (index = 0; index < size; ++index) {
+            next = p_term_create_functor(context, f_atom, 2);
+            p_term_bind_functor_arg(next, shape == SHAPE_LEFT ? 0 : 1, term);
+            p_term_bind_functor_arg(next, shape == SHAPE_LEFT ? 1 : 0, a_atom);
+            term = next;
+        }
+        return term;
+    case SHAPE_WIDE:
+        term = p_term_create_functor(context, f_atom, size + 1);
+        for (index = 0; index < size; ++index) {
+            p_term_bind_functor_arg
+                (term, index, p_term_create_integer(context, index));
+        }
+        p_term_bind_functor_arg(term, size, leaf);
+        return term;
+    default:
+        term = p_term_create_list(context, leaf, 0);
+        next = term;
+        for (index = 1; index < size; ++index) {
+            p_term *tail = p_term_create_list
+                (context, p_term_create_integer(context, index), 0);
+            p_term_set_tail(next, tail);
+            next = tail;
+        }
+        p_term_set_tail(next, p_term_nil_atom(context));
+        return term;
+    }
+}
+
+static double elapsed(clock_t start)
+{
+    return ((double)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+static void run_shape(int shape, int size, int repeat)
+{
+    p_term *b_atom = p_term_create_atom(context, "b");
+    p_term *term1 = build_term(shape, size, b_atom);
+    p_term *term2 = build_term(shape, size, b_atom);
+    p_term *var;
+    p_term *term3;
+    void *marker;
+    clock_t start;
+    int count;
+
+    printf("%-14s", shape_names[shape]);
+
+    start = clock();
+    for (count = 0; count < repeat; ++count)
+        p_term_unify(context, term1, term2, P_BIND_DEFAULT);
+    printf("  unify %7.3f", elapsed(start));
+
+    start = clock();
+    for (count = 0; count < repeat; ++count)
+        p_term_precedes(context, term1, term2);
+    printf("  compare %7.3f", elapsed(start));
+
+    start = clock();
+    for (count = 0; count < repeat; ++count)
+        p_term_clone(context, term1);
+    printf("  clone %7.3f", elapsed(start));
+
+    var = p_term_create_variable(context);
+    term3 = build_term(shape, size, var);
+    var = p_term_create_variable(context);
+    start = clock();
+    for (count = 0; count < repeat; ++count) {
+        marker = p_context_mark_trail(context);
+        p_term_bind_variable(context, var, term3, P_BIND_DEFAULT);
+        p_context_backtrack_trail(context, marker);
+    }
+    printf("  occurs %7.3f\n", elapsed(start));
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 100000;
+    int repeat = 20;
+    int shape;
+    if (argc > 1)
+        size = atoi(argv[1]);
+    if (argc > 2)
+        repeat = atoi(argv[2]);
+    context = p_context_create();
+    printf("size %d, %d repetitions, times in seconds\n", size, repeat);
+    for (shape = SHAPE_RIGHT; shape <= SHAPE_LIST; ++shape)
+        run_shape(shape, size, repeat);
+    p_context_free(context);
+    return 0;
+}
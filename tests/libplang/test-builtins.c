@@ -307,6 +307,32 @@ static void test_term_unification()
     P_COMPARE(run_goal("unifiable(f(X,b), f(a,Y)), var(X), var(Y)"), P_RESULT_TRUE);
 }
 
+static void test_occurs_check_flag()
+{
+    P_COMPARE(run_goal("current_prolog_flag(occurs_check, true)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("current_prolog_flag(F, V), F == occurs_check"), P_RESULT_TRUE);
+    P_COMPARE(run_goal_error("current_prolog_flag(1.5, V)", "type_error(atom, 1.5)"), P_RESULT_ERROR);
+    P_COMPARE(run_goal_error("current_prolog_flag(foo, V)", "domain_error(prolog_flag, foo)"), P_RESULT_ERROR);
+
+    P_COMPARE(run_goal_error("set_prolog_flag(F, true)", "instantiation_error"), P_RESULT_ERROR);
+    P_COMPARE(run_goal_error("set_prolog_flag(occurs_check, V)", "instantiation_error"), P_RESULT_ERROR);
+    P_COMPARE(run_goal_error("set_prolog_flag(1.5, true)", "type_error(atom, 1.5)"), P_RESULT_ERROR);
+    P_COMPARE(run_goal_error("set_prolog_flag(foo, true)", "domain_error(prolog_flag, foo)"), P_RESULT_ERROR);
+    P_COMPARE(run_goal_error("set_prolog_flag(occurs_check, 1)", "domain_error(flag_value, occurs_check + 1)"), P_RESULT_ERROR);
+
+    /* Turn off the occurs check; explicit checks still work */
+    P_COMPARE(run_goal("set_prolog_flag(occurs_check, false)"), P_RESULT_TRUE);
+    P_VERIFY(!p_context_is_occurs_check(context));
+    P_COMPARE(run_goal("current_prolog_flag(occurs_check, false)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("X != f(X)"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("unify_with_occurs_check(X, f(X))"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("f(X,b) = f(a,Y), X == a, Y == b"), P_RESULT_TRUE);
+
+    P_COMPARE(run_goal("set_prolog_flag(occurs_check, true)"), P_RESULT_TRUE);
+    P_VERIFY(p_context_is_occurs_check(context));
+    P_COMPARE(run_goal("X = f(X)"), P_RESULT_FAIL);
+}
+
 static void test_reexecute()
 {
     P_COMPARE(run_goal("atom(a)"), P_RESULT_TRUE);
@@ -388,6 +414,7 @@ int main(int argc, char *argv[])
     P_TEST_RUN(logic_switch);
     P_TEST_RUN(logic_while);
     P_TEST_RUN(term_unification);
+    P_TEST_RUN(occurs_check_flag);
     P_TEST_RUN(reexecute);
 
     P_TEST_REPORT();
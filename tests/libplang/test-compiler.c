@@ -357,6 +357,128 @@ static void test_overflow()
     P_VERIFY(p_term_unify(context, term, term2, P_BIND_EQUALITY));
 }
 
+/* Test compilation of clause bodies into call/execute sequences */
+static void test_clause_body()
+{
+    p_term *clause;
+    p_term *goal = 0;
+    p_term *a_atom;
+    p_term *c_atom;
+    p_term *var;
+    p_exec_code_node *cont = 0;
+    p_exec_code_node *cont2 = 0;
+    p_goal_result result;
+
+    clause = parse_term(TERM("(p(X, Y) :- q(X, Z), r(Z, Y))"));
+    P_VERIFY(clause != 0);
+    init_code();
+    _p_code_generate_clause
+        (context, p_term_arg(clause, 0), p_term_arg(clause, 1), code);
+    finish_code();
+
+    /* Y and Z live across the call to q/2, but X does not */
+    P_COMPARE(code_clause.num_yregs, 2);
+
+    /* Match the head and run up to the call of q/2 */
+    a_atom = p_term_create_atom(context, "a");
+    c_atom = p_term_create_atom(context, "c");
+    var = p_term_create_variable(context);
+    _p_code_set_xreg(context, 0, a_atom);
+    _p_code_set_xreg(context, 1, var);
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_CALL_BODY);
+    P_VERIFY(cont != 0);
+    P_VERIFY(goal != 0);
+    P_VERIFY(p_term_functor(goal) == p_term_create_atom(context, "q"));
+    P_COMPARE(p_term_arg_count(goal), 2);
+    P_VERIFY(p_term_deref(p_term_arg(goal, 0)) == a_atom);
+
+    /* Bind Z and then resume to execute r/2 as the last goal */
+    P_VERIFY(p_term_unify(context, p_term_arg(goal, 1), c_atom,
+                          P_BIND_DEFAULT));
+    goal = 0;
+    result = _p_code_resume
+        (context, cont->clause, cont->pc, cont->yregs, &goal, &cont2);
+    P_VERIFY(result == P_RESULT_RETURN_BODY);
+    P_VERIFY(cont2 == 0);
+    P_VERIFY(goal != 0);
+    P_VERIFY(p_term_functor(goal) == p_term_create_atom(context, "r"));
+    P_VERIFY(p_term_deref(p_term_arg(goal, 0)) == c_atom);
+    P_VERIFY(p_term_deref(p_term_arg(goal, 1)) == var);
+
+    /* Facts compile down to a proceed */
+    clause = parse_term(TERM("f(a)"));
+    init_code();
+    _p_code_generate_clause(context, clause, context->true_atom, code);
+    finish_code();
+    _p_code_set_xreg(context, 0, a_atom);
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_TRUE);
+    _p_code_set_xreg(context, 0, c_atom);
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_FAIL);
+    cleanup_code();
+}
+
+/* Test that "X = Term" is compiled inline when X is a fresh variable */
+static void test_fresh_unify()
+{
+    p_term *clause;
+    p_term *goal = 0;
+    p_term *a_atom;
+    p_term *var;
+    p_term *arg;
+    p_exec_code_node *cont = 0;
+    p_goal_result result;
+
+    /* Z is built directly; no call to (=)/2 is needed */
+    clause = parse_term(TERM("(p(X, Y) :- Z = f(X), q(Z, Y))"));
+    P_VERIFY(clause != 0);
+    init_code();
+    _p_code_generate_clause
+        (context, p_term_arg(clause, 0), p_term_arg(clause, 1), code);
+    finish_code();
+    a_atom = p_term_create_atom(context, "a");
+    var = p_term_create_variable(context);
+    _p_code_set_xreg(context, 0, a_atom);
+    _p_code_set_xreg(context, 1, var);
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_RETURN_BODY);
+    P_VERIFY(p_term_functor(goal) == p_term_create_atom(context, "q"));
+    arg = p_term_deref(p_term_arg(goal, 0));
+    P_VERIFY(p_term_functor(arg) == p_term_create_atom(context, "f"));
+    P_VERIFY(p_term_deref(p_term_arg(arg, 0)) == a_atom);
+    P_VERIFY(p_term_deref(p_term_arg(goal, 1)) == var);
+
+    /* A trailing fresh unification turns into a proceed */
+    clause = parse_term(TERM("(p(X) :- q(X), Y = g(X))"));
+    init_code();
+    _p_code_generate_clause
+        (context, p_term_arg(clause, 0), p_term_arg(clause, 1), code);
+    finish_code();
+    _p_code_set_xreg(context, 0, a_atom);
+    goal = 0;
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_CALL_BODY);
+    P_VERIFY(p_term_functor(goal) == p_term_create_atom(context, "q"));
+    result = _p_code_resume
+        (context, cont->clause, cont->pc, cont->yregs, &goal, 0);
+    P_VERIFY(result == P_RESULT_TRUE);
+
+    /* Unification against a variable that occurs in the term
+     * must still be performed by (=)/2 */
+    clause = parse_term(TERM("(p :- Z = f(Z))"));
+    init_code();
+    _p_code_generate_clause
+        (context, p_term_arg(clause, 0), p_term_arg(clause, 1), code);
+    finish_code();
+    goal = 0;
+    result = _p_code_resume(context, &code_clause, 0, 0, &goal, &cont);
+    P_VERIFY(result == P_RESULT_RETURN_BODY);
+    P_VERIFY(p_term_functor(goal) == context->unify_atom);
+    cleanup_code();
+}
+
 static void rbkey_init(p_rbkey *key, p_term *term)
 {
     if (!_p_rbkey_init(key, term)) {
@@ -366,6 +488,18 @@ static void rbkey_init(p_rbkey *key, p_term *term)
     }
 }
 
+/* Expected key for a sub-term: descend into the first argument of
+ * compound terms up to "depth" levels */
+static void rbkey_init_deep(p_rbkey *key, p_term *term, unsigned int depth)
+{
+    term = p_term_deref(term);
+    while (depth > 0 && term->header.type == P_TERM_FUNCTOR) {
+        term = p_term_deref(p_term_arg(term, 0));
+        --depth;
+    }
+    rbkey_init(key, term);
+}
+
 static void test_argument_key_common
     (int input_only, int force_large_regs)
 {
@@ -463,10 +597,15 @@ static void test_argument_key_common
         {"list_string", TERM("[a, b, c]"), TERM("\"a\"")},
         {"list_functor_1", TERM("[a, b, c]"), TERM("f(Y, 3)")},
         {"list_functor_2", TERM("[a, b, c]"), TERM("f(g([Y]), 3)")},
+
+        {"deep_int_atom", TERM("node(1)"), TERM("tag(node(a), b)")},
+        {"deep_string_float", TERM("tag(\"a\")"), TERM("t(u(v(4.5)))")},
+        {"deep_var_member_var", TERM("tag(node(X))"), TERM("t(Y.foo)")},
     };
     #define key_data_len (sizeof(key_data) / sizeof(struct key_type))
 
     size_t index;
+    unsigned int depth;
     p_term *arg0;
     p_term *arg1;
     p_rbkey expected_key;
@@ -510,6 +649,31 @@ static void test_argument_key_common
         P_COMPARE(expected_key.size, actual_key.size);
         P_COMPARE(expected_key.name, actual_key.name);
 
+        /* Keys for the sub-terms of compound arguments */
+        for (depth = 1; depth <= 3; ++depth) {
+            rbkey_init_deep(&expected_key, arg0, depth);
+            if (!_p_code_argument_deep_key
+                    (&actual_key, &code_clause, 0, depth)) {
+                actual_key.type = P_TERM_VARIABLE;
+                actual_key.size = 0;
+                actual_key.name = 0;
+            }
+            P_COMPARE(expected_key.type, actual_key.type);
+            P_COMPARE(expected_key.size, actual_key.size);
+            P_COMPARE(expected_key.name, actual_key.name);
+
+            rbkey_init_deep(&expected_key, arg1, depth);
+            if (!_p_code_argument_deep_key
+                    (&actual_key, &code_clause, 1, depth)) {
+                actual_key.type = P_TERM_VARIABLE;
+                actual_key.size = 0;
+                actual_key.name = 0;
+            }
+            P_COMPARE(expected_key.type, actual_key.type);
+            P_COMPARE(expected_key.size, actual_key.size);
+            P_COMPARE(expected_key.name, actual_key.name);
+        }
+
         cleanup_code();
     }
 }
@@ -534,6 +698,129 @@ static void test_argument_key_in_large()
     test_argument_key_common(1, 1);
 }
 
+/* Run the clause selection code for "predicate" against "goal" and
+ * return a bit mask of the positions of the clauses that were selected.
+ * Clauses must be selected in order with no duplicates */
+static unsigned int select_clauses
+    (p_term *predicate, const p_inst *code, const char *goal)
+{
+    struct p_term_clause **group;
+    struct p_term_clause *clause;
+    p_term *head = parse_term(goal);
+    unsigned int mask = 0;
+    unsigned int posn, count;
+    P_VERIFY(head != 0);
+    group = _p_code_select_clauses(code, head, &count);
+    if (!group)
+        return 0;
+    P_VERIFY(group[count] == 0);
+    clause = predicate->predicate.clauses.head;
+    posn = 0;
+    while (*group) {
+        while (clause && clause != *group) {
+            clause = clause->next_clause;
+            ++posn;
+        }
+        P_VERIFY(clause != 0);
+        mask |= (1U << posn);
+        ++group;
+    }
+    return mask;
+}
+
+static void test_switch()
+{
+    static char const switch_source[] =
+        "sw(a, x).\n"
+        "sw(X, x).\n"
+        "sw([H|T], x).\n"
+        "sw(f(X), x).\n"
+        "sw(b, x).\n"
+        "sw(g(Y, Z), x).\n"
+        "sw(a, x).\n"
+        "sw([], x).\n"
+        "sw2(a).\n"
+        "sw2(b).\n"
+        "sw2(c).\n"
+        "sw2(d).\n"
+        "sw2(e).\n"
+        "sw2(f).\n"
+        "sw2(1).\n"
+        "sw2(2).\n"
+        "sw2(-3).\n"
+        "sw2(1.5).\n"
+        "sw2(\"a\").\n"
+        "sw2(\"b\").\n"
+        "sw2(f(a)).\n"
+        "sw2(f(a, b)).\n"
+        "sw3(a).\n"
+        "sw3(b).\n"
+        ;
+    p_term *pred;
+    p_inst *code;
+
+    /* The switch code needs the clauses to be compiled */
+    p_context_set_eager_compile(context, 1);
+    P_VERIFY(p_context_consult_string(context, switch_source) == 0);
+    p_context_set_eager_compile(context, 0);
+
+    /* Mixture of variable and non-variable clauses */
+    pred = p_term_lookup_predicate
+        (context, p_term_create_atom(context, "sw"), 2);
+    P_VERIFY(pred != 0);
+    code = _p_code_generate_switch(pred);
+    P_VERIFY(code != 0);
+    P_COMPARE(p_inst_opcode(code), P_OP_SWITCH_ON_TERM);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(Y, x)")), 0xFFU);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(a, x)")), 0x43U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(b, x)")), 0x12U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(c, x)")), 0x02U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw([], x)")), 0x82U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw([a], x)")), 0x06U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(f(a), x)")), 0x0AU);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(g(a, b), x)")), 0x22U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(g(a), x)")), 0x02U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw(42, x)")), 0x02U);
+
+    /* Large constant table that needs to be hashed */
+    pred = p_term_lookup_predicate
+        (context, p_term_create_atom(context, "sw2"), 1);
+    P_VERIFY(pred != 0);
+    code = _p_code_generate_switch(pred);
+    P_VERIFY(code != 0);
+    P_COMPARE(p_inst_opcode(code->switch_on_term.constant_label),
+              P_OP_SWITCH_ON_CONSTANT);
+    P_VERIFY(code->switch_on_term.constant_label->switch_table.mask != 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(X)")), 0x3FFFU);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(a)")), 0x0001U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(f)")), 0x0020U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(1)")), 0x0040U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(2)")), 0x0080U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(-3)")), 0x0100U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(1.5)")), 0x0200U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(\"a\")")), 0x0400U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(\"b\")")), 0x0800U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(f(b))")), 0x1000U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(f(b, c))")), 0x2000U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(g)")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(3)")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(2.5)")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2(\"c\")")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2([])")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw2([a])")), 0);
+
+    /* Small constant table that is searched linearly */
+    pred = p_term_lookup_predicate
+        (context, p_term_create_atom(context, "sw3"), 1);
+    P_VERIFY(pred != 0);
+    code = _p_code_generate_switch(pred);
+    P_VERIFY(code != 0);
+    P_COMPARE(code->switch_on_term.constant_label->switch_table.mask, 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw3(b)")), 0x02U);
+    P_COMPARE(select_clauses(pred, code, TERM("sw3(c)")), 0);
+    P_COMPARE(select_clauses(pred, code, TERM("sw3(f(b))")), 0);
+}
+
 int main(int argc, char *argv[])
 {
     P_TEST_INIT("test-compiler");
@@ -553,12 +840,16 @@ int main(int argc, char *argv[])
     P_TEST_RUN(get_large_in);
 
     P_TEST_RUN(overflow);
+    P_TEST_RUN(clause_body);
+    P_TEST_RUN(fresh_unify);
 
     P_TEST_RUN(argument_key);
     P_TEST_RUN(argument_key_in);
     P_TEST_RUN(argument_key_large);
     P_TEST_RUN(argument_key_in_large);
 
+    P_TEST_RUN(switch);
+
     P_TEST_REPORT();
     return P_TEST_EXIT_CODE();
 }
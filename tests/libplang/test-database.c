@@ -19,6 +19,10 @@
 
 #include "testcase.h"
 #include <plang/database.h>
+#include "context-priv.h"
+#include "term-priv.h"
+#include "database-priv.h"
+#include <errno.h>
 
 P_TEST_DECLARE();
 
@@ -168,6 +172,551 @@ static void test_user_predicate()
     P_COMPARE(run_goal_error("a(g)", "foo"), P_RESULT_ERROR);
 }
 
+static void test_last_call()
+{
+    static char const loop_source[] =
+        "count(0) { commit; }\n"
+        "count(N) { N1 is N - 1; count(N1); }\n"
+        "count2(N, N).\n"
+        "count2(M, N) { M < N; M1 is M + 1; count2(M1, N); }\n"
+        ;
+    P_VERIFY(p_context_consult_string(context, loop_source) == 0);
+
+    /* Deterministic tail recursion must not grow the control stack
+     * beyond the first segment */
+    P_COMPARE(run_goal("count(100000)"), P_RESULT_TRUE);
+    P_VERIFY(context->exec_stack != 0);
+    P_VERIFY(context->exec_stack->prev == 0);
+
+    /* The choice point left by count2/2 keeps the frames alive,
+     * and backtracking into it must still work afterwards */
+    P_COMPARE(run_goal("count2(0, 2000), fail"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("count2(0, 2000)"), P_RESULT_TRUE);
+    P_COMPARE(p_context_reexecute_goal(context, 0), P_RESULT_FAIL);
+}
+
+static void test_var_ages()
+{
+    static char const deep_source[] =
+        "deep(N) { N > 0; N1 is N - 1; deep(N1); }\n"
+        "deep(_).\n"
+        ;
+    p_term *var;
+    void *marker;
+    P_VERIFY(p_context_consult_string(context, deep_source) == 0);
+
+    /* Start close to the limit on variable ages, and then create
+     * enough choice points to run past it.  Every binding is trailed
+     * once the ages run out, but backtracking out of the choice points
+     * hands the ages back so that fresh variables are not trailed */
+    context->var_age = P_TERM_VAR_MAX_AGE - 100;
+    P_COMPARE(run_goal("deep(1000), fail"), P_RESULT_FAIL);
+    P_VERIFY(context->var_age < P_TERM_VAR_MAX_AGE);
+    marker = p_context_mark_trail(context);
+    var = p_term_create_variable(context);
+    P_VERIFY(p_term_bind_variable
+                (context, var, context->true_atom, P_BIND_DEFAULT));
+    P_VERIFY(p_context_mark_trail(context) == marker);
+}
+
+static void test_clause_selection()
+{
+    static char const select_source[] =
+        "len([], 0).\n"
+        "len([H|T], N) { len(T, M); N is M + 1; }\n"
+        "colour(red, 1).\n"
+        "colour(green, 2).\n"
+        "colour(X, 3).\n"
+        ;
+    P_VERIFY(p_context_consult_string(context, select_source) == 0);
+
+    /* Clause selection on the first argument means that no choice
+     * points are left behind for either clause of len/2.  The current
+     * node after a top-level success is the choice point, if any */
+    P_COMPARE(run_goal("len([a, b, c], N), N == 3"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("len([], N), N == 0"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("len(L, 0), L == []"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node != 0);
+
+    /* Clauses with a variable argument must be tried after the
+     * clauses with a matching constant, and in order */
+    P_COMPARE(run_goal("colour(blue, N), N == 3"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("colour(green, N)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node != 0);
+    P_COMPARE(p_context_reexecute_goal(context, 0), P_RESULT_TRUE);
+    P_COMPARE(p_context_reexecute_goal(context, 0), P_RESULT_FAIL);
+    P_COMPARE(run_goal("colour(C, N), C == red, N == 1"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("colour(f(x), N), N == 3"), P_RESULT_TRUE);
+}
+
+static void test_argument_indexes()
+{
+    char line[64];
+    int id;
+
+    /* Build a fact table that is looked up on the second and
+     * third arguments as well as on the first */
+    for (id = 0; id < 80; ++id) {
+        sprintf(line, "emp(%d, d%d, r%d).\n", id, id % 5, id % 4);
+        P_VERIFY(p_context_consult_string(context, line) == 0);
+    }
+    P_VERIFY(p_context_consult_string
+                (context, "emp(100, d9, r9).\n") == 0);
+
+    /* The only clause with the key is selected deterministically */
+    P_COMPARE(run_goal("emp(N, d9, R), N == 100, R == r9"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("emp(N, D, r9), N == 100"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("emp(N, d7, R)"), P_RESULT_FAIL);
+
+    /* Combinations of bound arguments narrow the clauses down to
+     * the ones that match on both, in clause order */
+    P_COMPARE(run_goal("emp(N, d3, r1), N == 13"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node != 0);
+    P_COMPARE(run_goal("emp(N, d3, r1), N == 73"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("emp(N, d4, r3), N == 79"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+
+    /* The indexes are kept up to date as clauses are added and removed,
+     * including clauses that have a variable in an indexed argument */
+    P_COMPARE(run_goal("assertz(emp(101, d9, r9))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("emp(N, d9, r9), N == 101"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("retract(emp(100, d9, r9))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("emp(N, d9, R), N == 101"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("asserta(emp(200, D, r5))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("emp(N, d3, r5), N == 200"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("emp(N, d3, r1), N == 13"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("emp(N, d3, R), N == 200"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("retract(emp(200, D, r5))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("emp(N, d3, r5)"), P_RESULT_FAIL);
+}
+
+static void test_index_growth()
+{
+    static char const growth_source[] =
+        "big_fill(N, N) { commit; }\n"
+        "big_fill(I, N) { assertz(big(I, I)); J is I + 1; big_fill(J, N); }\n"
+        "big_check(N, N, _) { commit; }\n"
+        "big_check(I, N, S) { big(X, I); X == I; J is I + S; big_check(J, N, S); }\n"
+        "big_drop(N, N) { commit; }\n"
+        "big_drop(I, N) { retract(big(I, I)); J is I + 2; big_drop(J, N); }\n"
+        ;
+    P_VERIFY(p_context_consult_string(context, growth_source) == 0);
+
+    /* Build the index on the second argument while the predicate is
+     * small, and then grow it through several resizes of its table */
+    P_COMPARE(run_goal("big_fill(0, 8)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big(X, 3), X == 3"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big_fill(8, 3000)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big_check(0, 3000, 1)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big(X, 2999), X == 2999"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("big(X, 3000)"), P_RESULT_FAIL);
+
+    /* Remove every second key and then add some of them back */
+    P_COMPARE(run_goal("big_drop(0, 3000)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big_check(1, 3001, 2)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big(X, 1000)"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("big(X, 1001), X == 1001"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("asserta(big(-1, 1000))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("big(X, 1000), X == -1"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+}
+
+/* Counts the solutions of "goal" */
+static int count_solutions(const char *goal)
+{
+    char line[128];
+    int count = 0;
+    sprintf(line, "\?\?-- %s.\n", goal);
+    if (execute_goal(line, 0) != P_RESULT_TRUE)
+        return 0;
+    do {
+        ++count;
+    } while (p_context_reexecute_goal(context, 0) == P_RESULT_TRUE);
+    return count;
+}
+
+static void test_index_resize()
+{
+    static char const resize_source[] =
+        "rz_fill(N, N) { commit; }\n"
+        "rz_fill(I, N) { assertz(rz(I, I)); J is I + 1; rz_fill(J, N); }\n"
+        ;
+    p_database_info *info;
+    p_term_index *index;
+    char line[64];
+    int num_keys = 8;
+    int key;
+    P_VERIFY(p_context_consult_string(context, resize_source) == 0);
+
+    /* Build the index on the second argument */
+    P_COMPARE(run_goal("rz_fill(0, 8)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("rz(X, 3), X == 3"), P_RESULT_TRUE);
+    info = _p_db_find_arity(p_term_create_atom(context, "rz"), 2);
+    P_VERIFY(info != 0 && info->predicate != 0);
+    index = info->predicate->predicate.indexes;
+    while (index && index->arg != 1)
+        index = index->next;
+    P_VERIFY(index != 0);
+
+    /* Add keys until the table is resized, and then one more so that
+     * some of the entries have been moved across to the new table */
+    while (!index->keys.old_entries && num_keys < 1000) {
+        sprintf(line, "\?\?-- assertz(rz(%d, %d)).\n", num_keys, num_keys);
+        P_COMPARE(execute_goal(line, 0), P_RESULT_TRUE);
+        ++num_keys;
+    }
+    sprintf(line, "\?\?-- assertz(rz(%d, %d)).\n", num_keys, num_keys);
+    P_COMPARE(execute_goal(line, 0), P_RESULT_TRUE);
+    ++num_keys;
+    P_VERIFY(index->keys.old_entries != 0 && index->keys.old_posn > 0);
+
+    /* A clause with a variable in the indexed argument goes into
+     * every bucket exactly once, and is removed from all of them */
+    P_COMPARE(run_goal("assertz(rz(any, _))"), P_RESULT_TRUE);
+    P_VERIFY(index->keys.old_entries != 0);
+    for (key = 0; key < num_keys; ++key) {
+        sprintf(line, "rz(_, %d)", key);
+        P_TEST_SET_ROW(line);
+        P_COMPARE(count_solutions(line), 2);
+    }
+    P_COMPARE(run_goal("retract(rz(any, _))"), P_RESULT_TRUE);
+    for (key = 0; key < num_keys; ++key) {
+        sprintf(line, "rz(_, %d)", key);
+        P_TEST_SET_ROW(line);
+        P_COMPARE(count_solutions(line), 1);
+    }
+    P_COMPARE(run_goal("rz(any, _)"), P_RESULT_FAIL);
+}
+
+static void test_deep_indexes()
+{
+    char line[64];
+    int id;
+
+    /* All of the keys are wrapped in node/1, so the index needs to
+     * look inside the compound term to select a single clause */
+    for (id = 0; id < 40; ++id) {
+        sprintf(line, "edge(node(%d), node(%d)).\n", id, id + 1);
+        P_VERIFY(p_context_consult_string(context, line) == 0);
+    }
+    P_COMPARE(run_goal("edge(node(17), Y), Y == node(18)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("edge(X, node(18)), X == node(17)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("edge(node(40), Y)"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("edge(leaf(17), Y)"), P_RESULT_FAIL);
+
+    /* The switch code only dispatches on node/1, so the index must
+     * still be consulted for the switch argument once it is built */
+    for (id = 0; id < 20; ++id)
+        P_COMPARE(run_goal("edge(node(5), node(6))"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+
+    /* Turning off sub-term indexing leaves a choice point behind */
+    P_COMPARE(run_goal("index_depth(edge/2, 0)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("edge(node(17), Y), Y == node(18)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node != 0);
+    P_COMPARE(run_goal("index_depth(edge/2, 1)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("edge(node(17), Y), Y == node(18)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+
+    /* Clauses that don't follow the pattern must still be found */
+    P_COMPARE(run_goal("assertz(edge(node(X), root))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("assertz(edge(leaf, node(0)))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("edge(node(17), Y), Y == root"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("edge(node(foo), Y), Y == root"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_COMPARE(run_goal("edge(X, node(0)), X == leaf"), P_RESULT_TRUE);
+
+}
+
+static void test_ground_facts()
+{
+    static char const fact_source[] =
+        "word(cat, noun, 3).\n"
+        "word(\"dog\", noun, 3.5).\n"
+        "word(run, verb(intransitive), [r, u, n]).\n"
+        "word(X, unknown, 0).\n"
+        "word.\n"
+        ;
+    p_term *pred;
+    p_term *clause;
+    p_term_clause_iter iter;
+    int facts = 0;
+    int compiled = 0;
+    P_VERIFY(p_context_consult_string(context, fact_source) == 0);
+
+    /* Ground facts are stored as tuples, other clauses are compiled */
+    pred = p_term_lookup_predicate
+        (context, p_term_create_atom(context, "word"), 3);
+    P_VERIFY(pred != 0);
+    p_term_clauses_begin(pred, 0, &iter);
+    while ((clause = p_term_clauses_next(&iter)) != 0) {
+        if (p_term_clause_is_fact(&(clause->clause)))
+            ++facts;
+        else
+            ++compiled;
+    }
+    P_COMPARE(facts, 3);
+    P_COMPARE(compiled, 1);
+
+    P_COMPARE(run_goal("word(cat, C, N), C == noun, N == 3"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("word(\"dog\", noun, N), N == 3.5"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("word(run, verb(T), [H|L]), T == intransitive, H == r, L == [u, n]"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("word(run, verb(transitive), L)"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("word(dog, C, N), C == unknown"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("word(W, verb(_), _), W == run"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("word"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("clause(word(cat, C, N), B), B == true, N == 3"), P_RESULT_TRUE);
+
+    /* Bound variables in an asserted fact are copied out of the
+     * fact, so that backtracking cannot undo the bindings */
+    P_COMPARE(run_goal("X = f(1, [a]), assertz(copied(X, [X])), assertz(copied(X, [])), fail"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("copied(f(1, [a]), L), L == [f(1, [a])]"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("retract(copied(f(A, B), [C])), A == 1"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("copied(f(1, [a]), [_])"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("copied(f(1, [a]), [])"), P_RESULT_TRUE);
+}
+
+/* Counts the clauses of name/arity that are not compiled yet */
+static int count_lazy_clauses(const char *name, int arity)
+{
+    p_term *pred;
+    p_term *clause;
+    p_term_clause_iter iter;
+    int count = 0;
+    pred = p_term_lookup_predicate
+        (context, p_term_create_atom(context, name), arity);
+    p_term_clauses_begin(pred, 0, &iter);
+    while ((clause = p_term_clauses_next(&iter)) != 0) {
+        if (p_term_clause_is_lazy(&(clause->clause)))
+            ++count;
+    }
+    return count;
+}
+
+static void test_lazy_compile()
+{
+    static char const lazy_source[] =
+        "lazy_len([], 0).\n"
+        "lazy_len([H|T], N) { lazy_len(T, M); N is M + 1; }\n"
+        "lazy_member(X, [X|T]).\n"
+        "lazy_member(X, [H|T]) { lazy_member(X, T); }\n"
+        ;
+    static char const eager_source[] =
+        "eager_member(X, [X|T]).\n"
+        "eager_member(X, [H|T]) { eager_member(X, T); }\n"
+        ;
+    char line[64];
+    int id;
+
+    /* Clauses are compiled when their predicate is first called */
+    P_VERIFY(!p_context_is_eager_compile(context));
+    P_VERIFY(p_context_consult_string(context, lazy_source) == 0);
+    P_COMPARE(count_lazy_clauses("lazy_len", 2), 1);
+    P_COMPARE(count_lazy_clauses("lazy_member", 2), 2);
+    P_COMPARE(run_goal("lazy_len([a, b, c], N), N == 3"), P_RESULT_TRUE);
+    P_COMPARE(count_lazy_clauses("lazy_len", 2), 0);
+    P_COMPARE(count_lazy_clauses("lazy_member", 2), 2);
+
+    /* Inspecting a clause compiles it */
+    P_COMPARE(run_goal("clause(lazy_member(a, L), B), B == true"), P_RESULT_TRUE);
+    P_COMPARE(count_lazy_clauses("lazy_member", 2), 0);
+    P_COMPARE(run_goal("lazy_member(c, [a, b, c])"), P_RESULT_TRUE);
+
+    /* Clauses that are consulted after the predicate has been
+     * called and indexed are compiled for the indexes */
+    for (id = 0; id < 10; ++id) {
+        sprintf(line, "lazy_pick(%d, X) { X = item(%d); }\n", id, id);
+        P_VERIFY(p_context_consult_string(context, line) == 0);
+    }
+    P_COMPARE(run_goal("lazy_pick(4, X), X == item(4)"), P_RESULT_TRUE);
+    P_VERIFY(context->current_node == 0);
+    P_VERIFY(p_context_consult_string(context, "lazy_pick(10, X) { X = last; }\n") == 0);
+    P_COMPARE(count_lazy_clauses("lazy_pick", 2), 0);
+    P_COMPARE(run_goal("lazy_pick(10, X), X == last"), P_RESULT_TRUE);
+
+    /* Eager compilation does not leave any clauses behind */
+    p_context_set_eager_compile(context, 1);
+    P_VERIFY(p_context_is_eager_compile(context));
+    P_VERIFY(p_context_consult_string(context, eager_source) == 0);
+    P_COMPARE(count_lazy_clauses("eager_member", 2), 0);
+    P_COMPARE(run_goal("eager_member(b, [a, b, c])"), P_RESULT_TRUE);
+    p_context_set_eager_compile(context, 0);
+}
+
+static void write_file(const char *filename, const char *contents)
+{
+    FILE *file = fopen(filename, "w");
+    P_VERIFY(file != 0);
+    fputs(contents, file);
+    fclose(file);
+}
+
+/* Consults "filename" into a new context with the cache enabled */
+static p_context *consult_cached(const char *filename)
+{
+    p_context *cached = p_context_create();
+    p_context_set_consult_cache(cached, 1);
+    P_VERIFY(p_context_consult_file
+                (cached, filename, P_CONSULT_DEFAULT) == 0);
+    return cached;
+}
+
+static void test_consult_cache()
+{
+    static char const cache_source[] =
+        ":- import(\"test-cache-import\").\n"
+        ":- assertz(cache_loads(1)).\n"
+        "cache_fact(a, \"str\", -42, 1.5, [x, y | T], T).\n"
+        "cache_rule(X, Y) { cache_fact(X, _, N, _, _, _); Y is N * 2; }\n"
+        "class cache_point { var x\n new(X) { Self.x = X; } }\n"
+        "cache_point_x(X) { new cache_point(P, 7); X = P.x; }\n"
+        ;
+    static char const import_source[] =
+        "cache_imported(yes).\n"
+        ;
+    p_context *save_context = context;
+    char header[4];
+    FILE *file;
+
+    remove("test-cache.lpc");
+    remove("test-cache-import.lpc");
+    write_file("test-cache.lp", cache_source);
+    write_file("test-cache-import.lp", import_source);
+
+    /* The first consult parses the sources and writes the caches */
+    context = consult_cached("test-cache.lp");
+    p_context_free(context);
+    file = fopen("test-cache.lpc", "rb");
+    P_VERIFY(file != 0);
+    P_COMPARE(fread(header, 1, sizeof(header), file), sizeof(header));
+    fclose(file);
+    P_VERIFY(!memcmp(header, "PLC", 3));
+    file = fopen("test-cache-import.lpc", "rb");
+    P_VERIFY(file != 0);
+    fclose(file);
+
+    /* The second consult loads the caches and re-runs the directives */
+    context = consult_cached("test-cache.lp");
+    P_COMPARE(run_goal("retract(cache_loads(1)), assertz(cache_loads(0)), \\+ cache_loads(1)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("cache_fact(a, S, N, R, L, [])"
+                       ", S == \"str\", N == -42, R == 1.5, L == [x, y]"),
+              P_RESULT_TRUE);
+    P_COMPARE(run_goal("cache_rule(a, Y), Y == -84"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("cache_point_x(X), X == 7"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("cache_imported(yes)"), P_RESULT_TRUE);
+    p_context_free(context);
+
+    /* Changing the source causes it to be parsed again */
+    write_file("test-cache-import.lp", "cache_imported(no).\n");
+    context = consult_cached("test-cache.lp");
+    P_COMPARE(run_goal("cache_imported(no)"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("cache_rule(a, Y), Y == -84"), P_RESULT_TRUE);
+    p_context_free(context);
+
+    context = save_context;
+    remove("test-cache.lp");
+    remove("test-cache.lpc");
+    remove("test-cache-import.lp");
+    remove("test-cache-import.lpc");
+}
+
+static void test_save_image()
+{
+    static char const image_source[] =
+        ":- dynamic(image_counter/1).\n"
+        ":- index_depth(image_deep/1, 2).\n"
+        "image_fact(a, \"str\", -42, 1.5, [x, y | T], T).\n"
+        "image_rule(X, Y) { image_fact(X, _, N, _, _, _); Y is N * 2; }\n"
+        "class image_shape { var name\n"
+        "    new(N) { Self.name = N; }\n"
+        "    area(A) { A = 0; }\n"
+        "}\n"
+        "class image_square : image_shape { var side\n"
+        "    new(S) { Self.name = square; Self.side = S; }\n"
+        "    area(A) { A is Self.side * Self.side; }\n"
+        "}\n"
+        "image_area(A, N) { new image_square(Sq, 3); Sq.area(A); N = Sq.name; }\n"
+        ":- table(image_path/2).\n"
+        "image_path(X, Y) { image_path(X, Z); image_edge(Z, Y); }\n"
+        "image_path(X, Y) { image_edge(X, Y); }\n"
+        "image_edge(a, b).\n"
+        "image_edge(b, c).\n"
+        "image_edge(c, a).\n"
+        "image_seen(none).\n"
+        ;
+    p_context *save_context = context;
+    p_context *loaded;
+    char header[4];
+    FILE *file;
+
+    /* Build up some state, including clauses that are compiled,
+     * clauses that are not compiled yet, and runtime assertions */
+    context = p_context_create();
+    P_VERIFY(p_context_consult_string(context, image_source) == 0);
+    P_COMPARE(run_goal("image_rule(a, Y), Y == -84"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("assertz(image_asserted(f(X, Y, X), Y))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("assertz(image_deep(g(h(1)))), retract(image_fact(a, _, _, _, _, _))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("assertz(image_fact(b, \"s2\", 7, 2.5, [], []))"), P_RESULT_TRUE);
+    P_VERIFY(p_context_save_image(context, "test-image.pli") == 0);
+    file = fopen("test-image.pli", "rb");
+    P_VERIFY(file != 0);
+    P_COMPARE(fread(header, 1, sizeof(header), file), sizeof(header));
+    fclose(file);
+    P_VERIFY(!memcmp(header, "PLI", 3));
+
+    /* Objects cannot be saved in an image */
+    P_COMPARE(run_goal("new image_shape(S, circle), assertz(image_object(S))"), P_RESULT_TRUE);
+    P_COMPARE(p_context_save_image(context, "test-image-bad.pli"), EINVAL);
+    p_context_free(context);
+
+    /* Load the image into a new context and check the state */
+    loaded = p_context_create();
+    P_VERIFY(p_context_load_image(loaded, "test-image.pli") == 0);
+    context = loaded;
+    P_COMPARE(run_goal("image_fact(a, _, _, _, _, _)"), P_RESULT_FAIL);
+    P_COMPARE(run_goal("image_fact(b, S, N, R, L, T)"
+                       ", S == \"s2\", N == 7, R == 2.5, L == [], T == []"),
+              P_RESULT_TRUE);
+    P_COMPARE(run_goal("image_rule(b, Y), Y == 14"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("image_asserted(f(1, Y, Z), 2), Y == 2, Z == 1"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("image_asserted(f(1, _, 3), _)"), P_RESULT_FAIL);
+
+    /* Builtins that are written in Plang are defined by the new
+     * context, and must not pick up a second copy from the image */
+    P_COMPARE(run_goal("(X in [a, b], assertz(image_seen(X)), fail || true)"
+                       ", retract(image_seen(a)), retract(image_seen(b))"
+                       ", !(image_seen(a) || image_seen(b))"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("image_path(a, c), image_path(c, c)"), P_RESULT_TRUE);
+    P_VERIFY(p_db_predicate_flags
+                (context, p_term_create_atom(context, "image_counter"), 1)
+                    & P_PREDICATE_DYNAMIC);
+    P_COMPARE(run_goal("image_deep(g(h(X))), X == 1"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("image_area(A, N), A == 9, N == square"), P_RESULT_TRUE);
+    P_COMPARE(run_goal("new image_shape(S, blob), S.area(A), A == 0"), P_RESULT_TRUE);
+
+    /* Corrupted images are rejected */
+    write_file("test-image-bad.pli", "PLI\001garbage");
+    P_COMPARE(p_context_load_image(loaded, "test-image-bad.pli"), EINVAL);
+    P_VERIFY(p_context_load_image(loaded, "test-image-missing.pli") != 0);
+    p_context_free(loaded);
+
+    context = save_context;
+    remove("test-image.pli");
+    remove("test-image-bad.pli");
+}
+
 int main(int argc, char *argv[])
 {
     P_TEST_INIT("test-database");
@@ -175,6 +724,17 @@ int main(int argc, char *argv[])
 
     P_TEST_RUN(operators);
     P_TEST_RUN(user_predicate);
+    P_TEST_RUN(last_call);
+    P_TEST_RUN(var_ages);
+    P_TEST_RUN(clause_selection);
+    P_TEST_RUN(argument_indexes);
+    P_TEST_RUN(index_growth);
+    P_TEST_RUN(index_resize);
+    P_TEST_RUN(deep_indexes);
+    P_TEST_RUN(ground_facts);
+    P_TEST_RUN(lazy_compile);
+    P_TEST_RUN(consult_cache);
+    P_TEST_RUN(save_image);
 
     P_TEST_REPORT();
     return P_TEST_EXIT_CODE();
@@ -19,6 +19,7 @@
 
 #include "testcase.h"
 #include <plang/term.h>
+#include <plang/database.h>
 #include <config.h>
 #ifdef HAVE_GC_GC_H
 #include <gc/gc.h>
@@ -361,6 +362,52 @@ static void test_atom()
     P_VERIFY(strcmp(p_term_name(atom3), "bar") == 0);
 }
 
+/* Creates atoms that are not referenced from anywhere, so that
+ * the garbage collector is free to reclaim them */
+static void create_garbage_atoms(int count)
+{
+    char name[64];
+    int value;
+    for (value = 0; value < count; ++value) {
+        sprintf(name, "garbage_%d", value);
+        p_term_create_atom(context, name);
+    }
+}
+
+static void test_atom_gc()
+{
+    p_term *kept[16];
+    char name[64];
+    int value;
+
+    /* Atoms that are referenced survive collection */
+    for (value = 0; value < 16; ++value) {
+        sprintf(name, "kept_%d", value);
+        kept[value] = p_term_create_atom(context, name);
+    }
+    p_db_set_predicate_flag
+        (context, p_term_create_atom(context, "gc_pinned"), 2,
+         P_PREDICATE_DYNAMIC, 1);
+    create_garbage_atoms(100000);
+    GC_gcollect();
+    create_garbage_atoms(100000);
+    for (value = 0; value < 16; ++value) {
+        sprintf(name, "kept_%d", value);
+        P_VERIFY(p_term_create_atom(context, name) == kept[value]);
+        P_VERIFY(strcmp(p_term_name(kept[value]), name) == 0);
+    }
+
+    /* Atoms with database information are pinned, even when
+     * nothing else refers to them */
+    P_COMPARE(p_db_predicate_flags
+                (context, p_term_create_atom(context, "gc_pinned"), 2),
+              P_PREDICATE_DYNAMIC);
+
+    /* Reclaimed atoms are created again on demand */
+    P_VERIFY(strcmp(p_term_name(p_term_create_atom(context, "garbage_7")),
+                    "garbage_7") == 0);
+}
+
 static void test_standard_atoms()
 {
     p_term *nil_atom = p_term_nil_atom(context);
@@ -459,6 +506,14 @@ static void test_integer()
 
     P_VERIFY(p_term_bind_variable(context, var, int2, P_BIND_DEFAULT));
     P_COMPARE(p_term_integer_value(var), 124);
+
+    /* Small integers are shared, but large ones are not */
+    P_VERIFY(p_term_create_integer(context, 124) == int2);
+    P_VERIFY(p_term_create_integer(context, -124) == int3);
+    int1 = p_term_create_integer(context, 0x7fffffff);
+    P_VERIFY(int1 != int4);
+    P_COMPARE(p_term_integer_value(int1), 0x7fffffff);
+    P_VERIFY(p_term_unify(context, int1, int4, P_BIND_DEFAULT));
 }
 
 static void test_real()
@@ -1036,6 +1091,111 @@ static void test_precedes()
     clear_parse_state();
 }
 
+/* Build a term that is nested "depth" levels deep on either the
+ * first or last argument, ending in "leaf" */
+static p_term *deep_term(int depth, int left, p_term *leaf)
+{
+    p_term *f_atom = p_term_create_atom(context, "f");
+    p_term *a_atom = p_term_create_atom(context, "a");
+    p_term *term = leaf;
+    p_term *next;
+    while (depth-- > 0) {
+        next = p_term_create_functor(context, f_atom, 2);
+        p_term_bind_functor_arg(next, left ? 0 : 1, term);
+        p_term_bind_functor_arg(next, left ? 1 : 0, a_atom);
+        term = next;
+    }
+    return term;
+}
+
+/* Unify, compare, clone, and occurs check on terms that are
+ * too deep for a traversal that recurses on the C stack */
+static void test_deep_terms()
+{
+    static int const left_values[] = {0, 1};
+    int depth = 1000000;
+    size_t index;
+    p_term *b_atom = p_term_create_atom(context, "b");
+    p_term *c_atom = p_term_create_atom(context, "c");
+    p_term *term1;
+    p_term *term2;
+    p_term *var;
+    p_term *clone;
+    for (index = 0; index < 2; ++index) {
+        P_TEST_SET_ROW(left_values[index] ? "left" : "right");
+        term1 = deep_term(depth, left_values[index], b_atom);
+        term2 = deep_term(depth, left_values[index], b_atom);
+        P_VERIFY(p_term_unify(context, term1, term2, P_BIND_DEFAULT));
+        P_COMPARE(p_term_precedes(context, term1, term2), 0);
+
+        term2 = deep_term(depth, left_values[index], c_atom);
+        P_VERIFY(!p_term_unify(context, term1, term2, P_BIND_DEFAULT));
+        P_COMPARE(p_term_precedes(context, term1, term2), -1);
+        P_COMPARE(p_term_precedes(context, term2, term1), 1);
+
+        var = p_term_create_variable(context);
+        term2 = deep_term(depth, left_values[index], var);
+        P_VERIFY(p_term_unify(context, term1, term2, P_BIND_DEFAULT));
+        P_VERIFY(p_term_deref(var) == b_atom);
+
+        var = p_term_create_variable(context);
+        term2 = deep_term(depth, left_values[index], var);
+        P_VERIFY(!p_term_bind_variable
+                    (context, var, term2, P_BIND_DEFAULT));
+        clone = p_term_clone(context, term2);
+        P_VERIFY(clone != 0 && clone != term2);
+        P_VERIFY(p_term_unify(context, clone, term1, P_BIND_DEFAULT));
+        P_VERIFY(p_term_deref(var) == var);
+    }
+}
+
+static void test_trail()
+{
+    p_term *f_atom = p_term_create_atom(context, "f");
+    p_term *a_atom = p_term_create_atom(context, "a");
+    p_term *b_atom = p_term_create_atom(context, "b");
+    p_term *old_var;
+    p_term *named_var;
+    p_term *new_var;
+    p_term *term1;
+    p_term *term2;
+    void *marker1;
+    void *marker2;
+
+    /* Bindings of variables from before the marker are undone */
+    old_var = p_term_create_variable(context);
+    named_var = p_term_create_named_variable(context, "Named");
+    marker1 = p_context_mark_trail(context);
+    P_VERIFY(p_term_bind_variable(context, old_var, a_atom, P_BIND_DEFAULT));
+    P_VERIFY(p_term_bind_variable(context, named_var, a_atom, P_BIND_DEFAULT));
+    P_VERIFY(p_context_mark_trail(context) != marker1);
+    p_context_backtrack_trail(context, marker1);
+    P_VERIFY(p_term_deref(old_var) == old_var);
+    P_VERIFY(p_term_deref(named_var) == named_var);
+    P_VERIFY(strcmp(p_term_name(named_var), "Named") == 0);
+    P_COMPARE(p_term_name_length(named_var), (size_t)5);
+
+    /* Bindings of variables created after the marker are not trailed */
+    marker1 = p_context_mark_trail(context);
+    new_var = p_term_create_variable(context);
+    P_VERIFY(p_term_bind_variable(context, new_var, a_atom, P_BIND_DEFAULT));
+    P_VERIFY(p_term_unify(context, new_var, a_atom, P_BIND_DEFAULT));
+    marker2 = p_context_mark_trail(context);
+    P_VERIFY(marker2 == marker1);
+
+    /* A failed unification still backs out its partial bindings */
+    new_var = p_term_create_variable(context);
+    term1 = p_term_create_functor(context, f_atom, 2);
+    p_term_bind_functor_arg(term1, 0, new_var);
+    p_term_bind_functor_arg(term1, 1, a_atom);
+    term2 = p_term_create_functor(context, f_atom, 2);
+    p_term_bind_functor_arg(term2, 0, a_atom);
+    p_term_bind_functor_arg(term2, 1, b_atom);
+    P_VERIFY(!p_term_unify(context, term1, term2, P_BIND_DEFAULT));
+    P_VERIFY(p_term_deref(new_var) == new_var);
+    P_VERIFY(p_context_mark_trail(context) == marker2);
+}
+
 static void test_witness()
 {
     struct witness_type
@@ -1144,6 +1304,7 @@ int main(int argc, char *argv[])
     P_TEST_CREATE_CONTEXT();
 
     P_TEST_RUN(atom);
+    P_TEST_RUN(atom_gc);
     P_TEST_RUN(standard_atoms);
     P_TEST_RUN(string);
     P_TEST_RUN(integer);
@@ -1156,6 +1317,8 @@ int main(int argc, char *argv[])
     P_TEST_RUN(predicate);
     P_TEST_RUN(unify);
     P_TEST_RUN(precedes);
+    P_TEST_RUN(deep_terms);
+    P_TEST_RUN(trail);
     P_TEST_RUN(witness);
     P_TEST_RUN(utf8);
 